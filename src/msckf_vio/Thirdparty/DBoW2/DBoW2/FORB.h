@@ -16,6 +16,11 @@
 
 #include "FClass.h"
 
+// Header-only popcount kernel shared with the ORB matchers. It is
+// reached by its path, since DBoW2 is built with only OpenCV on its
+// include path
+#include "../../../include/msckf_vio/hamming.hpp"
+
 namespace DBoW2 {
 
 /// Functions to manipulate ORB descriptors
@@ -44,7 +49,24 @@ public:
    * @param b
    * @return distance
    */
-  static int distance(const TDescriptor &a, const TDescriptor &b);
+  static inline int distance(const TDescriptor &a, const TDescriptor &b)
+  {
+    return msckf_vio::descriptorDistance(a.ptr<uint8_t>(), b.ptr<uint8_t>());
+  }
+
+  /**
+   * Calculates the distances from a descriptor to n descriptors stored
+   * one after the other
+   * @param a descriptor of L bytes
+   * @param b first of the n descriptors of L bytes each
+   * @param n
+   * @param d (out) n distances
+   */
+  static inline void distances(const unsigned char *a,
+    const unsigned char *b, size_t n, int *d)
+  {
+    msckf_vio::descriptorDistances(a, b, n, L, d);
+  }
 
   /**
    * Returns a string version of the descriptor
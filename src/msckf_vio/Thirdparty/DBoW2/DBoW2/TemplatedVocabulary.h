@@ -26,6 +26,13 @@
 #include <algorithm>
 #include <opencv2/core/core.hpp>
 #include <limits>
+#include <cstring>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
@@ -246,6 +253,25 @@ public:
    */
   void saveToTextFile(const std::string &filename) const;  
 
+  /**
+   * Loads the vocabulary from a binary file written by saveToBinaryFile.
+   * The file is memory-mapped read-only, and the flattened tree and the
+   * node descriptors point into the mapping, so the pages are shared
+   * between the processes which load the same file
+   * @param filename
+   * @return false if the file cannot be mapped or is not valid
+   */
+  bool loadFromBinaryFile(const std::string &filename);
+
+  /**
+   * Saves the vocabulary into a binary file, in the layout of the
+   * flattened tree. Only descriptors of F::L bytes (CV_8U) are
+   * supported. The file is in the byte order of the host
+   * @param filename
+   * @return false if the file cannot be written
+   */
+  bool saveToBinaryFile(const std::string &filename) const;
+
   /**
    * Saves the vocabulary into a file
    * @param filename
@@ -355,6 +381,32 @@ protected:
   virtual void transform(const TDescriptor &feature, 
     WordId &id, WordValue &weight, NodeId* nid = NULL, int levelsup = 0) const;
 
+  /**
+   * Returns the words associated to a set of features. On the flattened
+   * tree, the features go down the tree together one level at a time,
+   * and the children of the next node of each feature are prefetched
+   * while the other features are compared
+   * @param features
+   * @param ids (out) word ids
+   * @param weights (out) word weights
+   * @param nids (out) if given, ids of the nodes "levelsup" levels up
+   * @param levelsup
+   */
+  void transform(const std::vector<TDescriptor> &features,
+    std::vector<WordId> &ids, std::vector<WordValue> &weights,
+    std::vector<NodeId> *nids, int levelsup) const;
+
+  /**
+   * Builds a private copy of the flattened tree from m_nodes, if the
+   * descriptors are binary. Otherwise the tree is walked through m_nodes
+   */
+  void buildFlatTree();
+
+  /**
+   * Whether the feature can go down the flattened tree
+   */
+  inline bool isFlatFeature(const TDescriptor &feature) const;
+
   /**
    * Returns the word id associated to a feature
    * @param feature
@@ -425,16 +477,102 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Binary file mapped by loadFromBinaryFile, which holds the
+  /// flattened tree and the node descriptors (NULL if none)
+  void *m_mapped_data;
+  size_t m_mapped_size;
+
+  /**
+   * Unmaps the binary file, if any. The descriptors of the nodes
+   * must not be used afterwards
+   */
+  void releaseMapping();
+
+  /// Layout of the binary file: the header, the node array in the
+  /// order of the node ids, the flattened tree and its descriptors,
+  /// each contiguous. The flattened tree and the descriptors are used
+  /// in place, see FlatNode
+  struct BinaryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t descriptor_size;
+    int32_t k;
+    int32_t L;
+    int32_t scoring;
+    int32_t weighting;
+    uint32_t node_num;
+    uint32_t word_num;
+    uint64_t nodes_offset;
+    uint64_t flat_offset;
+    uint64_t descriptors_offset;
+  };
+
+  struct BinaryNode
+  {
+    uint32_t parent;
+    /// Word id, or NOT_A_WORD for the inner nodes
+    uint32_t word_id;
+    double weight;
+  };
+
+  static const uint32_t BINARY_VERSION = 2;
+  static const uint32_t NOT_A_WORD = 0xffffffff;
+
+  /// Largest number of children of a node of the flattened tree, i.e.
+  /// the largest k of the vocabulary files, so that the distances to
+  /// the children fit on the stack. Larger trees are walked through
+  /// m_nodes
+  static const uint32_t FLAT_MAX_CHILDREN = 20;
+
+  /// Node of the flattened tree, whose children are at the positions
+  /// [first, first + num)
+  struct FlatNode
+  {
+    uint32_t first;
+    uint32_t num;
+    uint32_t id;
+  };
+
+  /// Flattened tree in breadth-first order, so that the children of
+  /// a node are next to each other (NULL if not built). It points
+  /// either into m_flat_node_copy or into the mapped binary file
+  const FlatNode *m_flat_nodes;
+
+  /// Descriptors of the flattened tree, F::L bytes per position, in
+  /// m_flat_descriptor_copy or in the mapped binary file
+  const unsigned char *m_flat_descriptors;
+
+  /// Number of positions of the flattened tree
+  uint32_t m_flat_num;
+
+  /// Flattened tree built by buildFlatTree, for the vocabularies which
+  /// are not loaded from a binary file
+  std::vector<FlatNode> m_flat_node_copy;
+  std::vector<unsigned char> m_flat_descriptor_copy;
   
 };
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+const uint32_t TemplatedVocabulary<TDescriptor,F>::BINARY_VERSION;
+
+template<class TDescriptor, class F>
+const uint32_t TemplatedVocabulary<TDescriptor,F>::NOT_A_WORD;
+
+template<class TDescriptor, class F>
+const uint32_t TemplatedVocabulary<TDescriptor,F>::FLAT_MAX_CHILDREN;
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_mapped_data(NULL), m_mapped_size(0),
+  m_flat_nodes(NULL), m_flat_descriptors(NULL), m_flat_num(0)
 {
   createScoringObject();
 }
@@ -443,7 +581,9 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL),
+  m_mapped_data(NULL), m_mapped_size(0),
+  m_flat_nodes(NULL), m_flat_descriptors(NULL), m_flat_num(0)
 {
   load(filename);
 }
@@ -452,7 +592,9 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL),
+  m_mapped_data(NULL), m_mapped_size(0),
+  m_flat_nodes(NULL), m_flat_descriptors(NULL), m_flat_num(0)
 {
   load(filename);
 }
@@ -516,7 +658,8 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_mapped_data(NULL), m_mapped_size(0),
+  m_flat_nodes(NULL), m_flat_descriptors(NULL), m_flat_num(0)
 {
   *this = voc;
 }
@@ -527,6 +670,21 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::~TemplatedVocabulary()
 {
   delete m_scoring_object;
+  m_nodes.clear();
+  releaseMapping();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::releaseMapping()
+{
+  if(m_mapped_data)
+  {
+    munmap(m_mapped_data, m_mapped_size);
+    m_mapped_data = NULL;
+    m_mapped_size = 0;
+  }
 }
 
 // --------------------------------------------------------------------------
@@ -536,6 +694,8 @@ TemplatedVocabulary<TDescriptor, F>&
 TemplatedVocabulary<TDescriptor,F>::operator=
   (const TemplatedVocabulary<TDescriptor, F> &voc)
 {  
+  if(this == &voc) return *this;
+
   this->m_k = voc.m_k;
   this->m_L = voc.m_L;
   this->m_scoring = voc.m_scoring;
@@ -545,9 +705,19 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   
   this->m_nodes.clear();
   this->m_words.clear();
+  this->buildFlatTree();
+  
+  this->releaseMapping();
   
   this->m_nodes = voc.m_nodes;
+  // the descriptors of a mapped vocabulary are owned by its mapping
+  if(voc.m_mapped_data)
+  {
+    for(size_t i = 0; i < this->m_nodes.size(); ++i)
+      this->m_nodes[i].descriptor = this->m_nodes[i].descriptor.clone();
+  }
   this->createWords();
+  this->buildFlatTree();
   
   return *this;
 }
@@ -560,6 +730,7 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 {
   m_nodes.clear();
   m_words.clear();
+  buildFlatTree();
   
   // expected_nodes = Sum_{i=0..L} ( k^i )
 	int expected_nodes = 
@@ -583,6 +754,8 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 
   // and set the weight of each node of the tree
   setNodeWeights(training_features);
+
+  buildFlatTree();
   
 }
 
@@ -1077,18 +1250,18 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
   LNorm norm;
   bool must = m_scoring_object->mustNormalize(norm);
 
-	typename vector<TDescriptor>::const_iterator fit;
+  vector<WordId> ids;
+  vector<WordValue> weights;
+  transform(features, ids, weights, NULL, 0);
 
   if(m_weighting == TF || m_weighting == TF_IDF)
   {
-    for(fit = features.begin(); fit < features.end(); ++fit)
+    for(size_t i = 0; i < features.size(); ++i)
     {
-      WordId id;
-      WordValue w; 
+      const WordId id = ids[i];
+      const WordValue w = weights[i];
       // w is the idf value if TF_IDF, 1 if TF
       
-      transform(*fit, id, w);
-      
       // not stopped
       if(w > 0) v.addWeight(id, w);
     }
@@ -1104,14 +1277,12 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
   }
   else // IDF || BINARY
   {
-    for(fit = features.begin(); fit < features.end(); ++fit)
+    for(size_t i = 0; i < features.size(); ++i)
     {
-      WordId id;
-      WordValue w;
+      const WordId id = ids[i];
+      const WordValue w = weights[i];
       // w is idf if IDF, or 1 if BINARY
       
-      transform(*fit, id, w);
-      
       // not stopped
       if(w > 0) v.addIfNotExist(id, w);
       
@@ -1140,20 +1311,20 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
   LNorm norm;
   bool must = m_scoring_object->mustNormalize(norm);
   
-  typename vector<TDescriptor>::const_iterator fit;
+  vector<WordId> ids;
+  vector<WordValue> weights;
+  vector<NodeId> nids;
+  transform(features, ids, weights, &nids, levelsup);
   
   if(m_weighting == TF || m_weighting == TF_IDF)
   {
-    unsigned int i_feature = 0;
-    for(fit = features.begin(); fit < features.end(); ++fit, ++i_feature)
+    for(unsigned int i_feature = 0; i_feature < features.size(); ++i_feature)
     {
-      WordId id;
-      NodeId nid;
-      WordValue w; 
+      const WordId id = ids[i_feature];
+      const NodeId nid = nids[i_feature];
+      const WordValue w = weights[i_feature];
       // w is the idf value if TF_IDF, 1 if TF
       
-      transform(*fit, id, w, &nid, levelsup);
-      
       if(w > 0) // not stopped
       { 
         v.addWeight(id, w);
@@ -1172,16 +1343,13 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
   }
   else // IDF || BINARY
   {
-    unsigned int i_feature = 0;
-    for(fit = features.begin(); fit < features.end(); ++fit, ++i_feature)
+    for(unsigned int i_feature = 0; i_feature < features.size(); ++i_feature)
     {
-      WordId id;
-      NodeId nid;
-      WordValue w;
+      const WordId id = ids[i_feature];
+      const NodeId nid = nids[i_feature];
+      const WordValue w = weights[i_feature];
       // w is idf if IDF, or 1 if BINARY
       
-      transform(*fit, id, w, &nid, levelsup);
-      
       if(w > 0) // not stopped
       {
         v.addIfNotExist(id, w);
@@ -1226,6 +1394,34 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
   const int nid_level = m_L - levelsup;
   if(nid_level <= 0 && nid != NULL) *nid = 0; // root
 
+  if(isFlatFeature(feature) && m_flat_nodes[0].num > 0)
+  {
+    // the children of a node are compared in one batch, and the
+    // first closest one is taken as below
+    const unsigned char *query = feature.data;
+    int distances[FLAT_MAX_CHILDREN];
+    uint32_t pos = 0; // root
+    int level = 0;
+    while(m_flat_nodes[pos].num > 0)
+    {
+      const FlatNode &node = m_flat_nodes[pos];
+      F::distances(query, &m_flat_descriptors[(size_t)node.first*F::L],
+        node.num, distances);
+      uint32_t best = 0;
+      for(uint32_t i = 1; i < node.num; ++i)
+        if(distances[i] < distances[best]) best = i;
+      pos = node.first + best;
+
+      ++level;
+      if(nid != NULL && level == nid_level)
+        *nid = m_flat_nodes[pos].id;
+    }
+
+    word_id = m_nodes[m_flat_nodes[pos].id].word_id;
+    weight = m_nodes[m_flat_nodes[pos].id].weight;
+    return;
+  }
+
   NodeId final_id = 0; // root
   int current_level = 0;
 
@@ -1260,6 +1456,147 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::transform(
+  const std::vector<TDescriptor> &features,
+  std::vector<WordId> &ids, std::vector<WordValue> &weights,
+  std::vector<NodeId> *nids, int levelsup) const
+{
+  const size_t n = features.size();
+  ids.resize(n);
+  weights.resize(n);
+  if(nids != NULL) nids->assign(n, 0);
+
+  bool flat = m_flat_num > 0 && m_flat_nodes[0].num > 0;
+  for(size_t i = 0; flat && i < n; ++i)
+    flat = isFlatFeature(features[i]);
+
+  if(!flat)
+  {
+    for(size_t i = 0; i < n; ++i)
+      transform(features[i], ids[i], weights[i],
+        nids != NULL ? &(*nids)[i] : NULL, levelsup);
+    return;
+  }
+
+  // level at which the node must be stored in nids, if given
+  const int nid_level = m_L - levelsup;
+
+  // current position of each feature, and the features which have
+  // not reached a leaf yet
+  vector<uint32_t> current(n, 0);
+  vector<uint32_t> active(n);
+  for(size_t i = 0; i < n; ++i) active[i] = i;
+
+  int distances[FLAT_MAX_CHILDREN];
+  for(int level = 1; !active.empty(); ++level)
+  {
+    size_t remaining = 0;
+    for(size_t a = 0; a < active.size(); ++a)
+    {
+      const uint32_t f = active[a];
+      const FlatNode &node = m_flat_nodes[current[f]];
+      F::distances(features[f].data,
+        &m_flat_descriptors[(size_t)node.first*F::L], node.num, distances);
+
+      // the first closest child, as in the single transform
+      uint32_t best = 0;
+      for(uint32_t i = 1; i < node.num; ++i)
+        if(distances[i] < distances[best]) best = i;
+      const uint32_t pos = node.first + best;
+      current[f] = pos;
+
+      const FlatNode &next = m_flat_nodes[pos];
+      if(nids != NULL && level == nid_level)
+        (*nids)[f] = next.id;
+
+      if(next.num > 0)
+      {
+        // fetch the children of the next node, which are compared
+        // once the other features are done with this level
+        const unsigned char *d = &m_flat_descriptors[(size_t)next.first*F::L];
+        for(size_t b = 0; b < (size_t)next.num*F::L; b += 64)
+          __builtin_prefetch(d + b);
+        __builtin_prefetch(&m_flat_nodes[next.first]);
+        active[remaining++] = f;
+      }
+    }
+    active.resize(remaining);
+  }
+
+  for(size_t i = 0; i < n; ++i)
+  {
+    const Node &leaf = m_nodes[m_flat_nodes[current[i]].id];
+    ids[i] = leaf.word_id;
+    weights[i] = leaf.weight;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+inline bool TemplatedVocabulary<TDescriptor,F>::isFlatFeature(
+  const TDescriptor &feature) const
+{
+  return m_flat_num > 0 && feature.type() == CV_8U &&
+    (int)feature.total() == F::L && feature.isContinuous();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::buildFlatTree()
+{
+  m_flat_nodes = NULL;
+  m_flat_descriptors = NULL;
+  m_flat_num = 0;
+  m_flat_node_copy.clear();
+  m_flat_descriptor_copy.clear();
+
+  if(m_nodes.size() < 2)
+    return;
+
+  for(size_t i = 1; i < m_nodes.size(); ++i)
+  {
+    const TDescriptor &d = m_nodes[i].descriptor;
+    if(d.type() != CV_8U || (int)d.total() != F::L || !d.isContinuous())
+      return;
+  }
+
+  // the children of each node get the next free positions, in the
+  // order in which the nodes are reached, i.e. breadth-first
+  vector<FlatNode> flat(m_nodes.size());
+  vector<unsigned char> descriptors(m_nodes.size()*F::L, 0);
+  size_t next = 1;
+  flat[0].id = 0;
+  for(size_t pos = 0; pos < next; ++pos)
+  {
+    const vector<NodeId> &children = m_nodes[flat[pos].id].children;
+    if(next + children.size() > m_nodes.size())
+      return; // not a tree
+    if(children.size() > FLAT_MAX_CHILDREN)
+      return; // walked through m_nodes
+
+    flat[pos].first = next;
+    flat[pos].num = children.size();
+    for(size_t i = 0; i < children.size(); ++i, ++next)
+    {
+      flat[next].id = children[i];
+      memcpy(&descriptors[next*F::L], m_nodes[children[i]].descriptor.data, F::L);
+    }
+  }
+  flat.resize(next);
+  descriptors.resize(next*F::L);
+
+  m_flat_node_copy.swap(flat);
+  m_flat_descriptor_copy.swap(descriptors);
+  m_flat_nodes = &m_flat_node_copy[0];
+  m_flat_descriptors = &m_flat_descriptor_copy[0];
+  m_flat_num = next;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor,F>::getParentNode
   (WordId wid, int levelsup) const
@@ -1345,6 +1682,8 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
 
     m_words.clear();
     m_nodes.clear();
+    buildFlatTree();
+    releaseMapping();
 
     string s;
     getline(f,s);
@@ -1419,12 +1758,223 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
         }
     }
 
+    buildFlatTree();
+
     return true;
 
 }
 
 // --------------------------------------------------------------------------
 
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromBinaryFile(const std::string &filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BinaryHeader))
+  {
+    close(fd);
+    return false;
+  }
+
+  const size_t size = (size_t)st.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+    return false;
+
+  // check the header and the extent of the arrays before using them
+  const unsigned char *bytes = static_cast<const unsigned char*>(data);
+  BinaryHeader header;
+  memcpy(&header, bytes, sizeof(header));
+
+  const bool valid =
+    memcmp(header.magic, "DBOW2BIN", 8) == 0 &&
+    header.version == BINARY_VERSION &&
+    header.descriptor_size == (uint32_t)F::L &&
+    header.k > 0 && (uint32_t)header.k <= FLAT_MAX_CHILDREN && header.L >= 1 && header.L <= 10 &&
+    header.scoring >= 0 && header.scoring <= 5 &&
+    header.weighting >= 0 && header.weighting <= 3 &&
+    header.node_num > 1 && header.word_num <= header.node_num &&
+    header.nodes_offset >= sizeof(BinaryHeader) &&
+    header.nodes_offset % sizeof(double) == 0 &&
+    header.nodes_offset + (uint64_t)header.node_num*sizeof(BinaryNode) <= header.flat_offset &&
+    header.flat_offset % sizeof(uint32_t) == 0 &&
+    header.flat_offset + (uint64_t)header.node_num*sizeof(FlatNode) <= header.descriptors_offset &&
+    header.descriptors_offset + (uint64_t)header.node_num*F::L <= size;
+
+  if(!valid)
+  {
+    std::cerr << "Vocabulary loading failure: This is not a correct binary file!" << endl;
+    munmap(data, size);
+    return false;
+  }
+
+  const BinaryNode *nodes =
+    reinterpret_cast<const BinaryNode*>(bytes + header.nodes_offset);
+  const FlatNode *flat =
+    reinterpret_cast<const FlatNode*>(bytes + header.flat_offset);
+  unsigned char *descriptors =
+    const_cast<unsigned char*>(bytes + header.descriptors_offset);
+
+  // the flattened tree is used in place, so check that it is the
+  // breadth-first order of the nodes before anything is changed
+  vector<bool> reached(header.node_num, false);
+  size_t next = 1;
+  bool tree = flat[0].id == 0;
+  reached[0] = true;
+  for(size_t pos = 0; tree && pos < next; ++pos)
+  {
+    tree = flat[pos].first == next &&
+      flat[pos].num <= (uint32_t)header.k &&
+      next + flat[pos].num <= header.node_num;
+    for(size_t i = next; tree && i < next + flat[pos].num; ++i)
+    {
+      tree = flat[i].id < header.node_num && !reached[flat[i].id] &&
+        nodes[flat[i].id].parent == flat[pos].id;
+      if(tree) reached[flat[i].id] = true;
+    }
+    next += flat[pos].num;
+  }
+
+  if(!tree || next != header.node_num)
+  {
+    std::cerr << "Vocabulary loading failure: Bad tree in binary file!" << endl;
+    munmap(data, size);
+    return false;
+  }
+
+  m_words.clear();
+  m_nodes.clear();
+  buildFlatTree();
+  releaseMapping();
+  m_mapped_data = data;
+  m_mapped_size = size;
+
+  m_k = header.k;
+  m_L = header.L;
+  m_scoring = (ScoringType)header.scoring;
+  m_weighting = (WeightingType)header.weighting;
+  createScoringObject();
+
+  m_nodes.resize(header.node_num);
+  m_words.resize(header.word_num, NULL);
+  for(unsigned int i = 0; i < header.node_num; ++i)
+  {
+    Node &node = m_nodes[i];
+    node.id = i;
+    node.parent = nodes[i].parent;
+    node.weight = nodes[i].weight;
+
+    if(nodes[i].word_id != NOT_A_WORD)
+    {
+      if(nodes[i].word_id >= header.word_num || m_words[nodes[i].word_id])
+      {
+        std::cerr << "Vocabulary loading failure: Bad word of node " << i << endl;
+        m_words.clear();
+        m_nodes.clear();
+        releaseMapping();
+        return false;
+      }
+      node.word_id = nodes[i].word_id;
+      m_words[node.word_id] = &node;
+    }
+  }
+
+  // the children and the descriptors come from the flattened tree; the
+  // descriptors are headers on the mapped bytes, which are not copied
+  for(uint32_t pos = 0; pos < header.node_num; ++pos)
+  {
+    Node &node = m_nodes[flat[pos].id];
+    node.children.reserve(flat[pos].num);
+    for(uint32_t i = flat[pos].first; i < flat[pos].first + flat[pos].num; ++i)
+      node.children.push_back(flat[i].id);
+    if(pos > 0)
+      node.descriptor = cv::Mat(1, F::L, CV_8U, descriptors + (size_t)pos*F::L);
+  }
+
+  m_flat_nodes = flat;
+  m_flat_descriptors = descriptors;
+  m_flat_num = header.node_num;
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::saveToBinaryFile(const std::string &filename) const
+{
+  // the file holds the flattened tree, so every node must be in it
+  if(m_flat_num == 0 || m_flat_num != m_nodes.size())
+    return false;
+
+  fstream f;
+  f.open(filename.c_str(), ios_base::out | ios_base::binary);
+  if(!f.is_open())
+    return false;
+
+  BinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "DBOW2BIN", 8);
+  header.version = BINARY_VERSION;
+  header.descriptor_size = F::L;
+  header.k = m_k;
+  header.L = m_L;
+  header.scoring = m_scoring;
+  header.weighting = m_weighting;
+  header.node_num = m_nodes.size();
+  header.word_num = m_words.size();
+  // the descriptors start on a 32 byte boundary for vector loads
+  header.nodes_offset = sizeof(BinaryHeader);
+  header.flat_offset =
+    header.nodes_offset + m_nodes.size()*sizeof(BinaryNode);
+  header.descriptors_offset =
+    (header.flat_offset + m_flat_num*sizeof(FlatNode) + 31) / 32 * 32;
+
+  f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  vector<bool> is_word(m_nodes.size(), false);
+  for(size_t i = 0; i < m_words.size(); ++i)
+    is_word[m_words[i] - &m_nodes[0]] = true;
+
+  for(size_t i = 0; i < m_nodes.size(); ++i)
+  {
+    BinaryNode node;
+    memset(&node, 0, sizeof(node));
+    node.parent = m_nodes[i].parent;
+    node.word_id = NOT_A_WORD;
+    if(is_word[i])
+      node.word_id = m_nodes[i].word_id;
+    node.weight = m_nodes[i].weight;
+    f.write(reinterpret_cast<const char*>(&node), sizeof(node));
+  }
+
+  f.write(reinterpret_cast<const char*>(m_flat_nodes),
+    m_flat_num*sizeof(FlatNode));
+
+  const vector<char> padding(header.descriptors_offset -
+    header.flat_offset - m_flat_num*sizeof(FlatNode), 0);
+  if(!padding.empty())
+    f.write(&padding[0], padding.size());
+
+  // the children of a node are packed together; the root has no
+  // descriptor, so its position is left zero
+  const vector<char> empty(F::L, 0);
+  f.write(&empty[0], F::L);
+  f.write(reinterpret_cast<const char*>(m_flat_descriptors + F::L),
+    (size_t)(m_flat_num - 1)*F::L);
+
+  return f.good();
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filename) const
 {
@@ -1575,6 +2125,7 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
 {
   m_words.clear();
   m_nodes.clear();
+  buildFlatTree();
   
   cv::FileNode fvoc = fs[name];
   
@@ -1619,6 +2170,8 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
     m_nodes[nid].word_id = wid;
     m_words[wid] = &m_nodes[nid];
   }
+
+  buildFlatTree();
 }
 
 // --------------------------------------------------------------------------
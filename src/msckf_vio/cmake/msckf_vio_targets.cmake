@@ -0,0 +1,123 @@
+# Tools, unit tests and benchmarks of msckf_vio, which are
+# built on top of the libraries of CMakeLists.txt.
+#
+# NOTE: CMakeLists.txt does not include this file yet, so none
+# of the targets below are built. CMakeLists.txt is a git-lfs
+# pointer in this checkout and could not be changed along with
+# them. To build them, add at the end of CMakeLists.txt, once
+# the libraries and the original tests are defined:
+#
+#   include(cmake/msckf_vio_targets.cmake)
+#
+# and add diagnostic_msgs to the catkin components of its
+# find_package, for the /diagnostics publishers of the nodes.
+
+# Offline replay of the EuRoC datasets
+add_executable(replay_runner
+  src/replay_runner.cpp
+)
+add_dependencies(replay_runner
+  ${${PROJECT_NAME}_EXPORTED_TARGETS}
+  ${catkin_EXPORTED_TARGETS}
+)
+target_link_libraries(replay_runner
+  image_processor
+  msckf_vio
+  ${catkin_LIBRARIES}
+  ${OpenCV_LIBRARIES}
+  ${SUITESPARSE_LIBRARIES}
+)
+
+# Conversion of the ORB vocabulary to the binary format
+add_executable(vocabulary_converter
+  src/vocabulary_converter.cpp
+)
+target_link_libraries(vocabulary_converter
+  ${PROJECT_SOURCE_DIR}/Thirdparty/DBoW2/lib/libDBoW2.so
+  ${OpenCV_LIBRARIES}
+)
+
+# Unit tests
+if(CATKIN_ENABLE_TESTING)
+  # Two point ransac test
+  catkin_add_gtest(test_two_point_ransac
+    test/two_point_ransac_test.cpp
+  )
+
+  # Profiler test
+  catkin_add_gtest(test_profiler
+    test/profiler_test.cpp
+  )
+
+  # Pose history test
+  catkin_add_gtest(test_pose_history
+    test/pose_history_test.cpp
+  )
+
+  # Track statistics test
+  catkin_add_gtest(test_track_statistics
+    test/track_statistics_test.cpp
+  )
+
+  # Bounded queue test
+  catkin_add_gtest(test_bounded_queue
+    test/bounded_queue_test.cpp
+  )
+
+  # Worker pool test
+  catkin_add_gtest(test_worker_pool
+    test/worker_pool_test.cpp
+  )
+
+  # ORB kernels test
+  catkin_add_gtest(test_orb_kernels
+    test/orb_kernels_test.cpp
+  )
+
+  # Hamming distance test
+  catkin_add_gtest(test_hamming
+    test/hamming_test.cpp
+  )
+
+  # Descriptor arena test
+  catkin_add_gtest(test_descriptor_arena
+    test/descriptor_arena_test.cpp
+  )
+
+  # Benchmarks, built along with the tests if Google Benchmark
+  # is installed.
+  find_package(benchmark QUIET)
+  if(benchmark_FOUND)
+    # Filter benchmark
+    add_executable(msckf_vio_benchmark
+      test/msckf_vio_benchmark.cpp
+    )
+    add_dependencies(msckf_vio_benchmark
+      ${${PROJECT_NAME}_EXPORTED_TARGETS}
+      ${catkin_EXPORTED_TARGETS}
+    )
+    target_link_libraries(msckf_vio_benchmark
+      msckf_vio
+      benchmark::benchmark
+      ${catkin_LIBRARIES}
+      ${SUITESPARSE_LIBRARIES}
+    )
+
+    # Front end benchmark
+    add_executable(image_processor_benchmark
+      test/image_processor_benchmark.cpp
+    )
+    add_dependencies(image_processor_benchmark
+      ${${PROJECT_NAME}_EXPORTED_TARGETS}
+      ${catkin_EXPORTED_TARGETS}
+    )
+    target_link_libraries(image_processor_benchmark
+      image_processor
+      benchmark::benchmark
+      ${catkin_LIBRARIES}
+      ${OpenCV_LIBRARIES}
+    )
+  else()
+    message(STATUS "Google Benchmark not found, skip the benchmarks")
+  endif()
+endif()
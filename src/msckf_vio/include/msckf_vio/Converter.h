@@ -4,6 +4,7 @@
 #include <opencv2/core/core.hpp>
 
 #include <Eigen/Dense>
+#include <msckf_vio/descriptor_arena.hpp>
 #include <../Thirdparty/g2o/g2o/types/types_six_dof_expmap.h>
 #include <../Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h>
 
@@ -13,7 +14,7 @@ namespace msckf_vio{
     class Converter
     {
     public:
-        static std::vector<cv::Mat> toDescriptorVector(const cv::Mat &Descriptors);
+        static std::vector<cv::Mat> toDescriptorVector(const DescriptorArena &Descriptors);
 
         static g2o::SE3Quat toSE3Quat(const cv::Mat &cvT);
         static g2o::SE3Quat toSE3Quat(const g2o::Sim3 &gSim3);
@@ -9,6 +9,7 @@
 #include <msckf_vio/ORBVocabulary.h>
 #include <msckf_vio/KeyFrame.h>
 #include <msckf_vio/ORBextractor.h>
+#include <msckf_vio/descriptor_arena.hpp>
 
 #include <opencv2/opencv.hpp>
 
@@ -27,8 +28,9 @@ namespace msckf_vio{
             // Copy constructor.
             Frame(const Frame &frame);
 
-            // Constructor for stereo cameras.
-            Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
+            // Constructor for stereo cameras. The images are extracted
+            // by the workers of the pool if given.
+            Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, WorkerPool* pool=NULL);
 
             // Constructor for RGB-D cameras.
             Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
@@ -125,8 +127,8 @@ namespace msckf_vio{
             DBoW2::BowVector mBowVec;
             DBoW2::FeatureVector mFeatVec;
 
-            // ORB descriptor, each row associated to a keypoint.
-            cv::Mat mDescriptors, mDescriptorsRight;
+            // ORB descriptor, each block associated to a keypoint.
+            DescriptorArena mDescriptors, mDescriptorsRight;
 
             // MapPoints associated to keypoints, NULL pointer if no association.
             std::vector<MapPoint*> mvpMapPoints;
@@ -8,6 +8,7 @@
 #include <msckf_vio/ORBextractor.h>
 #include <msckf_vio/Frame.h>
 #include <msckf_vio/KeyFrameDatabase.h>
+#include <msckf_vio/descriptor_arena.hpp>
 
 #include <mutex>
 
@@ -141,7 +142,7 @@ namespace msckf_vio{
         const std::vector<cv::KeyPoint> mvKeysUn;
         const std::vector<float> mvuRight; // negative value for monocular points
         const std::vector<float> mvDepth; // negative value for monocular points
-        const cv::Mat mDescriptors;
+        const DescriptorArena mDescriptors;
 
         //BoW
         DBoW2::BowVector mBowVec;
@@ -8,6 +8,8 @@
 #include<opencv2/core/core.hpp>
 #include<mutex>
 
+#include <msckf_vio/descriptor_arena.hpp>
+
 using namespace std;
 using namespace cv;
 
@@ -52,7 +54,8 @@ namespace msckf_vio{
 
         void ComputeDistinctiveDescriptors();
 
-        cv::Mat GetDescriptor();
+        // Copies the most distinctive descriptor, 32 bytes
+        void GetDescriptor(uint8_t* desc);
 
         void UpdateNormalAndDepth();
 
@@ -106,7 +109,7 @@ namespace msckf_vio{
         Mat mNormalVector;
 
         // Best descriptor to fast matching
-        Mat mDescriptor;
+        uint8_t mDescriptor[DescriptorArena::DESCRIPTOR_SIZE];
 
         // Reference KeyFrame
         KeyFrame* mpRefKF;
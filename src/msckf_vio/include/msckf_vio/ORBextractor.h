@@ -4,6 +4,8 @@
 #include <vector>
 #include <list>
 #include <opencv/cv.h>
+#include <msckf_vio/orb_kernels.hpp>
+#include <msckf_vio/worker_pool.hpp>
 
 using namespace std;
 using namespace cv;
@@ -52,10 +54,19 @@ namespace msckf_vio{
             vector<float> inline GetInverseScaleSigmaSquares(){
                 return mvInvLevelSigma2;
             }
+            // Workers for the levels of the pyramid and the FAST
+            // cells of each level, which may be shared with other
+            // extractors. Serial if NULL.
+            void inline SetWorkerPool(WorkerPool* pool){
+                mpWorkerPool = pool;
+            }
             // void getFASTonly(InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints);
         protected:
             void ComputePyramid(Mat image);
             void ComputeKeyPointsOctTree(vector<vector<KeyPoint>>& allKeypoints);
+            void ComputeKeyPointsLevel(const int level, vector<KeyPoint>& keypoints);
+            // Runs the task for each level, on the workers if any.
+            void ForEachLevel(const WorkerPool::Task& task);
             vector<KeyPoint> DistributeOctTree(const vector<KeyPoint>& vToDistributeKeys, const int &minX,
                                            const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
             int nfeatures;
@@ -69,12 +80,20 @@ namespace msckf_vio{
             vector<int> mnFeaturesPerLevel;
 
             vector<int> umax;
+            // Weights of the orientation moments, built from umax
+            PatchMoments mPatchMoments;
 
             vector<float> mvScaleFactor;
             vector<float> mvInvScaleFactor;    
             vector<float> mvLevelSigma2;
             vector<float> mvInvLevelSigma2;
 
+            WorkerPool* mpWorkerPool;
+
+            // Padded buffers holding the levels of mvImagePyramid, and
+            // the blurred levels, both reused across frames
+            vector<cv::Mat> mvPyramidBuffers;
+            vector<cv::Mat> mvBlurredPyramid;
     };
 }
 #endif
\ No newline at end of file
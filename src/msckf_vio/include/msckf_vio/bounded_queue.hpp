@@ -0,0 +1,119 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_BOUNDED_QUEUE_HPP
+#define MSCKF_VIO_BOUNDED_QUEUE_HPP
+
+#include <stdint.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace msckf_vio {
+
+/*
+ * @brief BoundedQueue A queue of a fixed capacity between
+ *    a producer, e.g. a ros callback, and a worker thread.
+ *
+ *    The producer never blocks. If the queue is full, the
+ *    oldest item is dropped for the new one, i.e. the latest
+ *    items win, so that a slow worker falls behind by at
+ *    most the capacity.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(const size_t capacity = 2) :
+    capacity(std::max<size_t>(capacity, 1)),
+    is_closed(false), dropped_num(0) {}
+
+  void setCapacity(const size_t new_capacity) {
+    std::lock_guard<std::mutex> lock(mtx);
+    capacity = std::max<size_t>(new_capacity, 1);
+    while (items.size() > capacity) {
+      items.pop_front();
+      ++dropped_num;
+    }
+  }
+
+  /*
+   * @brief push Adds an item, dropping the oldest one
+   *    if the queue is full.
+   * @return False if an item is dropped, or if the queue
+   *    is closed and the item is discarded.
+   */
+  bool push(T item) {
+    bool is_dropped = false;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (is_closed) return false;
+      if (items.size() >= capacity) {
+        items.pop_front();
+        ++dropped_num;
+        is_dropped = true;
+      }
+      items.push_back(std::move(item));
+    }
+    cv.notify_one();
+    return !is_dropped;
+  }
+
+  /*
+   * @brief pop Waits for the oldest item.
+   * @return False if the queue is closed and empty.
+   */
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this]() { return is_closed || !items.empty(); });
+    if (items.empty()) return false;
+    item = std::move(items.front());
+    items.pop_front();
+    return true;
+  }
+
+  /*
+   * @brief close Wakes up the worker, which gets the items
+   *    left and then false from pop. Later items are discarded.
+   */
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      is_closed = true;
+    }
+    cv.notify_all();
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    items.clear();
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return items.size();
+  }
+
+  // Number of items dropped since the start.
+  uint64_t droppedNumber() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return dropped_num;
+  }
+
+private:
+  mutable std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<T> items;
+  size_t capacity;
+  bool is_closed;
+  uint64_t dropped_num;
+};
+
+} // end namespace msckf_vio
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_CALIBRATION_H
+#define MSCKF_VIO_CALIBRATION_H
+
+#include <new>
+#include <string>
+#include <boost/align/aligned_alloc.hpp>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include <Eigen/Geometry>
+
+namespace msckf_vio {
+
+/*
+ * @brief CameraCalibration Intrinsic calibration of a camera
+ *    in the Kalibr format.
+ */
+struct CameraCalibration {
+  std::string distortion_model;
+  cv::Vec2i resolution;
+  cv::Vec4d intrinsics;
+  cv::Vec4d distortion_coeffs;
+};
+
+/*
+ * @brief StereoCalibration Calibration of the stereo rig and
+ *    the imu, which is loaded once and shared by the image
+ *    processor and the filter. It is immutable once created.
+ *
+ *    cam0 and cam1 are the left and right cameras of the
+ *    pair, which are not necessarily cam0 and cam1 of the
+ *    calibration file.
+ *
+ *    The transforms used by the filter at every update come
+ *    first, and the object is aligned to a cache line.
+ */
+struct alignas(64) StereoCalibration {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  // Takes a vector from the cam0 frame to the cam1 frame.
+  Eigen::Isometry3d T_cam0_cam1;
+  // Takes a vector from the imu frame to the body frame.
+  // The z axis of the body frame should point upwards.
+  // Normally, this transform should be identity.
+  Eigen::Isometry3d T_imu_body;
+  // Takes a vector from the imu frame to the cam0 frame.
+  Eigen::Isometry3d T_imu_cam0;
+
+  CameraCalibration cam0;
+  CameraCalibration cam1;
+
+  /*
+   * @brief create Allocates a calibration with identity
+   *    transforms on a cache line boundary.
+   */
+  static boost::shared_ptr<StereoCalibration> create() {
+    void* memory = boost::alignment::aligned_alloc(
+        alignof(StereoCalibration), sizeof(StereoCalibration));
+    if (!memory) throw std::bad_alloc();
+    return boost::shared_ptr<StereoCalibration>(
+        ::new (memory) StereoCalibration(), Deleter());
+  }
+
+private:
+  StereoCalibration() :
+    T_cam0_cam1(Eigen::Isometry3d::Identity()),
+    T_imu_body(Eigen::Isometry3d::Identity()),
+    T_imu_cam0(Eigen::Isometry3d::Identity()) {}
+
+  struct Deleter {
+    void operator()(StereoCalibration* calibration) const {
+      calibration->~StereoCalibration();
+      boost::alignment::aligned_free(calibration);
+    }
+  };
+};
+
+typedef boost::shared_ptr<const StereoCalibration> StereoCalibrationConstPtr;
+
+} // end namespace msckf_vio
+
+#endif
@@ -43,9 +43,6 @@ struct CAMState {
   Eigen::Vector4d orientation_null;
   Eigen::Vector3d position_null;
 
-  // Takes a vector from the cam0 frame to the cam1 frame.
-  static Eigen::Isometry3d T_cam0_cam1;
-
   CAMState(): id(0), time(0),
     orientation(Eigen::Vector4d(0, 0, 0, 1)),
     position(Eigen::Vector3d::Zero()),
@@ -0,0 +1,48 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_CPU_FEATURES_HPP
+#define MSCKF_VIO_CPU_FEATURES_HPP
+
+/*
+ * Runtime dispatch of the AVX2 kernels.
+ *
+ * The package is built without -march or -mavx2, so that the
+ * binaries run on any x86-64. The AVX2 kernels are compiled
+ * anyway with MSCKF_VIO_TARGET_AVX2, i.e. the target attribute
+ * of GCC and Clang, and are called only if cpuSupportsAvx2()
+ * holds. With MSCKF_VIO_DISABLE_SIMD, or on other architectures
+ * and compilers, only the scalar code is compiled.
+ */
+#if !defined(MSCKF_VIO_DISABLE_SIMD) && defined(__GNUC__) && \
+  (defined(__x86_64__) || defined(__i386__))
+#define MSCKF_VIO_AVX2_DISPATCH
+#define MSCKF_VIO_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+namespace msckf_vio {
+
+/*
+ * @brief cpuSupportsAvx2 Whether the AVX2 kernels can run on
+ *    this cpu. The cpu is queried once.
+ */
+inline bool cpuSupportsAvx2() {
+#if defined(MSCKF_VIO_AVX2_DISPATCH) && defined(__AVX2__)
+  return true;
+#elif defined(MSCKF_VIO_AVX2_DISPATCH)
+  static const bool avx2 =
+    (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+  return avx2;
+#else
+  return false;
+#endif
+}
+
+} // end namespace msckf_vio
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_DESCRIPTOR_ARENA_HPP
+#define MSCKF_VIO_DESCRIPTOR_ARENA_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace msckf_vio {
+
+/*
+ * @brief DescriptorArena Flat storage of ORB descriptors, 32
+ *    bytes each, which are aligned to 32 bytes and addressed
+ *    by the index of their keypoint.
+ *
+ *    The indices are stable, i.e. descriptors are only added
+ *    at the end, though adding may move the storage.
+ */
+class DescriptorArena {
+public:
+  enum { DESCRIPTOR_SIZE = 32 };
+
+  DescriptorArena() : blocks(NULL), count(0), capacity(0) {}
+
+  /*
+   * @param rows: the first of n descriptors, which are step
+   *    bytes apart, e.g. the rows of a matrix.
+   */
+  DescriptorArena(const uint8_t* rows, const size_t n, const size_t step) :
+    blocks(NULL), count(0), capacity(0) {
+    assign(rows, n, step);
+  }
+
+  DescriptorArena(const DescriptorArena& other) :
+    blocks(NULL), count(0), capacity(0) {
+    assign(other.data(), other.size(), DESCRIPTOR_SIZE);
+  }
+
+  DescriptorArena(DescriptorArena&& other) :
+    blocks(other.blocks), count(other.count), capacity(other.capacity) {
+    other.blocks = NULL;
+    other.count = 0;
+    other.capacity = 0;
+  }
+
+  DescriptorArena& operator=(const DescriptorArena& other) {
+    if (this != &other)
+      assign(other.data(), other.size(), DESCRIPTOR_SIZE);
+    return *this;
+  }
+
+  DescriptorArena& operator=(DescriptorArena&& other) {
+    std::swap(blocks, other.blocks);
+    std::swap(count, other.count);
+    std::swap(capacity, other.capacity);
+    return *this;
+  }
+
+  ~DescriptorArena() {
+    free(blocks);
+  }
+
+  /*
+   * @brief assign Replaces the descriptors with a copy of n
+   *    descriptors which are step bytes apart.
+   */
+  void assign(const uint8_t* rows, const size_t n, const size_t step) {
+    count = 0;
+    reserve(n);
+    if (step == DESCRIPTOR_SIZE) {
+      if (n > 0) std::memcpy(blocks, rows, n*DESCRIPTOR_SIZE);
+    } else {
+      for (size_t i = 0; i < n; ++i)
+        std::memcpy(blocks+i*DESCRIPTOR_SIZE, rows+i*step, DESCRIPTOR_SIZE);
+    }
+    count = n;
+  }
+
+  /*
+   * @brief push_back Adds a copy of the descriptor.
+   * @return the index of the descriptor.
+   */
+  size_t push_back(const uint8_t* descriptor) {
+    if (count == capacity)
+      reserve(std::max<size_t>(2*capacity, 16));
+    std::memcpy(blocks+count*DESCRIPTOR_SIZE, descriptor, DESCRIPTOR_SIZE);
+    return count++;
+  }
+
+  void reserve(const size_t n) {
+    if (n <= capacity) return;
+    void* memory = NULL;
+    if (posix_memalign(&memory, DESCRIPTOR_SIZE, n*DESCRIPTOR_SIZE) != 0)
+      throw std::bad_alloc();
+    uint8_t* new_blocks = static_cast<uint8_t*>(memory);
+    if (count > 0) std::memcpy(new_blocks, blocks, count*DESCRIPTOR_SIZE);
+    free(blocks);
+    blocks = new_blocks;
+    capacity = n;
+  }
+
+  void clear() {
+    count = 0;
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  const uint8_t* data() const {
+    return blocks;
+  }
+
+  const uint8_t* operator[](const size_t i) const {
+    return blocks + i*DESCRIPTOR_SIZE;
+  }
+
+  uint8_t* operator[](const size_t i) {
+    return blocks + i*DESCRIPTOR_SIZE;
+  }
+
+private:
+  uint8_t* blocks;
+  size_t count;
+  size_t capacity;
+};
+
+} // end namespace msckf_vio
+
+#endif
@@ -119,6 +119,8 @@ struct Feature {
    *    based on all current available measurements.
    * @param cam_states: A map containing the camera poses with its
    *    ID as the associated key value.
+   * @param T_cam0_cam1: A rigid body transformation taking
+   *    a vector from cam0 frame to cam1 frame.
    * @return The computed 3d position is used to set the position
    *    member variable. Note the resulted position is in world
    *    frame.
@@ -126,7 +128,8 @@ struct Feature {
    *    is valid.
    */
   inline bool initializePosition(
-      const CamStateServer& cam_states);
+      const CamStateServer& cam_states,
+      const Eigen::Isometry3d& T_cam0_cam1);
 
 
   // An unique identifier for the feature.
@@ -291,7 +294,8 @@ bool Feature::checkMotion(
 }
 
 bool Feature::initializePosition(
-    const CamStateServer& cam_states) {
+    const CamStateServer& cam_states,
+    const Eigen::Isometry3d& T_cam0_cam1) {
   // Organize camera poses and feature observations properly.
   std::vector<Eigen::Isometry3d,
     Eigen::aligned_allocator<Eigen::Isometry3d> > cam_poses(0);
@@ -317,7 +321,7 @@ bool Feature::initializePosition(
     cam0_pose.translation() = cam_state_iter->second.position;
 
     Eigen::Isometry3d cam1_pose;
-    cam1_pose = cam0_pose * CAMState::T_cam0_cam1.inverse();
+    cam1_pose = cam0_pose * T_cam0_cam1.inverse();
 
     cam_poses.push_back(cam0_pose);
     cam_poses.push_back(cam1_pose);
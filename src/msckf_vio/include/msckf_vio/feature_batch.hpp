@@ -0,0 +1,145 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_FEATURE_BATCH_HPP
+#define MSCKF_VIO_FEATURE_BATCH_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include <ros/message_traits.h>
+#include <ros/serialization.h>
+#include <std_msgs/Header.h>
+#include <msckf_vio/CameraMeasurement.h>
+
+namespace msckf_vio {
+
+/*
+ * @brief FeatureBatch The stereo features of an image in
+ *    a structure of arrays, which is sent between the image
+ *    processor and the filter in place of CameraMeasurement.
+ *
+ *    Its wire format is the one of CameraMeasurement. When
+ *    the two nodelets share a manager, the batch is passed
+ *    as a shared pointer without serialization. Otherwise,
+ *    e.g. with separate processes or rosbag, it is sent and
+ *    received as a CameraMeasurement msg.
+ */
+struct FeatureBatch {
+  std_msgs::Header header;
+
+  std::vector<uint64_t> id;
+  // Normalized feature coordinates (with identity intrinsic matrix)
+  std::vector<double> u0;
+  std::vector<double> v0;
+  std::vector<double> u1;
+  std::vector<double> v1;
+
+  size_t size() const {
+    return id.size();
+  }
+
+  void resize(const size_t size) {
+    id.resize(size);
+    u0.resize(size);
+    v0.resize(size);
+    u1.resize(size);
+    v1.resize(size);
+  }
+};
+
+typedef boost::shared_ptr<FeatureBatch> FeatureBatchPtr;
+typedef boost::shared_ptr<const FeatureBatch> FeatureBatchConstPtr;
+
+} // end namespace msckf_vio
+
+namespace ros {
+namespace message_traits {
+
+template<> struct IsMessage<msckf_vio::FeatureBatch> : TrueType {};
+template<> struct IsMessage<const msckf_vio::FeatureBatch> : TrueType {};
+template<> struct HasHeader<msckf_vio::FeatureBatch> : TrueType {};
+template<> struct HasHeader<const msckf_vio::FeatureBatch> : TrueType {};
+
+template<> struct MD5Sum<msckf_vio::FeatureBatch> {
+  static const char* value() {
+    return MD5Sum<msckf_vio::CameraMeasurement>::value();
+  }
+  static const char* value(const msckf_vio::FeatureBatch&) {
+    return value();
+  }
+};
+
+template<> struct DataType<msckf_vio::FeatureBatch> {
+  static const char* value() {
+    return DataType<msckf_vio::CameraMeasurement>::value();
+  }
+  static const char* value(const msckf_vio::FeatureBatch&) {
+    return value();
+  }
+};
+
+template<> struct Definition<msckf_vio::FeatureBatch> {
+  static const char* value() {
+    return Definition<msckf_vio::CameraMeasurement>::value();
+  }
+  static const char* value(const msckf_vio::FeatureBatch&) {
+    return value();
+  }
+};
+
+} // end namespace message_traits
+
+namespace serialization {
+
+/*
+ * Reads and writes the batch as a CameraMeasurement, i.e.
+ * the header followed by an array of (id, u0, v0, u1, v1).
+ */
+template<> struct Serializer<msckf_vio::FeatureBatch> {
+  template<typename Stream>
+  inline static void write(Stream& stream,
+      const msckf_vio::FeatureBatch& batch) {
+    stream.next(batch.header);
+    stream.next(static_cast<uint32_t>(batch.size()));
+    for (size_t i = 0; i < batch.size(); ++i) {
+      stream.next(batch.id[i]);
+      stream.next(batch.u0[i]);
+      stream.next(batch.v0[i]);
+      stream.next(batch.u1[i]);
+      stream.next(batch.v1[i]);
+    }
+  }
+
+  template<typename Stream>
+  inline static void read(Stream& stream,
+      msckf_vio::FeatureBatch& batch) {
+    stream.next(batch.header);
+    uint32_t size = 0;
+    stream.next(size);
+    batch.resize(size);
+    for (size_t i = 0; i < batch.size(); ++i) {
+      stream.next(batch.id[i]);
+      stream.next(batch.u0[i]);
+      stream.next(batch.v0[i]);
+      stream.next(batch.u1[i]);
+      stream.next(batch.v1[i]);
+    }
+  }
+
+  inline static uint32_t serializedLength(
+      const msckf_vio::FeatureBatch& batch) {
+    return serializationLength(batch.header) + 4 +
+      batch.size() * (sizeof(uint64_t) + 4*sizeof(double));
+  }
+};
+
+} // end namespace serialization
+} // end namespace ros
+
+#endif
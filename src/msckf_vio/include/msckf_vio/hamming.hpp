@@ -0,0 +1,137 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_HAMMING_HPP
+#define MSCKF_VIO_HAMMING_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstring>
+
+// Included by its path from DBoW2 as well, hence the quotes.
+#include "cpu_features.hpp"
+
+namespace msckf_vio {
+
+/*
+ * Hamming distances between 256 bit ORB descriptors, shared by
+ * the matchers and the vocabulary of DBoW2.
+ *
+ * The single distance uses the popcnt instruction when it is
+ * enabled, e.g. by -mpopcnt or -march=native, and a bit
+ * parallel count otherwise, since the builtin would then be a
+ * library call. The batches use the nibble lookup of AVX2,
+ * one descriptor per register, if the cpu has it, see
+ * cpu_features.hpp. Descriptors need no alignment, though
+ * rows aligned to 32 bytes load faster.
+ */
+
+/*
+ * @brief descriptorDistance Distance between two descriptors
+ *    of 32 bytes each.
+ */
+inline int descriptorDistance(const uint8_t* a, const uint8_t* b) {
+  uint64_t x[4];
+  for (int i = 0; i < 4; ++i) {
+    uint64_t va, vb;
+    std::memcpy(&va, a+8*i, 8);
+    std::memcpy(&vb, b+8*i, 8);
+    x[i] = va ^ vb;
+  }
+#if defined(__POPCNT__)
+  // Not a loop on purpose: GCC 12.2 vectorizes the loop with
+  // vpopcntq on AVX-512 targets and then folds constant inputs
+  // wrongly, e.g. to -4 instead of 256 for 0x00 vs 0xff bytes.
+  return __builtin_popcountll(x[0]) + __builtin_popcountll(x[1]) +
+    __builtin_popcountll(x[2]) + __builtin_popcountll(x[3]);
+#else
+  int dist = 0;
+  for (int i = 0; i < 4; ++i) {
+    uint64_t v = x[i];
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    dist += static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+  }
+  return dist;
+#endif
+}
+
+#ifdef MSCKF_VIO_AVX2_DISPATCH
+/*
+ * @brief descriptorDistancesAvx2 AVX2 version of the one to
+ *    many distances below, for the cpus which support it.
+ */
+MSCKF_VIO_TARGET_AVX2 inline void descriptorDistancesAvx2(
+    const uint8_t* query, const uint8_t* train,
+    const size_t train_num, const size_t train_step,
+    int* distances) {
+  const __m256i q = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(query));
+  const __m256i lookup = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+
+  for (size_t i = 0; i < train_num; ++i, train += train_step) {
+    const __m256i x = _mm256_xor_si256(q, _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(train)));
+    const __m256i low = _mm256_shuffle_epi8(
+        lookup, _mm256_and_si256(x, low_mask));
+    const __m256i high = _mm256_shuffle_epi8(
+        lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask));
+    // Bit counts of the four 64 bit words.
+    const __m256i counts = _mm256_sad_epu8(_mm256_add_epi8(low, high), zero);
+    const __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(counts),
+        _mm256_extracti128_si256(counts, 1));
+    distances[i] = _mm_cvtsi128_si32(_mm_add_epi64(
+          sum, _mm_unpackhi_epi64(sum, sum)));
+  }
+}
+#endif
+
+/*
+ * @brief descriptorDistances Distances from one descriptor to
+ *    each of a set of descriptors.
+ * @param query: the descriptor of 32 bytes.
+ * @param train: the first of the descriptors.
+ * @param train_num: number of the descriptors.
+ * @param train_step: bytes from one descriptor to the next.
+ * @param distances: train_num distances.
+ */
+inline void descriptorDistances(const uint8_t* query,
+    const uint8_t* train, const size_t train_num,
+    const size_t train_step, int* distances) {
+#ifdef MSCKF_VIO_AVX2_DISPATCH
+  if (cpuSupportsAvx2()) {
+    descriptorDistancesAvx2(query, train, train_num,
+        train_step, distances);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < train_num; ++i, train += train_step)
+    distances[i] = descriptorDistance(query, train);
+}
+
+/*
+ * @brief descriptorDistances Distances from each of a set of
+ *    descriptors to each of another set.
+ * @param distances: query_num x train_num distances, row major.
+ */
+inline void descriptorDistances(const uint8_t* query,
+    const size_t query_num, const size_t query_step,
+    const uint8_t* train, const size_t train_num,
+    const size_t train_step, int* distances) {
+  for (size_t i = 0; i < query_num; ++i, query += query_step)
+    descriptorDistances(query, train, train_num,
+        train_step, distances+i*train_num);
+}
+
+} // end namespace msckf_vio
+
+#endif
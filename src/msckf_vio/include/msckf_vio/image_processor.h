@@ -11,6 +11,7 @@
 #include <vector>
 #include <map>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 #include <opencv2/opencv.hpp>
 #include <opencv2/video.hpp>
 
@@ -26,6 +27,13 @@
 #include <thread>
 
 #include <msckf_vio/msckf_vio.h>
+#include <msckf_vio/feature_batch.hpp>
+#include <msckf_vio/utils.h>
+#include <msckf_vio/profiler.hpp>
+#include <msckf_vio/point_undistorter.hpp>
+#include <msckf_vio/two_point_ransac.hpp>
+#include <msckf_vio/track_statistics.hpp>
+#include <msckf_vio/worker_pool.hpp>
 
 using namespace std;
 using namespace cv;
@@ -41,6 +49,9 @@ class ImageProcessor {
 public:
   // Constructor
   ImageProcessor(ros::NodeHandle& n);
+  // Constructor without ros io, where the images and imu
+  // msgs are passed to the callbacks directly.
+  ImageProcessor(const utils::ParameterReader& params);
   // Disable copy and assign constructors.
   ImageProcessor(const ImageProcessor&) = delete;
   ImageProcessor operator=(const ImageProcessor&) = delete;
@@ -54,6 +65,57 @@ public:
   typedef boost::shared_ptr<ImageProcessor> Ptr;
   typedef boost::shared_ptr<const ImageProcessor> ConstPtr;
 
+  /*
+   * @brief stereoCallback
+   *    Callback function for the stereo images.
+   * @param cam0_img left image.
+   * @param cam1_img right image.
+   */
+  void stereoCallback(
+      const sensor_msgs::ImageConstPtr& cam0_img,
+      const sensor_msgs::ImageConstPtr& cam1_img);
+
+  /*
+   * @brief imuCallback
+   *    Callback function for the imu message.
+   * @param msg IMU msg.
+   */
+  void imuCallback(const sensor_msgs::ImuConstPtr& msg);
+
+  /*
+   * @brief setCalibration
+   *    Share a calibration loaded by the caller, which is
+   *    otherwise loaded from the parameters. It should be
+   *    called before initialize().
+   */
+  void setCalibration(const StereoCalibrationConstPtr& calib) {
+    calibration = calib;
+  }
+
+  /*
+   * @brief setFeatureCallback
+   *    Set a function receiving the features of each stereo
+   *    frame besides the feature topic, e.g. the filter when
+   *    the pipeline runs without ros io.
+   */
+  typedef boost::function<
+    void(const FeatureBatchConstPtr&)> FeatureCallback;
+  void setFeatureCallback(const FeatureCallback& callback) {
+    feature_callback = callback;
+  }
+
+  /*
+   * @brief getProfiler
+   *    Timings of the stages of the front end, which are
+   *    published on the diagnostics topic with ros io.
+   */
+  profiling::Profiler& getProfiler() {
+    return profiler;
+  }
+
+  // The benchmarks drive the internal stages directly.
+  friend class ImageProcessorBenchmark;
+
 private:
 
   /*
@@ -73,6 +135,14 @@ private:
     double track_precision;
     double ransac_threshold;
     double stereo_threshold;
+    bool undistortion_lut;
+    bool adaptive_tracking;
+    double track_error_threshold;
+    bool stereo_prior;
+
+    // Calibration namespaces of the stereo pair.
+    std::string left_camera;
+    std::string right_camera;
   };
 
   double timestamp;
@@ -147,23 +217,6 @@ private:
    */
   bool createRosIO();
 
-  /*
-   * @brief stereoCallback
-   *    Callback function for the stereo images.
-   * @param cam0_img left image.
-   * @param cam1_img right image.
-   */
-  void stereoCallback(
-      const sensor_msgs::ImageConstPtr& cam0_img,
-      const sensor_msgs::ImageConstPtr& cam1_img);
-
-  /*
-   * @brief imuCallback
-   *    Callback function for the imu message.
-   * @param msg IMU msg.
-   */
-  void imuCallback(const sensor_msgs::ImuConstPtr& msg);
-
   /*
    * @initializeFirstFrame
    *    Initialize the image processing sequence, which is
@@ -185,6 +238,22 @@ private:
    */
   void addNewFeatures();
 
+  /*
+   * @brief detectGridFeatures Runs FAST separately within each
+   *    grid cell in parallel and keeps the strongest responses.
+   * @param img: image to detect features on.
+   * @param mask: detection mask of the same size as img.
+   * @param grid_quota: maximum number of keypoints to keep for
+   *    each grid. Grids with zero quota are skipped entirely.
+   * @return new_feature_sieve: detected keypoints of each grid
+   *    in image coordinates, not sorted by response.
+   */
+  void detectGridFeatures(
+      const cv::Mat& img,
+      const cv::Mat& mask,
+      const std::vector<int>& grid_quota,
+      std::vector<std::vector<cv::KeyPoint> >& new_feature_sieve);
+
   /*
    * @brief pruneGridFeatures
    *    Remove some of the features of a grid in case there are
@@ -250,6 +319,23 @@ private:
       const cv::Vec4d& intrinsics,
       std::vector<cv::Point2f>& compenstated_pts);
 
+  /*
+   * @brief selectTrackingParameters Chooses the pyramid depth
+   *    and window size of the KLT tracker for the current frame
+   *    based on the rotation integrated from the gyro. Slow
+   *    motion results in fewer levels and a smaller window.
+   * @param R_p_c: a rotation matrix takes a vector in the previous
+   *    camera frame to the current camera frame.
+   * @param intrinsics: intrinsics of the camera.
+   * @return pyramid_levels: max pyramid level used in tracking.
+   * @return patch_size: size of the tracking window.
+   */
+  void selectTrackingParameters(
+      const cv::Matx33f& R_p_c,
+      const cv::Vec4d& intrinsics,
+      int& pyramid_levels,
+      int& patch_size);
+
   /*
    * @brief twoPointRansac Applies two point ransac algorithm
    *    to mark the inliers in the input set.
@@ -258,8 +344,8 @@ private:
    * @param R_p_c: a rotation matrix takes a vector in the previous
    *    camera frame to the current camera frame.
    * @param intrinsics: intrinsics of the camera.
-   * @param distortion_model: distortion model of the camera.
-   * @param distortion_coeffs: distortion coefficients.
+   * @param undistorter: undistorter of the camera.
+   * @param ransac: ransac workspace of the camera.
    * @param inlier_error: acceptable error to be considered as an inlier.
    * @param success_probability: the required probability of success.
    * @return inlier_flag: 1 for inliers and 0 for outliers.
@@ -269,32 +355,23 @@ private:
       const std::vector<cv::Point2f>& pts2,
       const cv::Matx33f& R_p_c,
       const cv::Vec4d& intrinsics,
-      const std::string& distortion_model,
-      const cv::Vec4d& distortion_coeffs,
+      const PointUndistorter& undistorter,
+      TwoPointRansac& ransac,
       const double& inlier_error,
       const double& success_probability,
       std::vector<int>& inlier_markers);
-  void undistortPoints(
-      const std::vector<cv::Point2f>& pts_in,
-      const cv::Vec4d& intrinsics,
-      const std::string& distortion_model,
-      const cv::Vec4d& distortion_coeffs,
-      std::vector<cv::Point2f>& pts_out,
-      const cv::Matx33d &rectification_matrix = cv::Matx33d::eye(),
-      const cv::Vec4d &new_intrinsics = cv::Vec4d(1,1,0,0));
   void rescalePoints(
       std::vector<cv::Point2f>& pts1,
       std::vector<cv::Point2f>& pts2,
       float& scaling_factor);
-  std::vector<cv::Point2f> distortPoints(
-      const std::vector<cv::Point2f>& pts_in,
-      const cv::Vec4d& intrinsics,
-      const std::string& distortion_model,
-      const cv::Vec4d& distortion_coeffs);
 
   /*
    * @brief stereoMatch Matches features with stereo image pairs.
    * @param cam0_points: points in the primary image.
+   * @param cam1_points: if not empty, prior locations of the points
+   *    in the secondary image, e.g. from the disparity of the
+   *    previous frame. Matching with a prior uses a shallow search,
+   *    and only falls back to the full search if that fails.
    * @return cam1_points: points in the secondary image.
    * @return inlier_markers: 1 if the match is valid, 0 otherwise.
    */
@@ -343,15 +420,20 @@ private:
   std::vector<sensor_msgs::Imu> imu_msg_buffer;
 
   // Camera calibration parameters
-  std::string cam0_distortion_model;
-  cv::Vec2i cam0_resolution;
-  cv::Vec4d cam0_intrinsics;
-  cv::Vec4d cam0_distortion_coeffs;
+  StereoCalibrationConstPtr calibration;
 
-  std::string cam1_distortion_model;
-  cv::Vec2i cam1_resolution;
-  cv::Vec4d cam1_intrinsics;
-  cv::Vec4d cam1_distortion_coeffs;
+  // Undistorters with the cached calibration.
+  PointUndistorter cam0_undistorter;
+  PointUndistorter cam1_undistorter;
+
+  // Ransac workspaces, one for each camera since
+  // the two cameras are processed concurrently.
+  TwoPointRansac cam0_ransac;
+  TwoPointRansac cam1_ransac;
+
+  // Long-lived worker for the cam1 half of the per frame
+  // work, while the calling thread does the cam0 half.
+  boost::shared_ptr<WorkerPool> cam1_worker;
 
   // Take a vector from cam0 frame to the IMU frame.
   cv::Matx33d R_cam0_imu;
@@ -380,8 +462,9 @@ private:
   int after_matching;
   int after_ransac;
 
-  // Ros node handle
-  ros::NodeHandle nh;
+  // Ros node handle, which is empty without ros io.
+  boost::shared_ptr<ros::NodeHandle> nh_ptr;
+  utils::ParameterReader param_reader;
 
   // Subscribers and publishers.
   message_filters::Subscriber<
@@ -396,11 +479,19 @@ private:
   ros::Publisher feature_pub;
   ros::Publisher tracking_info_pub;
   image_transport::Publisher debug_stereo_pub;
+  FeatureCallback feature_callback;
+
+  // Timings of the stages, published once per second.
+  profiling::Profiler profiler;
+  ros::Publisher diagnostics_pub;
+  ros::WallTimer diagnostics_timer;
+  void diagnosticsCallback(const ros::WallTimerEvent& event);
 
   // Debugging
-  std::map<FeatureIDType, int> feature_lifetime;
-  void updateFeatureLifetime();
-  void featureLifetimeStatistics();
+  // Lifetime of the ended tracks and stereo errors,
+  // published with the tracking info.
+  TrackStatistics track_statistics;
+  void updateTrackStatistics();
 
   int cam_pub_counter = 0;
 };
@@ -74,13 +74,6 @@ struct IMUState {
   // Gravity vector in the world frame
   static Eigen::Vector3d gravity;
 
-  // Transformation offset from the IMU frame to
-  // the body frame. The transformation takes a
-  // vector from the IMU frame to the body frame.
-  // The z axis of the body frame should point upwards.
-  // Normally, this transform should be identity.
-  static Eigen::Isometry3d T_imu_body;
-
   IMUState(): id(0), time(0),
     orientation(Eigen::Vector4d(0, 0, 0, 1)),
     position(Eigen::Vector3d::Zero()),
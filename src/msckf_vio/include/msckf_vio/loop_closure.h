@@ -4,6 +4,8 @@
 #include <vector>
 #include <map>
 #include <boost/shared_ptr.hpp>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
 #include <opencv2/opencv.hpp>
 #include <opencv2/video.hpp>
 
@@ -24,7 +26,9 @@
 #include <msckf_vio/LoopClosing.h>
 #include <msckf_vio/Map.h>
 #include <msckf_vio/Converter.h>
+#include <msckf_vio/bounded_queue.hpp>
 #include <mutex>
+#include <thread>
 // #include <msckf_vio/FrameDrawer.h>
 // #include <msckf_vio/MapDrawer.h>
 // #include <msckf_vio/Viewer.h>
@@ -50,8 +54,26 @@ namespace msckf_vio{
                 RGBD=2
             };
         
+            // Stereo images and the pose of the filter at the
+            // time, which are passed to the frame processing
+            // thread. The images share the memory of the msgs.
+            struct FrameData {
+                cv_bridge::CvImageConstPtr cam0_img;
+                cv_bridge::CvImageConstPtr cam1_img;
+                double timestamp;
+                cv::Mat T_c_w;
+            };
+
+            // Which frames are queued for the processing.
+            enum IntakePolicy {
+                // All frames, the latest ones win if the
+                // processing falls behind.
+                LATEST=0,
+                // Only the keyframe candidates.
+                KEYFRAME_CANDIDATES=1
+            };
+
         public:
-            typedef pair<pair<Mat, Mat>, double> ImgData;
             loop_closure();
             loop_closure(ros::NodeHandle& n);
             loop_closure(const loop_closure&) = delete;
@@ -65,7 +87,7 @@ namespace msckf_vio{
             void run();
             void updateImg(Mat img0, Mat img1);
 
-            void createFrame(ImgData imgData);
+            void createFrame(const FrameData& frameData);
 
             void creatKF();
             void ProcessorCallback(const sensor_msgs::ImageConstPtr& cam0_img,
@@ -73,7 +95,6 @@ namespace msckf_vio{
     								const nav_msgs::Odometry::ConstPtr& odom_msg);
 
             void KFInitialization();
-            void updateImg(Mat img0, Mat img1, double timestamp);
             bool createRosIO();
         private:
 
@@ -84,18 +105,41 @@ namespace msckf_vio{
             float mbf;
             float mThDepth;
             ////////////////////////////////
-            double timestamp;
             ORBextractor* oe;
             ORBextractor* mpORBextractorLeft;
             ORBextractor* mpORBextractorRight;
+            // Workers shared by the extractors of the two images.
+            WorkerPool* mpExtractionPool;
 
             
 
-            vector<Frame> frameQueue;
-            vector<pair<pair<Mat, Mat>, double>> imgQueue;
+            // Frames waiting for the ORB extraction and the
+            // keyframe creation, which are done by the frame
+            // processing thread instead of the ros callback.
+            BoundedQueue<FrameData> frameDataQueue;
+            std::thread* mptFrameProcessing;
+            void ProcessFrames();
+            void processFrame(const FrameData& frameData);
+
+            IntakePolicy mIntakePolicy;
+            // A frame is a keyframe candidate if the filter moved
+            // enough since the last candidate, or if mMaxFrames
+            // frames passed. Candidates are at least mMinFrames
+            // frames and mMinCandidateInterval seconds apart.
+            double mMinCandidateInterval;
+            double mCandidateTranslationThreshold;
+            double mCandidateRotationThreshold;
+            double mLastCandidateTime;
+            int mFramesSinceCandidate;
+            Eigen::Matrix3d mLastCandidateRotation;
+            Eigen::Vector3d mLastCandidatePosition;
+            bool isKeyFrameCandidate(const FrameData& frameData,
+                const Eigen::Matrix3d& R, const Eigen::Vector3d& t);
+
             vector<pair<Mat, double>> fPose;
 
-            //New KeyFrame rules (according to fps)
+            //New KeyFrame rules (according to fps), used by the
+            //keyframe intake policy.
             int mMinFrames;
             int mMaxFrames;
             // 地图对象指针  存储 关键帧 和 地图点
@@ -128,8 +172,6 @@ namespace msckf_vio{
     //current images
         private:
             Converter converter;
-            cv_bridge::CvImageConstPtr cam0_curr_img_ptr;
-            cv_bridge::CvImageConstPtr cam1_curr_img_ptr;
             // Subscribers and publishers.
             message_filters::Subscriber<
                 sensor_msgs::Image> cam0_img_sub;
@@ -144,13 +186,7 @@ namespace msckf_vio{
             message_filters::Synchronizer<SyncPolicy>* sync_;  
             ros::Publisher pose_pub;
 
-            ////////////////////////////////////////////////////
-            Mat cam0_img_input;
-            Mat cam1_img_input;
-
-            ////////////////////////////////////////////////////
-
-            
+            // The frame being processed.
             Frame newFrame;
             
     };
@@ -10,13 +10,17 @@
 
 #include <map>
 #include <set>
+#include <deque>
 #include <vector>
 #include <string>
+#include <mutex>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <sensor_msgs/Imu.h>
 #include <nav_msgs/Odometry.h>
 #include <tf/transform_broadcaster.h>
@@ -26,7 +30,10 @@
 #include "imu_state.h"
 #include "cam_state.h"
 #include "feature.hpp"
-#include <msckf_vio/CameraMeasurement.h>
+#include <msckf_vio/feature_batch.hpp>
+#include <msckf_vio/utils.h>
+#include <msckf_vio/profiler.hpp>
+#include <msckf_vio/pose_history.hpp>
 #include <msckf_vio/image_processor.h>
 #include <moveit_visual_tools/moveit_visual_tools.h>
 
@@ -51,12 +58,15 @@ class MsckfVio {
 
     // Constructor
     MsckfVio(ros::NodeHandle& pnh);
+    // Constructor without ros io, where the imu and feature
+    // msgs are passed to the callbacks directly.
+    MsckfVio(const utils::ParameterReader& params);
     // Disable copy and assign constructor
     MsckfVio(const MsckfVio&) = delete;
     MsckfVio operator=(const MsckfVio&) = delete;
 
     // Destructor
-    ~MsckfVio() {}
+    ~MsckfVio();
 
     /*
      * @brief initialize Initialize the VIO.
@@ -71,6 +81,53 @@ class MsckfVio {
     typedef boost::shared_ptr<MsckfVio> Ptr;
     typedef boost::shared_ptr<const MsckfVio> ConstPtr;
 
+    /*
+     * @brief imuCallback
+     *    Callback function for the imu message.
+     * @param msg IMU msg.
+     */
+    void imuCallback(const sensor_msgs::ImuConstPtr& msg);
+
+    /*
+     * @brief featureCallback
+     *    Callback function for feature measurements.
+     * @param msg Stereo feature measurements.
+     */
+    void featureCallback(const FeatureBatchConstPtr& msg);
+
+    /*
+     * @brief setCalibration
+     *    Share a calibration loaded by the caller, which is
+     *    otherwise loaded from the parameters. It should be
+     *    called before initialize().
+     */
+    void setCalibration(const StereoCalibrationConstPtr& calib) {
+      calibration = calib;
+    }
+
+    /*
+     * @brief setOdometryCallback
+     *    Set a function receiving the odometry of each
+     *    filter update besides the odom topic.
+     */
+    typedef boost::function<
+      void(const nav_msgs::Odometry&)> OdometryCallback;
+    void setOdometryCallback(const OdometryCallback& callback) {
+      odometry_callback = callback;
+    }
+
+    /*
+     * @brief getProfiler
+     *    Timings of the stages of the filter, which are
+     *    published on the diagnostics topic with ros io.
+     */
+    profiling::Profiler& getProfiler() {
+      return profiler;
+    }
+
+    // The benchmarks drive the filter steps directly.
+    friend class MsckfVioBenchmark;
+
   private:
 
     static cv::Mat toCvMat(const Eigen::Matrix<double,4,4> &m);
@@ -106,20 +163,6 @@ class MsckfVio {
      */
     bool createRosIO();
 
-    /*
-     * @brief imuCallback
-     *    Callback function for the imu message.
-     * @param msg IMU msg.
-     */
-    void imuCallback(const sensor_msgs::ImuConstPtr& msg);
-
-    /*
-     * @brief featureCallback
-     *    Callback function for feature measurements.
-     * @param msg Stereo feature measurements.
-     */
-    void featureCallback(const CameraMeasurementConstPtr& msg);
-
     /*
      * @brief publish Publish the results of VIO.
      * @param time The time stamp of output msgs.
@@ -153,10 +196,16 @@ class MsckfVio {
     void predictNewState(const double& dt,
         const Eigen::Vector3d& gyro,
         const Eigen::Vector3d& acc);
+    // Integrates the given orientation, velocity and position
+    // with 4th order Runge-Kutta, without the covariance.
+    static void predictNewState(const double& dt,
+        const Eigen::Vector3d& gyro,
+        const Eigen::Vector3d& acc,
+        Eigen::Vector4d& q, Eigen::Vector3d& v, Eigen::Vector3d& p);
 
     // Measurement update
     void stateAugmentation(const double& time);
-    void addFeatureObservations(const CameraMeasurementConstPtr& msg);
+    void addFeatureObservations(const FeatureBatchConstPtr& msg);
     // This function is used to compute the measurement Jacobian
     // for a single feature observed at a single camera frame.
     void measurementJacobian(const StateIDType& cam_state_id,
@@ -218,8 +267,12 @@ class MsckfVio {
     double rotation_threshold;
     double tracking_rate_threshold;
 
-    // Ros node handle
-    ros::NodeHandle nh;
+    // Ros node handle, which is empty without ros io.
+    boost::shared_ptr<ros::NodeHandle> nh_ptr;
+    utils::ParameterReader param_reader;
+
+    // Calibration of the cameras and the imu.
+    StereoCalibrationConstPtr calibration;
 
     // Subscribers and publishers
     ros::Subscriber imu_sub;
@@ -227,10 +280,39 @@ class MsckfVio {
     ros::Subscriber self_odom_sub;
     ros::Publisher odom_pub;
     ros::Publisher feature_pub;
-    tf::TransformBroadcaster tf_pub;
+    boost::shared_ptr<tf::TransformBroadcaster> tf_pub_ptr;
     ros::ServiceServer reset_srv;
     ros::Subscriber corrected_pose_sub;
     ros::Publisher final_odom_pub;
+    OdometryCallback odometry_callback;
+
+    // Timings of the stages, published once per second.
+    profiling::Profiler profiler;
+    ros::Publisher diagnostics_pub;
+    ros::WallTimer diagnostics_timer;
+    void diagnosticsCallback(const ros::WallTimerEvent& event);
+
+    // Odometry at the imu rate, which is the latest filter
+    // state propagated with the imu msgs received since. The
+    // imu msgs are handled by a thread of their own, so that
+    // the output is not delayed by the filter updates.
+    bool publish_imu_rate_odom;
+    ros::CallbackQueue imu_rate_queue;
+    boost::shared_ptr<ros::AsyncSpinner> imu_rate_spinner;
+    ros::Subscriber imu_rate_sub;
+    ros::Publisher imu_rate_odom_pub;
+    // Guards the variables below, which are shared
+    // between the filter and the imu rate thread.
+    std::mutex imu_rate_mutex;
+    bool is_imu_rate_state_set;
+    IMUState imu_rate_state;
+    Eigen::Vector3d imu_rate_gyro;
+    // Imu msgs later than the filter state, which are
+    // replayed when the filter state is updated.
+    std::deque<sensor_msgs::Imu> imu_rate_buffer;
+    void imuRateCallback(const sensor_msgs::ImuConstPtr& msg);
+    bool propagateImuRateState(const sensor_msgs::Imu& msg);
+    void resetImuRateState();
 
     // Frame id
     std::string fixed_frame_id;
@@ -258,13 +340,25 @@ class MsckfVio {
     bool loopClosureCheck = false;
     Mat fusedPose;
 
-    vector<nav_msgs::Odometry> finalOdomMsgBuffer;
+    // Published body poses, which the delayed loop
+    // closure corrections are related to.
+    PoseHistory pose_history;
     
 
     vector<pair<double, pair<bool, Mat>>> poseData;
 
-    ros::Publisher  path_pub;
-    nav_msgs::Path  path;
+    // Trajectory decimated by distance and angle. Only the
+    // new segments are published on the trajectory topic,
+    // and the whole path on request of the service.
+    ros::Publisher path_pub;
+    ros::Publisher full_path_pub;
+    ros::ServiceServer full_path_srv;
+    std::deque<geometry_msgs::PoseStamped> trajectory;
+    double trajectory_min_distance;
+    double trajectory_min_angle;
+    int trajectory_max_size;
+    bool fullPathCallback(std_srvs::Trigger::Request& req,
+        std_srvs::Trigger::Response& res);
 
     ////////////////////////////////////////////////////
     double currentTimestamp;
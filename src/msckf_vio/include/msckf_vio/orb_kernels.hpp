@@ -0,0 +1,340 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_ORB_KERNELS_HPP
+#define MSCKF_VIO_ORB_KERNELS_HPP
+
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if !defined(MSCKF_VIO_DISABLE_SIMD) && defined(__SSE2__)
+#define MSCKF_VIO_ORB_SSE2
+#include <emmintrin.h>
+#elif !defined(MSCKF_VIO_DISABLE_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#define MSCKF_VIO_ORB_NEON
+#include <arm_neon.h>
+#endif
+
+namespace msckf_vio {
+
+/*
+ * Vectorized kernels of the ORB extractor, which give the
+ * same results as the scalar code bit by bit, i.e. the
+ * integer moments are exact, and the sample offsets are
+ * rounded to the nearest even integer as cvRound does.
+ *
+ * SSE2 is used on x86-64, where it is always available, and
+ * NEON on aarch64. Otherwise, or with MSCKF_VIO_DISABLE_SIMD,
+ * the scalar code is used.
+ */
+
+/*
+ * @brief PatchMoments Intensity moments of the circular patch
+ *    around a keypoint, which give its orientation.
+ *
+ *    The rows of the patch are loaded as a whole, and the
+ *    pixels outside of the circle are weighted by zero, so
+ *    the full square of the patch is read.
+ */
+class PatchMoments {
+public:
+  enum { HALF_PATCH_SIZE = 15 };
+
+  PatchMoments() {
+    std::memset(u_weights, 0, sizeof(u_weights));
+    std::memset(v_weights, 0, sizeof(v_weights));
+  }
+
+  /*
+   * @param u_max: end of each row of the circular patch,
+   *    of HALF_PATCH_SIZE+1 entries.
+   */
+  explicit PatchMoments(const std::vector<int>& u_max) : umax(u_max) {
+    std::memset(u_weights, 0, sizeof(u_weights));
+    std::memset(v_weights, 0, sizeof(v_weights));
+    for (int v = 0; v <= HALF_PATCH_SIZE; ++v) {
+      // Lanes [0, 16) hold u in [-15, 0], and lanes [16, 32)
+      // hold u in [0, 15], so u = 0 is counted in the first half.
+      for (int k = 0; k < 32; ++k) {
+        const int u = k < 16 ? k-HALF_PATCH_SIZE : k-16;
+        if (k == 16 || std::abs(u) > u_max[v]) continue;
+        u_weights[v][k] = static_cast<int16_t>(u);
+        v_weights[v][k] = static_cast<int16_t>(v);
+      }
+    }
+  }
+
+  /*
+   * @brief operator() Computes the moments of the patch.
+   * @param center: the keypoint in the image.
+   * @param step: the row step of the image in bytes.
+   */
+  void operator()(const uint8_t* center, const int step,
+      int& m_01, int& m_10) const {
+#if defined(MSCKF_VIO_ORB_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc_10 = zero;
+    __m128i acc_01 = zero;
+
+    // The center line, v=0
+    {
+      const __m128i left = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(center-HALF_PATCH_SIZE));
+      const __m128i right = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(center));
+      const __m128i* w = reinterpret_cast<const __m128i*>(u_weights[0]);
+      acc_10 = _mm_add_epi32(acc_10, _mm_madd_epi16(
+            _mm_unpacklo_epi8(left, zero), _mm_loadu_si128(w)));
+      acc_10 = _mm_add_epi32(acc_10, _mm_madd_epi16(
+            _mm_unpackhi_epi8(left, zero), _mm_loadu_si128(w+1)));
+      acc_10 = _mm_add_epi32(acc_10, _mm_madd_epi16(
+            _mm_unpacklo_epi8(right, zero), _mm_loadu_si128(w+2)));
+      acc_10 = _mm_add_epi32(acc_10, _mm_madd_epi16(
+            _mm_unpackhi_epi8(right, zero), _mm_loadu_si128(w+3)));
+    }
+
+    // The two lines at +v and -v
+    for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
+      const uint8_t* plus = center + v*step;
+      const uint8_t* minus = center - v*step;
+      const __m128i plus_left = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(plus-HALF_PATCH_SIZE));
+      const __m128i plus_right = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(plus));
+      const __m128i minus_left = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(minus-HALF_PATCH_SIZE));
+      const __m128i minus_right = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(minus));
+
+      const __m128i p[4] = {
+        _mm_unpacklo_epi8(plus_left, zero), _mm_unpackhi_epi8(plus_left, zero),
+        _mm_unpacklo_epi8(plus_right, zero), _mm_unpackhi_epi8(plus_right, zero)};
+      const __m128i m[4] = {
+        _mm_unpacklo_epi8(minus_left, zero), _mm_unpackhi_epi8(minus_left, zero),
+        _mm_unpacklo_epi8(minus_right, zero), _mm_unpackhi_epi8(minus_right, zero)};
+      const __m128i* wu = reinterpret_cast<const __m128i*>(u_weights[v]);
+      const __m128i* wv = reinterpret_cast<const __m128i*>(v_weights[v]);
+
+      for (int i = 0; i < 4; ++i) {
+        acc_10 = _mm_add_epi32(acc_10, _mm_madd_epi16(
+              _mm_add_epi16(p[i], m[i]), _mm_loadu_si128(wu+i)));
+        acc_01 = _mm_add_epi32(acc_01, _mm_madd_epi16(
+              _mm_sub_epi16(p[i], m[i]), _mm_loadu_si128(wv+i)));
+      }
+    }
+
+    m_10 = horizontalSum(acc_10);
+    m_01 = horizontalSum(acc_01);
+#elif defined(MSCKF_VIO_ORB_NEON)
+    int32x4_t acc_10 = vdupq_n_s32(0);
+    int32x4_t acc_01 = vdupq_n_s32(0);
+
+    // The center line, v=0
+    {
+      const int16x8_t c[4] = {
+        widenLow(vld1q_u8(center-HALF_PATCH_SIZE)),
+        widenHigh(vld1q_u8(center-HALF_PATCH_SIZE)),
+        widenLow(vld1q_u8(center)), widenHigh(vld1q_u8(center))};
+      for (int i = 0; i < 4; ++i) {
+        const int16x8_t w = vld1q_s16(u_weights[0]+8*i);
+        acc_10 = vmlal_s16(acc_10, vget_low_s16(c[i]), vget_low_s16(w));
+        acc_10 = vmlal_s16(acc_10, vget_high_s16(c[i]), vget_high_s16(w));
+      }
+    }
+
+    // The two lines at +v and -v
+    for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
+      const uint8_t* plus = center + v*step;
+      const uint8_t* minus = center - v*step;
+      const uint8x16_t plus_left = vld1q_u8(plus-HALF_PATCH_SIZE);
+      const uint8x16_t plus_right = vld1q_u8(plus);
+      const uint8x16_t minus_left = vld1q_u8(minus-HALF_PATCH_SIZE);
+      const uint8x16_t minus_right = vld1q_u8(minus);
+
+      const int16x8_t p[4] = {
+        widenLow(plus_left), widenHigh(plus_left),
+        widenLow(plus_right), widenHigh(plus_right)};
+      const int16x8_t m[4] = {
+        widenLow(minus_left), widenHigh(minus_left),
+        widenLow(minus_right), widenHigh(minus_right)};
+
+      for (int i = 0; i < 4; ++i) {
+        const int16x8_t sum = vaddq_s16(p[i], m[i]);
+        const int16x8_t diff = vsubq_s16(p[i], m[i]);
+        const int16x8_t wu = vld1q_s16(u_weights[v]+8*i);
+        const int16x8_t wv = vld1q_s16(v_weights[v]+8*i);
+        acc_10 = vmlal_s16(acc_10, vget_low_s16(sum), vget_low_s16(wu));
+        acc_10 = vmlal_s16(acc_10, vget_high_s16(sum), vget_high_s16(wu));
+        acc_01 = vmlal_s16(acc_01, vget_low_s16(diff), vget_low_s16(wv));
+        acc_01 = vmlal_s16(acc_01, vget_high_s16(diff), vget_high_s16(wv));
+      }
+    }
+
+    m_10 = vaddvq_s32(acc_10);
+    m_01 = vaddvq_s32(acc_01);
+#else
+    m_01 = 0;
+    m_10 = 0;
+
+    // Treat the center line differently, v=0
+    for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u)
+      m_10 += u * center[u];
+
+    // Go line by line in the circular patch
+    for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
+      // Proceed over the two lines
+      int v_sum = 0;
+      const int d = umax[v];
+      for (int u = -d; u <= d; ++u) {
+        const int val_plus = center[u + v*step];
+        const int val_minus = center[u - v*step];
+        v_sum += (val_plus - val_minus);
+        m_10 += u * (val_plus + val_minus);
+      }
+      m_01 += v * v_sum;
+    }
+#endif
+  }
+
+private:
+#if defined(MSCKF_VIO_ORB_SSE2)
+  static int horizontalSum(const __m128i x) {
+    const __m128i y = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    const __m128i z = _mm_add_epi32(y, _mm_shuffle_epi32(y, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(z);
+  }
+#elif defined(MSCKF_VIO_ORB_NEON)
+  static int16x8_t widenLow(const uint8x16_t x) {
+    return vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(x)));
+  }
+  static int16x8_t widenHigh(const uint8x16_t x) {
+    return vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(x)));
+  }
+#endif
+
+  std::vector<int> umax;
+  // Weights of the pixels of each line for m_10 and m_01,
+  // which are zero outside of the circle.
+  int16_t u_weights[HALF_PATCH_SIZE+1][32];
+  int16_t v_weights[HALF_PATCH_SIZE+1][32];
+};
+
+/*
+ * @brief computeBriefDescriptor Computes the 256 intensity
+ *    tests of the rotated BRIEF pattern around a keypoint.
+ * @param center: the keypoint in the blurred image.
+ * @param step: the row step of the image in bytes.
+ * @param a, b: cosine and sine of the keypoint angle.
+ * @param pattern: the 512 points of the pattern as (x, y).
+ * @param desc: the 32 bytes of the descriptor.
+ */
+inline void computeBriefDescriptor(const uint8_t* center, const int step,
+    const float a, const float b, const int* pattern, uint8_t* desc) {
+#if defined(MSCKF_VIO_ORB_SSE2) || defined(MSCKF_VIO_ORB_NEON)
+  // The offsets of the rotated points are computed four
+  // at a time, then the pixels are fetched one by one.
+  int offsets[512];
+#if defined(MSCKF_VIO_ORB_SSE2)
+  // The offset is y*step + x, which is computed on 16 bit
+  // lanes, so the step should fit into them.
+  if (step < 32768) {
+    const __m128 va = _mm_set1_ps(a);
+    const __m128 vb = _mm_set1_ps(b);
+    const __m128i vstep = _mm_set1_epi32((1 << 16) | step);
+    for (int i = 0; i < 512; i += 4) {
+      const __m128 p0 = _mm_cvtepi32_ps(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(pattern+2*i)));
+      const __m128 p1 = _mm_cvtepi32_ps(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(pattern+2*i+4)));
+      const __m128 x = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0));
+      const __m128 y = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1));
+
+      const __m128i ry = _mm_cvtps_epi32(
+          _mm_add_ps(_mm_mul_ps(x, vb), _mm_mul_ps(y, va)));
+      const __m128i rx = _mm_cvtps_epi32(
+          _mm_sub_ps(_mm_mul_ps(x, va), _mm_mul_ps(y, vb)));
+      const __m128i packed = _mm_packs_epi32(ry, rx);
+      const __m128i pairs = _mm_unpacklo_epi16(
+          packed, _mm_srli_si128(packed, 8));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(offsets+i),
+          _mm_madd_epi16(pairs, vstep));
+    }
+  } else {
+    for (int i = 0; i < 512; ++i) {
+      const float x = static_cast<float>(pattern[2*i]);
+      const float y = static_cast<float>(pattern[2*i+1]);
+      offsets[i] = static_cast<int>(std::lrint(x*b + y*a))*step +
+        static_cast<int>(std::lrint(x*a - y*b));
+    }
+  }
+#else
+  const float32x4_t va = vdupq_n_f32(a);
+  const float32x4_t vb = vdupq_n_f32(b);
+  const int32x4_t vstep = vdupq_n_s32(step);
+  for (int i = 0; i < 512; i += 4) {
+    const int32x4x2_t p = vld2q_s32(pattern+2*i);
+    const float32x4_t x = vcvtq_f32_s32(p.val[0]);
+    const float32x4_t y = vcvtq_f32_s32(p.val[1]);
+    const int32x4_t ry = vcvtnq_s32_f32(
+        vaddq_f32(vmulq_f32(x, vb), vmulq_f32(y, va)));
+    const int32x4_t rx = vcvtnq_s32_f32(
+        vsubq_f32(vmulq_f32(x, va), vmulq_f32(y, vb)));
+    vst1q_s32(offsets+i, vmlaq_s32(rx, ry, vstep));
+  }
+#endif
+
+  uint8_t t0[256], t1[256];
+  for (int i = 0; i < 256; ++i) {
+    t0[i] = center[offsets[2*i]];
+    t1[i] = center[offsets[2*i+1]];
+  }
+
+#if defined(MSCKF_VIO_ORB_SSE2)
+  // Unsigned comparison of 16 tests at a time, whose
+  // results are the 16 bits of two bytes.
+  const __m128i sign = _mm_set1_epi8(static_cast<char>(0x80));
+  for (int i = 0; i < 16; ++i) {
+    const __m128i v0 = _mm_xor_si128(sign, _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(t0+16*i)));
+    const __m128i v1 = _mm_xor_si128(sign, _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(t1+16*i)));
+    const int mask = _mm_movemask_epi8(_mm_cmplt_epi8(v0, v1));
+    desc[2*i] = static_cast<uint8_t>(mask & 0xff);
+    desc[2*i+1] = static_cast<uint8_t>(mask >> 8);
+  }
+#else
+  for (int i = 0; i < 32; ++i) {
+    int val = 0;
+    for (int j = 0; j < 8; ++j)
+      val |= (t0[8*i+j] < t1[8*i+j]) << j;
+    desc[i] = static_cast<uint8_t>(val);
+  }
+#endif
+#else
+  #define GET_VALUE(idx) \
+    center[static_cast<int>(std::lrint(pattern[2*(idx)]*b + pattern[2*(idx)+1]*a))*step + \
+      static_cast<int>(std::lrint(pattern[2*(idx)]*a - pattern[2*(idx)+1]*b))]
+
+  for (int i = 0; i < 32; ++i, pattern += 32) {
+    int val = 0;
+    for (int j = 0; j < 8; ++j) {
+      const int t0 = GET_VALUE(2*j);
+      const int t1 = GET_VALUE(2*j+1);
+      val |= (t0 < t1) << j;
+    }
+    desc[i] = static_cast<uint8_t>(val);
+  }
+
+  #undef GET_VALUE
+#endif
+}
+
+} // end namespace msckf_vio
+
+#endif
@@ -0,0 +1,403 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_POINT_UNDISTORTER_HPP
+#define MSCKF_VIO_POINT_UNDISTORTER_HPP
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "cpu_features.hpp"
+
+namespace msckf_vio {
+
+/*
+ * @brief PointUndistorter Undistorts and distorts points of
+ *    a single camera. The calibration is cached once so that
+ *    the per-frame calls do not rebuild the camera matrices.
+ *
+ *    Optionally, a dense lookup table storing the undistorted
+ *    normalized coordinates of every pixel is created, which
+ *    replaces the iterative undistortion with a bilinear
+ *    interpolation for the points within the image. Points
+ *    outside of the table fall back to the exact solution.
+ */
+class PointUndistorter {
+public:
+  enum DistortionModel {
+    RADTAN,
+    EQUIDISTANT
+  };
+
+  PointUndistorter() : model(RADTAN) {}
+
+  /*
+   * @brief initialize Caches the calibration of the camera.
+   * @param resolution: image width and height.
+   * @param intrinsics: fx, fy, cx, cy.
+   * @param distortion_model: "radtan" or "equidistant".
+   * @param distortion_coeffs: distortion coefficients.
+   * @param use_lookup_table: create the dense lookup table.
+   * @return False if the distortion model is unrecognized,
+   *    in which case radtan is used instead.
+   */
+  bool initialize(
+      const cv::Vec2i& resolution,
+      const cv::Vec4d& intrinsics,
+      const std::string& distortion_model,
+      const cv::Vec4d& distortion_coeffs,
+      const bool use_lookup_table) {
+    bool model_recognized = true;
+    if (distortion_model == "radtan") {
+      model = RADTAN;
+    } else if (distortion_model == "equidistant") {
+      model = EQUIDISTANT;
+    } else {
+      model = RADTAN;
+      model_recognized = false;
+    }
+
+    this->intrinsics = intrinsics;
+    this->distortion_coeffs = distortion_coeffs;
+    K = cv::Matx33d(
+        intrinsics[0], 0.0, intrinsics[2],
+        0.0, intrinsics[1], intrinsics[3],
+        0.0, 0.0, 1.0);
+
+    lut_x.release();
+    lut_y.release();
+    if (use_lookup_table) createLookupTable(resolution);
+
+    return model_recognized;
+  }
+
+  /*
+   * @brief undistort Undistorts the given pixels.
+   * @param pts_in: distorted points in pixels.
+   * @param rectification_matrix: rotation applied to the
+   *    undistorted points.
+   * @param new_intrinsics: intrinsics used to project the
+   *    undistorted points. The default gives the normalized
+   *    image coordinates.
+   * @return pts_out: undistorted points.
+   */
+  void undistort(
+      const std::vector<cv::Point2f>& pts_in,
+      std::vector<cv::Point2f>& pts_out,
+      const cv::Matx33d& rectification_matrix = cv::Matx33d::eye(),
+      const cv::Vec4d& new_intrinsics = cv::Vec4d(1, 1, 0, 0)) const {
+    pts_out.resize(pts_in.size());
+    if (pts_in.size() == 0) return;
+
+    // Points which cannot be handled by the lookup table.
+    std::vector<int> missed_idx(0);
+    if (lut_x.empty()) {
+      missed_idx.resize(pts_in.size());
+      for (size_t i = 0; i < pts_in.size(); ++i) missed_idx[i] = i;
+    } else {
+      lookup(pts_in, pts_out, missed_idx);
+    }
+
+    if (missed_idx.size() == pts_in.size()) {
+      exactUndistort(pts_in, pts_out);
+    } else if (missed_idx.size() > 0) {
+      std::vector<cv::Point2f> missed_pts(missed_idx.size());
+      for (size_t i = 0; i < missed_idx.size(); ++i)
+        missed_pts[i] = pts_in[missed_idx[i]];
+      std::vector<cv::Point2f> missed_pts_out(0);
+      exactUndistort(missed_pts, missed_pts_out);
+      for (size_t i = 0; i < missed_idx.size(); ++i)
+        pts_out[missed_idx[i]] = missed_pts_out[i];
+    }
+
+    if (rectification_matrix == cv::Matx33d::eye() &&
+        new_intrinsics == cv::Vec4d(1, 1, 0, 0))
+      return;
+
+    // Rotate and project the normalized points the same way
+    // as cv::undistortPoints does with R and P.
+    for (auto& pt : pts_out) {
+      const cv::Vec3d pt_r = rectification_matrix *
+        cv::Vec3d(pt.x, pt.y, 1.0);
+      pt.x = new_intrinsics[0]*pt_r[0]/pt_r[2] + new_intrinsics[2];
+      pt.y = new_intrinsics[1]*pt_r[1]/pt_r[2] + new_intrinsics[3];
+    }
+
+    return;
+  }
+
+  /*
+   * @brief distort Projects normalized image coordinates
+   *    to distorted pixels.
+   * @param pts_in: points on the normalized image plane.
+   * @return Distorted points in pixels.
+   */
+  std::vector<cv::Point2f> distort(
+      const std::vector<cv::Point2f>& pts_in) const {
+    std::vector<cv::Point2f> pts_out(pts_in.size());
+
+    const double& fx = intrinsics[0];
+    const double& fy = intrinsics[1];
+    const double& cx = intrinsics[2];
+    const double& cy = intrinsics[3];
+    const double& k1 = distortion_coeffs[0];
+    const double& k2 = distortion_coeffs[1];
+
+    if (model == EQUIDISTANT) {
+      // Same as cv::fisheye::distortPoints.
+      const double& k3 = distortion_coeffs[2];
+      const double& k4 = distortion_coeffs[3];
+      for (size_t i = 0; i < pts_in.size(); ++i) {
+        const double x = pts_in[i].x;
+        const double y = pts_in[i].y;
+        const double r = std::sqrt(x*x + y*y);
+        const double theta = std::atan(r);
+        const double theta2 = theta*theta;
+        const double theta_d = theta * (1.0 + theta2*(k1 +
+              theta2*(k2 + theta2*(k3 + theta2*k4))));
+        const double scale = r > 1e-8 ? theta_d/r : 1.0;
+        pts_out[i].x = fx*x*scale + cx;
+        pts_out[i].y = fy*y*scale + cy;
+      }
+    } else {
+      // Same as cv::projectPoints with zero pose.
+      const double& p1 = distortion_coeffs[2];
+      const double& p2 = distortion_coeffs[3];
+      for (size_t i = 0; i < pts_in.size(); ++i) {
+        const double x = pts_in[i].x;
+        const double y = pts_in[i].y;
+        const double r2 = x*x + y*y;
+        const double radial = 1.0 + r2*(k1 + r2*k2);
+        const double xd = x*radial + 2.0*p1*x*y + p2*(r2+2.0*x*x);
+        const double yd = y*radial + p1*(r2+2.0*y*y) + 2.0*p2*x*y;
+        pts_out[i].x = fx*xd + cx;
+        pts_out[i].y = fy*yd + cy;
+      }
+    }
+
+    return pts_out;
+  }
+
+  const cv::Vec4d& getIntrinsics() const {
+    return intrinsics;
+  }
+
+  bool hasLookupTable() const {
+    return !lut_x.empty();
+  }
+
+private:
+
+  /*
+   * @brief exactUndistort Iteratively undistorts the points
+   *    to the normalized image plane with OpenCV.
+   */
+  void exactUndistort(
+      const std::vector<cv::Point2f>& pts_in,
+      std::vector<cv::Point2f>& pts_out) const {
+    if (model == EQUIDISTANT)
+      cv::fisheye::undistortPoints(pts_in, pts_out, K, distortion_coeffs);
+    else
+      cv::undistortPoints(pts_in, pts_out, K, distortion_coeffs);
+    return;
+  }
+
+  /*
+   * @brief createLookupTable Undistorts every pixel of the
+   *    image once and stores the normalized coordinates.
+   */
+  void createLookupTable(const cv::Vec2i& resolution) {
+    const int cols = resolution[0];
+    const int rows = resolution[1];
+    if (cols < 2 || rows < 2) return;
+
+    std::vector<cv::Point2f> pixels(0);
+    pixels.reserve(cols*rows);
+    for (int v = 0; v < rows; ++v)
+      for (int u = 0; u < cols; ++u)
+        pixels.push_back(cv::Point2f(u, v));
+
+    std::vector<cv::Point2f> pixels_undistorted(0);
+    exactUndistort(pixels, pixels_undistorted);
+
+    lut_x.create(rows, cols, CV_32F);
+    lut_y.create(rows, cols, CV_32F);
+    for (int v = 0; v < rows; ++v) {
+      float* lut_x_row = lut_x.ptr<float>(v);
+      float* lut_y_row = lut_y.ptr<float>(v);
+      for (int u = 0; u < cols; ++u) {
+        lut_x_row[u] = pixels_undistorted[v*cols+u].x;
+        lut_y_row[u] = pixels_undistorted[v*cols+u].y;
+      }
+    }
+
+    return;
+  }
+
+  /*
+   * @brief lookupPoint Bilinear interpolation within the
+   *    lookup table.
+   * @return False if the point is outside of the table.
+   */
+  bool lookupPoint(const cv::Point2f& pt, cv::Point2f& pt_out) const {
+    // Written so that NaNs are rejected as well.
+    if (!(pt.x >= 0.0f && pt.x < lut_x.cols-1 &&
+          pt.y >= 0.0f && pt.y < lut_x.rows-1))
+      return false;
+
+    const int u = static_cast<int>(pt.x);
+    const int v = static_cast<int>(pt.y);
+    const float au = pt.x - u;
+    const float av = pt.y - v;
+
+    const float* x0 = lut_x.ptr<float>(v);
+    const float* x1 = lut_x.ptr<float>(v+1);
+    const float* y0 = lut_y.ptr<float>(v);
+    const float* y1 = lut_y.ptr<float>(v+1);
+
+    const float x_top = x0[u] + au*(x0[u+1]-x0[u]);
+    const float x_bottom = x1[u] + au*(x1[u+1]-x1[u]);
+    const float y_top = y0[u] + au*(y0[u+1]-y0[u]);
+    const float y_bottom = y1[u] + au*(y1[u+1]-y1[u]);
+    pt_out.x = x_top + av*(x_bottom-x_top);
+    pt_out.y = y_top + av*(y_bottom-y_top);
+    return true;
+  }
+
+  /*
+   * @brief lookup Interpolates all the points within the
+   *    lookup table, 8 at a time if the cpu has AVX2.
+   * @return missed_idx: indices of the points outside
+   *    of the lookup table.
+   */
+  void lookup(
+      const std::vector<cv::Point2f>& pts_in,
+      std::vector<cv::Point2f>& pts_out,
+      std::vector<int>& missed_idx) const {
+    int i = 0;
+#ifdef MSCKF_VIO_AVX2_DISPATCH
+    if (cpuSupportsAvx2()) i = lookupAvx2(pts_in, pts_out, missed_idx);
+#endif
+
+    for (; i < static_cast<int>(pts_in.size()); ++i) {
+      if (!lookupPoint(pts_in[i], pts_out[i]))
+        missed_idx.push_back(i);
+    }
+
+    return;
+  }
+
+#ifdef MSCKF_VIO_AVX2_DISPATCH
+  /*
+   * @brief lookupAvx2 Interpolates the points in blocks
+   *    of 8 with gathers from the lookup table.
+   * @return Number of points handled, i.e. all but the
+   *    last pts_in.size() % 8.
+   */
+  MSCKF_VIO_TARGET_AVX2 int lookupAvx2(
+      const std::vector<cv::Point2f>& pts_in,
+      std::vector<cv::Point2f>& pts_out,
+      std::vector<int>& missed_idx) const {
+    // The tables are continuous, so that a single row
+    // stride addresses all the pixels.
+    const int stride = lut_x.cols;
+    const float* lut_x_data = lut_x.ptr<float>();
+    const float* lut_y_data = lut_y.ptr<float>();
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 u_max = _mm256_set1_ps(lut_x.cols-1);
+    const __m256 v_max = _mm256_set1_ps(lut_x.rows-1);
+    const __m256i stride_v = _mm256_set1_epi32(stride);
+    const __m256i one_v = _mm256_set1_epi32(1);
+
+    const int pt_num = pts_in.size();
+    alignas(32) float us[8], vs[8], xs[8], ys[8];
+    int i = 0;
+    for (; i+8 <= pt_num; i += 8) {
+      for (int k = 0; k < 8; ++k) {
+        us[k] = pts_in[i+k].x;
+        vs[k] = pts_in[i+k].y;
+      }
+      const __m256 u = _mm256_load_ps(us);
+      const __m256 v = _mm256_load_ps(vs);
+
+      const __m256 inside = _mm256_and_ps(
+          _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ),
+            _mm256_cmp_ps(u, u_max, _CMP_LT_OQ)),
+          _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ),
+            _mm256_cmp_ps(v, v_max, _CMP_LT_OQ)));
+
+      // Handle the whole block with the scalar version
+      // if any of the points is outside of the table.
+      if (_mm256_movemask_ps(inside) != 0xFF) {
+        for (int k = i; k < i+8; ++k) {
+          if (!lookupPoint(pts_in[k], pts_out[k]))
+            missed_idx.push_back(k);
+        }
+        continue;
+      }
+
+      const __m256 u0 = _mm256_floor_ps(u);
+      const __m256 v0 = _mm256_floor_ps(v);
+      const __m256 au = _mm256_sub_ps(u, u0);
+      const __m256 av = _mm256_sub_ps(v, v0);
+
+      const __m256i idx00 = _mm256_add_epi32(
+          _mm256_mullo_epi32(_mm256_cvttps_epi32(v0), stride_v),
+          _mm256_cvttps_epi32(u0));
+      const __m256i idx01 = _mm256_add_epi32(idx00, one_v);
+      const __m256i idx10 = _mm256_add_epi32(idx00, stride_v);
+      const __m256i idx11 = _mm256_add_epi32(idx10, one_v);
+
+      const __m256 x = interpolate(lut_x_data,
+          idx00, idx01, idx10, idx11, au, av);
+      const __m256 y = interpolate(lut_y_data,
+          idx00, idx01, idx10, idx11, au, av);
+      _mm256_store_ps(xs, x);
+      _mm256_store_ps(ys, y);
+
+      for (int k = 0; k < 8; ++k) {
+        pts_out[i+k].x = xs[k];
+        pts_out[i+k].y = ys[k];
+      }
+    }
+
+    return i;
+  }
+
+  MSCKF_VIO_TARGET_AVX2 static __m256 interpolate(const float* table,
+      const __m256i& idx00, const __m256i& idx01,
+      const __m256i& idx10, const __m256i& idx11,
+      const __m256& au, const __m256& av) {
+    const __m256 p00 = _mm256_i32gather_ps(table, idx00, 4);
+    const __m256 p01 = _mm256_i32gather_ps(table, idx01, 4);
+    const __m256 p10 = _mm256_i32gather_ps(table, idx10, 4);
+    const __m256 p11 = _mm256_i32gather_ps(table, idx11, 4);
+    const __m256 top = _mm256_add_ps(p00,
+        _mm256_mul_ps(au, _mm256_sub_ps(p01, p00)));
+    const __m256 bottom = _mm256_add_ps(p10,
+        _mm256_mul_ps(au, _mm256_sub_ps(p11, p10)));
+    return _mm256_add_ps(top,
+        _mm256_mul_ps(av, _mm256_sub_ps(bottom, top)));
+  }
+#endif
+
+  DistortionModel model;
+  cv::Vec4d intrinsics;
+  cv::Vec4d distortion_coeffs;
+  cv::Matx33d K;
+
+  // Undistorted normalized coordinates of each pixel.
+  cv::Mat lut_x;
+  cv::Mat lut_y;
+};
+
+} // end namespace msckf_vio
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_POSE_HISTORY_HPP
+#define MSCKF_VIO_POSE_HISTORY_HPP
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+namespace msckf_vio {
+
+/*
+ * @brief PoseHistory Estimated poses of the last few seconds
+ *    indexed by their time stamps in nanoseconds, so that
+ *    delayed measurements, e.g. loop closures, can be related
+ *    to the pose at their time.
+ *
+ *    The poses are kept in a ring buffer, which only grows
+ *    if the duration holds more poses than its capacity.
+ *    Lookups are binary searches over the time stamps.
+ */
+class PoseHistory {
+public:
+  /*
+   * @param duration: poses older than this duration w.r.t.
+   *    the latest one are dropped, in seconds.
+   */
+  explicit PoseHistory(const double duration = 10.0) :
+    buffer(64), head(0), count(0) {
+    setDuration(duration);
+  }
+
+  void setDuration(const double duration) {
+    max_age = static_cast<int64_t>(duration * 1e9);
+  }
+
+  void clear() {
+    head = 0;
+    count = 0;
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  /*
+   * @brief push Adds the pose at the given time, which
+   *    should be later than the ones already stored.
+   * @return False if the pose is out of order and dropped.
+   */
+  bool push(const int64_t stamp, const Eigen::Isometry3d& pose) {
+    if (count > 0 && stamp <= at(count-1).stamp) return false;
+
+    // Drop the poses beyond the duration.
+    while (count > 0 && stamp-at(0).stamp > max_age) {
+      head = (head+1) % buffer.size();
+      --count;
+    }
+
+    if (count == buffer.size()) grow();
+
+    Entry& entry = buffer[(head+count) % buffer.size()];
+    entry.stamp = stamp;
+    entry.orientation = Eigen::Quaterniond(pose.linear());
+    entry.position = pose.translation();
+    ++count;
+    return true;
+  }
+
+  /*
+   * @brief nearest Finds the pose closest in time.
+   * @param stamp: time of the query in nanoseconds.
+   * @param tolerance: maximum time difference in nanoseconds.
+   * @return pose: the pose found.
+   * @return pose_stamp: time of the pose found.
+   * @return False if there is no pose within the tolerance.
+   */
+  bool nearest(const int64_t stamp, const int64_t tolerance,
+      Eigen::Isometry3d& pose, int64_t& pose_stamp) const {
+    if (count == 0) return false;
+
+    const size_t upper = upperBound(stamp);
+    size_t index = upper;
+    if (upper == count ||
+        (upper > 0 && stamp-at(upper-1).stamp <= at(upper).stamp-stamp))
+      index = upper-1;
+
+    const Entry& entry = at(index);
+    if (std::abs(entry.stamp-stamp) > tolerance) return false;
+    pose = entry.toIsometry();
+    pose_stamp = entry.stamp;
+    return true;
+  }
+
+  /*
+   * @brief interpolate Interpolates the pose at the given
+   *    time between the two poses around it.
+   * @return False if the time is outside of the history.
+   */
+  bool interpolate(const int64_t stamp,
+      Eigen::Isometry3d& pose) const {
+    if (count == 0) return false;
+
+    const size_t upper = upperBound(stamp);
+    if (upper == 0) return false;
+    const Entry& begin = at(upper-1);
+    if (begin.stamp == stamp) {
+      pose = begin.toIsometry();
+      return true;
+    }
+    if (upper == count) return false;
+
+    const Entry& end = at(upper);
+    const double ratio = static_cast<double>(stamp-begin.stamp) /
+      static_cast<double>(end.stamp-begin.stamp);
+    pose.setIdentity();
+    pose.linear() = begin.orientation.slerp(
+        ratio, end.orientation).toRotationMatrix();
+    pose.translation() = (1.0-ratio)*begin.position +
+      ratio*end.position;
+    return true;
+  }
+
+private:
+  struct Entry {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    int64_t stamp;
+    Eigen::Quaterniond orientation;
+    Eigen::Vector3d position;
+
+    Eigen::Isometry3d toIsometry() const {
+      Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+      pose.linear() = orientation.toRotationMatrix();
+      pose.translation() = position;
+      return pose;
+    }
+  };
+
+  // The i-th oldest entry.
+  const Entry& at(const size_t i) const {
+    return buffer[(head+i) % buffer.size()];
+  }
+
+  // Index of the first entry later than the stamp.
+  size_t upperBound(const int64_t stamp) const {
+    size_t first = 0;
+    size_t last = count;
+    while (first < last) {
+      const size_t middle = first + (last-first)/2;
+      if (at(middle).stamp <= stamp) first = middle+1;
+      else last = middle;
+    }
+    return first;
+  }
+
+  void grow() {
+    std::vector<Entry, Eigen::aligned_allocator<Entry> >
+      new_buffer(buffer.size()*2);
+    for (size_t i = 0; i < count; ++i)
+      new_buffer[i] = at(i);
+    buffer.swap(new_buffer);
+    head = 0;
+  }
+
+  std::vector<Entry, Eigen::aligned_allocator<Entry> > buffer;
+  size_t head;
+  size_t count;
+  int64_t max_age;
+};
+
+} // end namespace msckf_vio
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_PROFILER_HPP
+#define MSCKF_VIO_PROFILER_HPP
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace msckf_vio {
+namespace profiling {
+
+typedef std::chrono::steady_clock Clock;
+
+/*
+ * @brief allocationCount Number of heap allocations made
+ *    by the calling thread. It is only counted in programs
+ *    using MSCKF_VIO_DEFINE_ALLOCATION_COUNTER, and stays 0
+ *    otherwise.
+ */
+inline uint64_t& allocationCount() {
+  static thread_local uint64_t count = 0;
+  return count;
+}
+
+/*
+ * @brief Histogram Histogram of durations with logarithmic
+ *    bins from 1us to 100s, which bounds the error of the
+ *    quantiles to about 12%.
+ */
+class Histogram {
+public:
+  enum {
+    BIN_PER_DECADE = 20,
+    BIN_NUM = 8 * BIN_PER_DECADE
+  };
+
+  Histogram() {
+    clear();
+  }
+
+  void clear() {
+    std::fill(bins, bins+BIN_NUM, 0);
+    count = 0;
+    sum = 0.0;
+    max = 0.0;
+  }
+
+  // @param duration: in seconds.
+  void add(const double duration) {
+    int bin = duration > 1e-6 ? static_cast<int>(
+        std::log10(duration*1e6) * BIN_PER_DECADE) : 0;
+    bin = std::min(bin, static_cast<int>(BIN_NUM)-1);
+    ++bins[bin];
+    ++count;
+    sum += duration;
+    max = std::max(max, duration);
+  }
+
+  /*
+   * @brief quantile Upper edge of the bin containing
+   *    the given quantile, limited by the maximum. The
+   *    last bin also holds the longer durations, which
+   *    are represented by the maximum.
+   */
+  double quantile(const double q) const {
+    if (count == 0) return 0.0;
+    const uint64_t rank = static_cast<uint64_t>(std::ceil(q*count));
+    uint64_t cumulative = 0;
+    for (int i = 0; i < BIN_NUM; ++i) {
+      cumulative += bins[i];
+      if (cumulative >= rank && i < BIN_NUM-1)
+        return std::min(max, 1e-6 * std::pow(
+              10.0, static_cast<double>(i+1)/BIN_PER_DECADE));
+    }
+    return max;
+  }
+
+  uint64_t count;
+  double sum;
+  double max;
+
+private:
+  uint64_t bins[BIN_NUM];
+};
+
+/*
+ * @brief StageStatistics Summary of a stage over a period.
+ *    The durations are in seconds.
+ */
+struct StageStatistics {
+  std::string name;
+  uint64_t count;
+  double mean;
+  double p50;
+  double p99;
+  double max;
+  double allocations;
+};
+
+/*
+ * @brief Profiler Collects the durations and allocations of
+ *    the named stages of a pipeline, and optionally writes
+ *    them as complete events in the Chrome trace format.
+ *
+ *    Stages can be recorded from any thread. The names
+ *    should be string literals, which are compared by their
+ *    address first.
+ */
+class Profiler {
+public:
+  Profiler() : origin(Clock::now()), has_trace_event(false) {}
+
+  ~Profiler() {
+    if (trace.is_open()) trace << "\n]\n";
+  }
+
+  /*
+   * @brief openTrace Starts to write the events into the
+   *    given file, which can be loaded in chrome://tracing.
+   */
+  bool openTrace(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mtx);
+    trace.open(filename.c_str());
+    if (!trace.is_open()) return false;
+    trace << "[\n";
+    has_trace_event = false;
+    return true;
+  }
+
+  void record(const char* name,
+      const Clock::time_point& start,
+      const Clock::time_point& end,
+      const uint64_t allocations) {
+    const double duration =
+      std::chrono::duration<double>(end-start).count();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    Stage& stage = findStage(name);
+    stage.histogram.add(duration);
+    stage.allocations += allocations;
+
+    if (!trace.is_open()) return;
+    const double timestamp = std::chrono::duration<double, std::micro>(
+        start-origin).count();
+    trace << (has_trace_event ? ",\n" : "")
+      << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0"
+      << ",\"tid\":" << std::hash<std::thread::id>()(
+          std::this_thread::get_id()) % 100000
+      << ",\"ts\":" << timestamp
+      << ",\"dur\":" << duration*1e6
+      << ",\"args\":{\"allocations\":" << allocations << "}}";
+    has_trace_event = true;
+  }
+
+  /*
+   * @brief collect Returns the statistics of the stages
+   *    called since the previous collection.
+   */
+  std::vector<StageStatistics> collect() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<StageStatistics> statistics;
+    for (auto& stage : stages) {
+      const Histogram& histogram = stage.histogram;
+      if (histogram.count == 0) continue;
+
+      StageStatistics stage_statistics;
+      stage_statistics.name = stage.name;
+      stage_statistics.count = histogram.count;
+      stage_statistics.mean = histogram.sum / histogram.count;
+      stage_statistics.p50 = histogram.quantile(0.5);
+      stage_statistics.p99 = histogram.quantile(0.99);
+      stage_statistics.max = histogram.max;
+      stage_statistics.allocations =
+        static_cast<double>(stage.allocations) / histogram.count;
+      statistics.push_back(stage_statistics);
+
+      stage.histogram.clear();
+      stage.allocations = 0;
+    }
+    if (trace.is_open()) trace.flush();
+    return statistics;
+  }
+
+private:
+  struct Stage {
+    const char* name;
+    Histogram histogram;
+    uint64_t allocations;
+  };
+
+  Stage& findStage(const char* name) {
+    for (auto& stage : stages)
+      if (stage.name == name) return stage;
+    for (auto& stage : stages)
+      if (std::strcmp(stage.name, name) == 0) return stage;
+
+    stages.push_back(Stage());
+    stages.back().name = name;
+    stages.back().allocations = 0;
+    return stages.back();
+  }
+
+  std::mutex mtx;
+  // There are only a few stages, so a linear
+  // search is faster than a map.
+  std::vector<Stage> stages;
+
+  Clock::time_point origin;
+  std::ofstream trace;
+  bool has_trace_event;
+};
+
+/*
+ * @brief ScopedTimer Records the lifetime of the object
+ *    as a stage of the profiler.
+ */
+class ScopedTimer {
+public:
+  ScopedTimer(Profiler& p, const char* n) :
+    profiler(p), name(n),
+    allocations(allocationCount()),
+    start(Clock::now()) {}
+
+  ~ScopedTimer() {
+    const Clock::time_point end = Clock::now();
+    profiler.record(name, start, end, allocationCount()-allocations);
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer operator=(const ScopedTimer&) = delete;
+
+private:
+  Profiler& profiler;
+  const char* name;
+  uint64_t allocations;
+  Clock::time_point start;
+};
+
+} // end namespace profiling
+} // end namespace msckf_vio
+
+#define MSCKF_VIO_PROFILE_CONCAT_IMPL(a, b) a##b
+#define MSCKF_VIO_PROFILE_CONCAT(a, b) MSCKF_VIO_PROFILE_CONCAT_IMPL(a, b)
+
+// Define MSCKF_VIO_DISABLE_PROFILING to compile the timers out.
+#ifndef MSCKF_VIO_DISABLE_PROFILING
+#define MSCKF_VIO_PROFILE_SCOPE(profiler, name) \
+  msckf_vio::profiling::ScopedTimer \
+    MSCKF_VIO_PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, name)
+#else
+#define MSCKF_VIO_PROFILE_SCOPE(profiler, name)
+#endif
+
+/*
+ * Replaces the global operator new and delete to count the
+ * allocations of each thread. It should be used once, at
+ * the global scope of an executable, since replacing them
+ * from a shared library, e.g. a nodelet, is not reliable.
+ */
+#define MSCKF_VIO_DEFINE_ALLOCATION_COUNTER() \
+  void* operator new(std::size_t size) { \
+    ++msckf_vio::profiling::allocationCount(); \
+    void* ptr = std::malloc(size == 0 ? 1 : size); \
+    if (!ptr) throw std::bad_alloc(); \
+    return ptr; \
+  } \
+  void* operator new[](std::size_t size) { \
+    return operator new(size); \
+  } \
+  void operator delete(void* ptr) noexcept { \
+    std::free(ptr); \
+  } \
+  void operator delete[](void* ptr) noexcept { \
+    std::free(ptr); \
+  }
+
+#endif
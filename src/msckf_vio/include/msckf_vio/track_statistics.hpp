@@ -0,0 +1,114 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_TRACK_STATISTICS_HPP
+#define MSCKF_VIO_TRACK_STATISTICS_HPP
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+namespace msckf_vio {
+
+/*
+ * @brief TrackStatistics Streaming statistics of the quality
+ *    of the feature tracks, i.e. the lifetime of the tracks
+ *    and the stereo matching error of the features.
+ *
+ *    Only the histograms are stored, whose sizes are fixed,
+ *    so the memory does not grow with the number of tracks.
+ *    The counts are accumulated since the start.
+ */
+class TrackStatistics {
+public:
+  /*
+   * @param max_lifetime: tracks living longer than this
+   *    number of frames are counted in the last bin.
+   * @param max_error: stereo errors larger than this in
+   *    pixels are counted in the last bin.
+   * @param error_bin_num: number of bins of the errors.
+   */
+  TrackStatistics(const int max_lifetime = 50,
+      const double max_error = 5.0,
+      const int error_bin_num = 20) :
+    lifetime_histogram(std::max(max_lifetime, 1), 0),
+    error_histogram(std::max(error_bin_num, 1), 0),
+    error_bin_width(max_error / std::max(error_bin_num, 1)),
+    track_num(0), lifetime_sum(0) {}
+
+  void clear() {
+    std::fill(lifetime_histogram.begin(), lifetime_histogram.end(), 0);
+    std::fill(error_histogram.begin(), error_histogram.end(), 0);
+    track_num = 0;
+    lifetime_sum = 0;
+  }
+
+  /*
+   * @brief addTrack Counts a track which ended.
+   * @param lifetime: number of frames the feature is tracked in.
+   */
+  void addTrack(const int lifetime) {
+    const int bin = std::min(std::max(lifetime, 1),
+        static_cast<int>(lifetime_histogram.size())) - 1;
+    ++lifetime_histogram[bin];
+    ++track_num;
+    lifetime_sum += lifetime;
+  }
+
+  /*
+   * @brief addError Counts the stereo error of a feature.
+   * @param error: distance to the epipolar line in pixels.
+   */
+  void addError(const double error) {
+    const int bin = std::min(static_cast<int>(error / error_bin_width),
+        static_cast<int>(error_histogram.size())-1);
+    ++error_histogram[std::max(bin, 0)];
+  }
+
+  /*
+   * @brief lifetimeHistogram The i-th bin counts the tracks
+   *    living for i+1 frames. The last bin also counts the
+   *    longer tracks.
+   */
+  const std::vector<uint32_t>& lifetimeHistogram() const {
+    return lifetime_histogram;
+  }
+
+  /*
+   * @brief errorHistogram The i-th bin counts the errors in
+   *    [i, i+1) times the bin width. The last bin also counts
+   *    the larger errors.
+   */
+  const std::vector<uint32_t>& errorHistogram() const {
+    return error_histogram;
+  }
+
+  double errorBinWidth() const {
+    return error_bin_width;
+  }
+
+  uint64_t trackNumber() const {
+    return track_num;
+  }
+
+  double meanLifetime() const {
+    return track_num > 0 ?
+      static_cast<double>(lifetime_sum) / track_num : 0.0;
+  }
+
+private:
+  std::vector<uint32_t> lifetime_histogram;
+  std::vector<uint32_t> error_histogram;
+  double error_bin_width;
+
+  uint64_t track_num;
+  uint64_t lifetime_sum;
+};
+
+} // end namespace msckf_vio
+
+#endif
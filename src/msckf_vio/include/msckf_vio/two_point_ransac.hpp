@@ -0,0 +1,267 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_TWO_POINT_RANSAC_HPP
+#define MSCKF_VIO_TWO_POINT_RANSAC_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace msckf_vio {
+
+/*
+ * @brief TwoPointRansac Marks the inliers among the point pairs
+ *    of two frames whose relative rotation is already known, in
+ *    which case two pairs are enough to solve the translation
+ *    direction.
+ *
+ *    The number of iterations adapts to the inlier ratio of the
+ *    best model found so far. The workspace is kept between the
+ *    calls, so one object should be used per thread.
+ */
+class TwoPointRansac {
+public:
+  // Models supported by less than this ratio of the
+  // points are rejected, which also bounds the number
+  // of iterations.
+  static constexpr double min_inlier_ratio = 0.2;
+
+  /*
+   * @param initial_inlier_ratio: the inlier ratio assumed
+   *    before any model is found, which sets the number of
+   *    iterations until a better model shrinks it. 0.7 gives
+   *    the 7 iterations of the fixed scheme at 0.99.
+   */
+  TwoPointRansac(const unsigned int seed = 0,
+      const double initial_inlier_ratio = 0.7) :
+    random_gen(seed), initial_inlier_ratio(initial_inlier_ratio),
+    last_iter_num(0) {}
+
+  /*
+   * @brief estimate Applies two point ransac.
+   * @param pts1: normalized points in the previous frame,
+   *    already compensated with the relative rotation.
+   * @param pts2: normalized points in the current frame.
+   * @param norm_pixel_unit: the size of a pixel in the
+   *    coordinates of pts1 and pts2.
+   * @param inlier_error: acceptable error in pixels to be
+   *    considered as an inlier.
+   * @param success_probability: the required probability of success.
+   * @return inlier_markers: 1 for inliers and 0 for outliers.
+   *
+   * PointT only needs to have the members x and y.
+   */
+  template <typename PointT>
+  void estimate(
+      const std::vector<PointT>& pts1,
+      const std::vector<PointT>& pts2,
+      const double& norm_pixel_unit,
+      const double& inlier_error,
+      const double& success_probability,
+      std::vector<int>& inlier_markers) {
+    last_iter_num = 0;
+
+    // Initially, mark all points as inliers.
+    inlier_markers.clear();
+    inlier_markers.resize(pts1.size(), 1);
+    if (pts1.size() == 0) return;
+
+    // Mark the point pairs with large difference directly.
+    // BTW, the mean distance of the rest of the point pairs
+    // are computed.
+    raw_inlier_idx.clear();
+    double mean_pt_distance = 0.0;
+    const int pt_num = pts1.size();
+    for (int i = 0; i < pt_num; ++i) {
+      const double dx = pts1[i].x - pts2[i].x;
+      const double dy = pts1[i].y - pts2[i].y;
+      const double distance = std::sqrt(dx*dx + dy*dy);
+      // 25 pixel distance is a pretty large tolerance for normal motion.
+      // However, to be used with aggressive motion, this tolerance should
+      // be increased significantly to match the usage.
+      if (distance > 50.0*norm_pixel_unit) {
+        inlier_markers[i] = 0;
+      } else {
+        mean_pt_distance += distance;
+        raw_inlier_idx.push_back(i);
+      }
+    }
+    const int raw_inlier_num = raw_inlier_idx.size();
+    mean_pt_distance /= raw_inlier_num;
+
+    // If the current number of inliers is less than 3, just mark
+    // all input as outliers. This case can happen with fast
+    // rotation where very few features are tracked.
+    if (raw_inlier_num < 3) {
+      for (auto& marker : inlier_markers) marker = 0;
+      return;
+    }
+
+    // Before doing 2-point RANSAC, we have to check if the motion
+    // is degenerated, meaning that there is no translation between
+    // the frames, in which case, the model of the RANSAC does not
+    // work. If so, the distance between the matched points will
+    // be almost 0.
+    if (mean_pt_distance < norm_pixel_unit) {
+      for (const auto& i : raw_inlier_idx) {
+        const double dx = pts1[i].x - pts2[i].x;
+        const double dy = pts1[i].y - pts2[i].y;
+        if (std::sqrt(dx*dx + dy*dy) > inlier_error*norm_pixel_unit)
+          inlier_markers[i] = 0;
+      }
+      return;
+    }
+
+    // In the case of general motion, the RANSAC model can be applied.
+    // The three columns correspond to tx, ty, and tz respectively.
+    // Only the raw inliers are kept so that the scoring of each
+    // hypothesis is a plain vectorized pass over the columns.
+    if (coeff_t.rows() < raw_inlier_num) {
+      coeff_t.resize(raw_inlier_num, 3);
+      error.resize(raw_inlier_num);
+      best_inlier_flags.resize(raw_inlier_num);
+    }
+    for (int k = 0; k < raw_inlier_num; ++k) {
+      const int i = raw_inlier_idx[k];
+      coeff_t(k, 0) = pts1[i].y - pts2[i].y;
+      coeff_t(k, 1) = -(pts1[i].x - pts2[i].x);
+      coeff_t(k, 2) = pts1[i].x*pts2[i].y - pts1[i].y*pts2[i].x;
+    }
+
+    const double error_threshold = inlier_error * norm_pixel_unit;
+    const int min_inlier_num = static_cast<int>(
+        std::ceil(min_inlier_ratio*pts1.size()));
+    int iter_num = iterationNumber(
+        success_probability, initial_inlier_ratio);
+    int best_inlier_num = 0;
+
+    std::uniform_int_distribution<int> first_distr(0, raw_inlier_num-1);
+    std::uniform_int_distribution<int> diff_distr(1, raw_inlier_num-1);
+
+    for (int iter_idx = 0; iter_idx < iter_num; ++iter_idx) {
+      ++last_iter_num;
+
+      // Randomly select two point pairs.
+      // Although this is a weird way of selecting two pairs, but it
+      // is able to efficiently avoid selecting repetitive pairs.
+      const int pair_idx1 = first_distr(random_gen);
+      const int pair_idx_diff = diff_distr(random_gen);
+      const int pair_idx2 = pair_idx1+pair_idx_diff < raw_inlier_num ?
+        pair_idx1+pair_idx_diff : pair_idx1+pair_idx_diff-raw_inlier_num;
+
+      Eigen::Vector3d model;
+      if (!solveModel(pair_idx1, pair_idx2, model)) continue;
+
+      // Score the hypothesis on all the raw inliers.
+      error.head(raw_inlier_num).noalias() =
+        coeff_t.topRows(raw_inlier_num) * model;
+      const int inlier_num = (error.head(raw_inlier_num).array().abs() <
+          error_threshold).count();
+
+      // If the number of inliers is small, the current
+      // model is probably wrong.
+      if (inlier_num < min_inlier_num) continue;
+      if (inlier_num <= best_inlier_num) continue;
+
+      best_inlier_num = inlier_num;
+      best_inlier_flags.head(raw_inlier_num) =
+        error.head(raw_inlier_num).array().abs() < error_threshold;
+
+      // All the raw inliers agree with the model.
+      if (best_inlier_num == raw_inlier_num) break;
+
+      // Shrink the number of iterations based on the
+      // inlier ratio of the best model so far.
+      iter_num = std::min(iter_num, iterationNumber(success_probability,
+            static_cast<double>(best_inlier_num)/raw_inlier_num));
+    }
+
+    // Fill in the markers.
+    std::fill(inlier_markers.begin(), inlier_markers.end(), 0);
+    if (best_inlier_num == 0) return;
+    for (int k = 0; k < raw_inlier_num; ++k) {
+      if (best_inlier_flags(k))
+        inlier_markers[raw_inlier_idx[k]] = 1;
+    }
+
+    return;
+  }
+
+  /*
+   * @brief lastIterationNumber Number of hypotheses
+   *    evaluated in the last call of estimate().
+   */
+  int lastIterationNumber() const {
+    return last_iter_num;
+  }
+
+private:
+
+  /*
+   * @brief iterationNumber Number of iterations needed to
+   *    draw an outlier free pair with the given probability.
+   */
+  static int iterationNumber(
+      const double success_probability,
+      const double inlier_ratio) {
+    const double pair_ratio = inlier_ratio * inlier_ratio;
+    if (pair_ratio >= 1.0) return 1;
+    return std::max(1, static_cast<int>(std::ceil(
+            std::log(1.0-success_probability) / std::log(1.0-pair_ratio))));
+  }
+
+  /*
+   * @brief solveModel Solves the translation direction
+   *    from two point pairs.
+   * @return False if the pairs are degenerated.
+   */
+  bool solveModel(const int idx1, const int idx2,
+      Eigen::Vector3d& model) const {
+    const Eigen::Vector3d row1 = coeff_t.row(idx1).transpose();
+    const Eigen::Vector3d row2 = coeff_t.row(idx2).transpose();
+
+    // Fix the component with the smallest coefficients to 1.
+    Eigen::Vector3d coeff_l1_norm;
+    for (int j = 0; j < 3; ++j)
+      coeff_l1_norm(j) = std::abs(row1(j)) + std::abs(row2(j));
+    int base_indicator = 0;
+    coeff_l1_norm.minCoeff(&base_indicator);
+
+    const int j1 = base_indicator == 0 ? 1 : 0;
+    const int j2 = base_indicator == 2 ? 1 : 2;
+
+    Eigen::Matrix2d A;
+    A << row1(j1), row1(j2),
+         row2(j1), row2(j2);
+    const double det = A.determinant();
+    if (det == 0.0 || !std::isfinite(det)) return false;
+
+    const Eigen::Vector2d solution = A.inverse() *
+      Eigen::Vector2d(-row1(base_indicator), -row2(base_indicator));
+    model(base_indicator) = 1.0;
+    model(j1) = solution(0);
+    model(j2) = solution(1);
+    return true;
+  }
+
+  std::mt19937 random_gen;
+  double initial_inlier_ratio;
+  int last_iter_num;
+
+  // Workspace reused across the calls.
+  std::vector<int> raw_inlier_idx;
+  Eigen::Matrix<double, Eigen::Dynamic, 3> coeff_t;
+  Eigen::VectorXd error;
+  Eigen::Array<bool, Eigen::Dynamic, 1> best_inlier_flags;
+};
+
+} // end namespace msckf_vio
+
+#endif
@@ -10,25 +10,114 @@
 
 #include <ros/ros.h>
 #include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
 #include <opencv2/core/core.hpp>
 #include <Eigen/Geometry>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include "calibration.h"
+#include "profiler.hpp"
 
 namespace msckf_vio {
 /*
  * @brief utilities for msckf_vio
  */
 namespace utils {
-Eigen::Isometry3d getTransformEigen(const ros::NodeHandle &nh,
+
+/*
+ * @brief ParameterReader Reads parameters either from the
+ *    ros parameter server or from a parameter tree loaded
+ *    from yaml files, so that the nodes can also be set up
+ *    without a running roscore.
+ *
+ *    The interface follows the one of ros::NodeHandle.
+ */
+class ParameterReader {
+public:
+  // Read from the parameter server in the namespace of nh.
+  ParameterReader(const ros::NodeHandle &nh);
+  // Read from the given parameter tree.
+  ParameterReader(const XmlRpc::XmlRpcValue &tree);
+
+  bool getParam(const std::string &key, XmlRpc::XmlRpcValue &value) const;
+  bool getParam(const std::string &key, std::string &value) const;
+  bool getParam(const std::string &key, double &value) const;
+  bool getParam(const std::string &key, int &value) const;
+  bool getParam(const std::string &key, bool &value) const;
+  bool getParam(const std::string &key, std::vector<double> &value) const;
+  bool getParam(const std::string &key, std::vector<int> &value) const;
+
+  template <typename T>
+  bool param(const std::string &key, T &value,
+             const T &default_value) const {
+    if (getParam(key, value)) return true;
+    value = default_value;
+    return false;
+  }
+
+  /*
+   * @brief loadYaml Merges the entries of a yaml file into
+   *    a parameter tree, as `rosparam load` would do.
+   * @param filename: the yaml file, e.g. a kalibr calibration.
+   * @param tree: the parameter tree to be extended.
+   * @param ns: if not empty, only the entries under this
+   *    namespace of the file are merged.
+   * @return False if the file cannot be parsed.
+   */
+  static bool loadYaml(const std::string &filename,
+                       XmlRpc::XmlRpcValue &tree,
+                       const std::string &ns = std::string());
+
+private:
+  boost::shared_ptr<ros::NodeHandle> nh_ptr;
+  // Only used if there is no node handle. Lookups do not
+  // modify the tree, but the accessors of XmlRpcValue
+  // are not const.
+  mutable XmlRpc::XmlRpcValue tree;
+};
+
+Eigen::Isometry3d getTransformEigen(const ParameterReader &nh,
                                     const std::string &field);
 
-cv::Mat getTransformCV(const ros::NodeHandle &nh,
+cv::Mat getTransformCV(const ParameterReader &nh,
                        const std::string &field);
 
-cv::Mat getVec16Transform(const ros::NodeHandle &nh,
+cv::Mat getVec16Transform(const ParameterReader &nh,
                           const std::string &field);
 
-cv::Mat getKalibrStyleTransform(const ros::NodeHandle &nh,
+cv::Mat getKalibrStyleTransform(const ParameterReader &nh,
                                 const std::string &field);
+
+/*
+ * @brief loadCalibration Loads the Kalibr calibration of a
+ *    stereo pair and the imu, i.e. cam0, cam1 and T_imu_body.
+ *    Each of them is fetched once from the parameters.
+ * @param left, right: namespaces of the cameras of the pair,
+ *    e.g. cam2 and cam3 for the second pair of a vehicle.
+ *    The right camera should follow the left one in the
+ *    Kalibr camera chain.
+ * @throw std::runtime_error if a transform is missing.
+ */
+StereoCalibrationConstPtr loadCalibration(const ParameterReader &params,
+    const std::string &left = "cam0", const std::string &right = "cam1");
+
+/*
+ * @brief loadCalibration Loads the calibration from a yaml
+ *    file directly, e.g. without a running roscore.
+ * @return Null if the file cannot be parsed.
+ */
+StereoCalibrationConstPtr loadCalibration(const std::string &filename,
+    const std::string &left = "cam0", const std::string &right = "cam1");
+
+/*
+ * @brief getDiagnostics Converts the statistics of the
+ *    stages of a node into one status per stage, with
+ *    the durations in milliseconds.
+ */
+void getDiagnostics(const std::string &node_name,
+                    const std::vector<profiling::StageStatistics> &statistics,
+                    diagnostic_msgs::DiagnosticArray &diagnostics);
 }
 }
 #endif
@@ -0,0 +1,129 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_WORKER_POOL_HPP
+#define MSCKF_VIO_WORKER_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace msckf_vio {
+
+/*
+ * @brief WorkerPool Long-lived worker threads, which run the
+ *    iterations of parallel loops, e.g. the ORB extraction
+ *    of the stereo images and of the cells of each image.
+ *
+ *    The calling thread runs iterations of its own loop as
+ *    well, so that loops can be nested, e.g. from inside an
+ *    iteration of another loop, without a deadlock.
+ */
+class WorkerPool {
+public:
+  typedef std::function<void(size_t)> Task;
+
+  /*
+   * @param thread_num: number of worker threads besides the
+   *    calling ones. With no workers, the loops are serial.
+   */
+  explicit WorkerPool(const size_t thread_num) :
+    is_stopped(false) {
+    threads.reserve(thread_num);
+    for (size_t i = 0; i < thread_num; ++i)
+      threads.emplace_back(&WorkerPool::work, this);
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      is_stopped = true;
+    }
+    work_cv.notify_all();
+    for (auto& thread : threads) thread.join();
+  }
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  size_t threadNumber() const {
+    return threads.size();
+  }
+
+  /*
+   * @brief parallelFor Runs task(i) for i in [0, n), and
+   *    returns once all of them are done.
+   */
+  void parallelFor(const size_t n, const Task& task) {
+    if (n == 0) return;
+    if (threads.empty() || n == 1) {
+      for (size_t i = 0; i < n; ++i) task(i);
+      return;
+    }
+
+    Loop loop(task, n);
+    std::unique_lock<std::mutex> lock(mtx);
+    loops.push_back(&loop);
+    work_cv.notify_all();
+
+    // Run the iterations not taken by the workers, and wait
+    // for the ones which are.
+    while (loop.next < loop.n) runNext(loop, lock);
+    done_cv.wait(lock, [&loop]() { return loop.done == loop.n; });
+  }
+
+private:
+  struct Loop {
+    Loop(const Task& t, const size_t size) :
+      task(t), n(size), next(0), done(0) {}
+    const Task& task;
+    const size_t n;
+    // Guarded by the mutex of the pool.
+    size_t next;
+    size_t done;
+  };
+
+  // Runs the next iteration of the loop with the lock held
+  // before and after, but not during the iteration.
+  void runNext(Loop& loop, std::unique_lock<std::mutex>& lock) {
+    const size_t i = loop.next++;
+    if (loop.next == loop.n)
+      loops.erase(std::find(loops.begin(), loops.end(), &loop));
+
+    lock.unlock();
+    loop.task(i);
+    lock.lock();
+
+    if (++loop.done == loop.n) done_cv.notify_all();
+  }
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+      work_cv.wait(lock, [this]() { return is_stopped || !loops.empty(); });
+      if (loops.empty()) return;
+      runNext(*loops.front(), lock);
+    }
+  }
+
+  std::vector<std::thread> threads;
+
+  std::mutex mtx;
+  std::condition_variable work_cv;
+  std::condition_variable done_cv;
+  // Loops with iterations not taken yet.
+  std::deque<Loop*> loops;
+  bool is_stopped;
+};
+
+} // end namespace msckf_vio
+
+#endif
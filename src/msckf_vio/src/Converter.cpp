@@ -2,12 +2,15 @@
 
 namespace msckf_vio{
 
-    std::vector<cv::Mat> Converter::toDescriptorVector(const cv::Mat &Descriptors)
+    std::vector<cv::Mat> Converter::toDescriptorVector(const DescriptorArena &Descriptors)
     {
+        // Headers pointing into the descriptor memory, with no copy
+        // and no reference counting
         std::vector<cv::Mat> vDesc;
-        vDesc.reserve(Descriptors.rows);
-        for (int j=0;j<Descriptors.rows;j++)
-            vDesc.push_back(Descriptors.row(j));
+        vDesc.reserve(Descriptors.size());
+        for (size_t j=0;j<Descriptors.size();j++)
+            vDesc.push_back(cv::Mat(1, DescriptorArena::DESCRIPTOR_SIZE, CV_8U,
+                const_cast<uint8_t*>(Descriptors[j])));
 
         return vDesc;
     }
@@ -20,7 +20,7 @@ namespace msckf_vio{
         mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
         mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn),  mvuRight(frame.mvuRight),
         mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
-        mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
+        mDescriptors(frame.mDescriptors), mDescriptorsRight(frame.mDescriptorsRight),
         mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
         mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
         mfScaleFactor(frame.mfScaleFactor), mfLogScaleFactor(frame.mfLogScaleFactor),
@@ -36,7 +36,7 @@ namespace msckf_vio{
     }
 
 
-    Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+    Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, WorkerPool* pool)
         :mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(extractorRight), mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
         mpReferenceKF(static_cast<KeyFrame*>(NULL))
     {
@@ -53,10 +53,20 @@ namespace msckf_vio{
         mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
         // ORB extraction
-        thread threadLeft(&Frame::ExtractORB,this,0,imLeft);
-        thread threadRight(&Frame::ExtractORB,this,1,imRight);
-        threadLeft.join();
-        threadRight.join();
+        if(pool)
+        {
+            pool->parallelFor(2, [&](size_t flag)
+            {
+                ExtractORB(flag, flag==0 ? imLeft : imRight);
+            });
+        }
+        else
+        {
+            thread threadLeft(&Frame::ExtractORB,this,0,imLeft);
+            thread threadRight(&Frame::ExtractORB,this,1,imRight);
+            threadLeft.join();
+            threadRight.join();
+        }
 
         N = mvKeys.size();
 
@@ -224,10 +234,19 @@ namespace msckf_vio{
 
     void Frame::ExtractORB(int flag, const cv::Mat &im)
     {
+        // The rows of the extractor output are copied into the
+        // contiguous descriptor storage
+        cv::Mat descriptors;
         if(flag==0)
-            (*mpORBextractorLeft)(im,cv::Mat(),mvKeys,mDescriptors);
+        {
+            (*mpORBextractorLeft)(im,cv::Mat(),mvKeys,descriptors);
+            mDescriptors.assign(descriptors.ptr(), descriptors.rows, descriptors.step);
+        }
         else
-            (*mpORBextractorRight)(im,cv::Mat(),mvKeysRight,mDescriptorsRight);
+        {
+            (*mpORBextractorRight)(im,cv::Mat(),mvKeysRight,descriptors);
+            mDescriptorsRight.assign(descriptors.ptr(), descriptors.rows, descriptors.step);
+        }
     }
 
     void Frame::SetPose(cv::Mat Tcw)
@@ -500,7 +519,7 @@ namespace msckf_vio{
             int bestDist = ORBmatcher::TH_HIGH;
             size_t bestIdxR = 0;
 
-            const cv::Mat &dL = mDescriptors.row(iL);
+            const uint8_t* dL = mDescriptors[iL];
 
             // Compare descriptor to right keypoints
             for(size_t iC=0; iC<vCandidates.size(); iC++)
@@ -515,7 +534,7 @@ namespace msckf_vio{
 
                 if(uR>=minU && uR<=maxU)
                 {
-                    const cv::Mat &dR = mDescriptorsRight.row(iR);
+                    const uint8_t* dR = mDescriptorsRight[iR];
                     const int dist = ORBmatcher::DescriptorDistance(dL,dR);
 
                     if(dist<bestDist)
@@ -1,6 +1,7 @@
 #include <msckf_vio/MapPoint.h>
 #include <mutex>
 #include <msckf_vio/ORBmatcher.h>
+#include <msckf_vio/hamming.hpp>
 
 
 using namespace std;
@@ -19,6 +20,7 @@ namespace msckf_vio{
     {
         Pos.copyTo(mWorldPos);
         mNormalVector = cv::Mat::zeros(3,1,CV_32F);
+        memset(mDescriptor, 0, DescriptorArena::DESCRIPTOR_SIZE);
 
         // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
         unique_lock<mutex> lock(mpMap->mMutexPointCreation);
@@ -45,7 +47,7 @@ namespace msckf_vio{
         mfMaxDistance = dist*levelScaleFactor;
         mfMinDistance = mfMaxDistance/pFrame->mvScaleFactors[nLevels-1];
 
-        pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
+        memcpy(mDescriptor, pFrame->mDescriptors[idxF], DescriptorArena::DESCRIPTOR_SIZE);
 
         // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
         unique_lock<mutex> lock(mpMap->mMutexPointCreation);
@@ -224,7 +226,7 @@ namespace msckf_vio{
     void MapPoint::ComputeDistinctiveDescriptors()
     {
         // Retrieve all observed descriptors
-        vector<cv::Mat> vDescriptors;
+        DescriptorArena vDescriptors;
 
         map<KeyFrame*,size_t> observations;
 
@@ -245,7 +247,7 @@ namespace msckf_vio{
             KeyFrame* pKF = mit->first;
 
             if(!pKF->isBad())
-                vDescriptors.push_back(pKF->mDescriptors.row(mit->second));
+                vDescriptors.push_back(pKF->mDescriptors[mit->second]);
         }
 
         if(vDescriptors.empty())
@@ -254,13 +256,17 @@ namespace msckf_vio{
         // Compute distances between them
         const size_t N = vDescriptors.size();
 
+        // Distances of each descriptor to the following ones, in one batch
         float Distances[N][N];
+        vector<int> vDistij(N);
         for(size_t i=0;i<N;i++)
         {
             Distances[i][i]=0;
+            descriptorDistances(vDescriptors[i], vDescriptors[i]+DescriptorArena::DESCRIPTOR_SIZE, N-i-1,
+                DescriptorArena::DESCRIPTOR_SIZE, &vDistij[0]);
             for(size_t j=i+1;j<N;j++)
             {
-                int distij = ORBmatcher::DescriptorDistance(vDescriptors[i],vDescriptors[j]);
+                int distij = vDistij[j-i-1];
                 Distances[i][j]=distij;
                 Distances[j][i]=distij;
             }
@@ -284,14 +290,14 @@ namespace msckf_vio{
 
         {
             unique_lock<mutex> lock(mMutexFeatures);
-            mDescriptor = vDescriptors[BestIdx].clone();
+            memcpy(mDescriptor, vDescriptors[BestIdx], DescriptorArena::DESCRIPTOR_SIZE);
         }
     }
 
-    cv::Mat MapPoint::GetDescriptor()
+    void MapPoint::GetDescriptor(uint8_t* desc)
     {
         unique_lock<mutex> lock(mMutexFeatures);
-        return mDescriptor.clone();
+        memcpy(desc, mDescriptor, DescriptorArena::DESCRIPTOR_SIZE);
     }
 
     int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
@@ -17,31 +17,14 @@ namespace msckf_vio{
     const int HALF_PATCH_SIZE = 15;
     const int EDGE_THRESHOLD = 19;
 
-    static float IC_Angle(const Mat& image, Point2f pt,  const vector<int> & u_max)
+    static float IC_Angle(const Mat& image, Point2f pt, const PatchMoments& moments)
     {
         int m_01 = 0, m_10 = 0;
 
         const uchar* center = &image.at<uchar> (cvRound(pt.y), cvRound(pt.x));
 
-        // Treat the center line differently, v=0
-        for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u)
-            m_10 += u * center[u];
-
-        // Go line by line in the circuI853lar patch
-        int step = (int)image.step1();
-        for (int v = 1; v <= HALF_PATCH_SIZE; ++v)
-        {
-            // Proceed over the two lines
-            int v_sum = 0;
-            int d = u_max[v];
-            for (int u = -d; u <= d; ++u)
-            {
-                int val_plus = center[u + v*step], val_minus = center[u - v*step];
-                v_sum += (val_plus - val_minus);
-                m_10 += u * (val_plus + val_minus);
-            }
-            m_01 += v * v_sum;
-        }
+        // Intensity moments of the circular patch, see orb_kernels.hpp
+        moments(center, (int)image.step1(), m_01, m_10);
 
         return fastAtan2((float)m_01, (float)m_10);
     }
@@ -58,35 +41,8 @@ namespace msckf_vio{
         const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
         const int step = (int)img.step;
 
-        #define GET_VALUE(idx) \
-            center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
-                cvRound(pattern[idx].x*a - pattern[idx].y*b)]
-
-
-        for (int i = 0; i < 32; ++i, pattern += 16)
-        {
-            int t0, t1, val;
-            t0 = GET_VALUE(0); t1 = GET_VALUE(1);
-            val = t0 < t1;
-            t0 = GET_VALUE(2); t1 = GET_VALUE(3);
-            val |= (t0 < t1) << 1;
-            t0 = GET_VALUE(4); t1 = GET_VALUE(5);
-            val |= (t0 < t1) << 2;
-            t0 = GET_VALUE(6); t1 = GET_VALUE(7);
-            val |= (t0 < t1) << 3;
-            t0 = GET_VALUE(8); t1 = GET_VALUE(9);
-            val |= (t0 < t1) << 4;
-            t0 = GET_VALUE(10); t1 = GET_VALUE(11);
-            val |= (t0 < t1) << 5;
-            t0 = GET_VALUE(12); t1 = GET_VALUE(13);
-            val |= (t0 < t1) << 6;
-            t0 = GET_VALUE(14); t1 = GET_VALUE(15);
-            val |= (t0 < t1) << 7;
-
-            desc[i] = (uchar)val;
-        }
-
-        #undef GET_VALUE
+        // 256 intensity tests of the rotated pattern, see orb_kernels.hpp
+        computeBriefDescriptor(center, step, a, b, &pattern->x, desc);
     }
 
     static int bit_pattern_31_[256*4] =
@@ -349,19 +305,19 @@ namespace msckf_vio{
         -1,-6, 0,-11/*mean (0.127148), correlation (0.547401)*/
     };
 
-    static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, const vector<int>& umax)
+    static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, const PatchMoments& moments)
     {
         for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
             keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
         {
-            keypoint->angle = IC_Angle(image, keypoint->pt, umax);
+            keypoint->angle = IC_Angle(image, keypoint->pt, moments);
         }
     }
 
     ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
          int _iniThFAST, int _minThFAST):
         nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
-        iniThFAST(_iniThFAST), minThFAST(_minThFAST)
+        iniThFAST(_iniThFAST), minThFAST(_minThFAST), mpWorkerPool(NULL)
     {
          mvScaleFactor.resize(nlevels);
         mvLevelSigma2.resize(nlevels);
@@ -382,6 +338,8 @@ namespace msckf_vio{
         }
 
         mvImagePyramid.resize(nlevels);
+        mvPyramidBuffers.resize(nlevels);
+        mvBlurredPyramid.resize(nlevels);
 
         mnFeaturesPerLevel.resize(nlevels);
         float factor = 1.0f / scaleFactor;
@@ -418,6 +376,7 @@ namespace msckf_vio{
             umax[v] = v0;
             ++v0;
         }
+        mPatchMoments = PatchMoments(umax);
     }
 
     void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4)
@@ -711,7 +670,10 @@ namespace msckf_vio{
             float scale = mvInvScaleFactor[level];
             Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
             Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
-            Mat temp(wholeSize, image.type()), masktemp;
+            // The padded buffers are reused across frames, and only
+            // reallocated when the image size changes
+            Mat& temp = mvPyramidBuffers[level];
+            temp.create(wholeSize, image.type());
             mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
 
             // Compute the resized image
@@ -727,97 +689,128 @@ namespace msckf_vio{
                 copyMakeBorder(image, temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
                             BORDER_REFLECT_101);            
             }
+
+            // Blur the level for the descriptors while it is still in cache.
+            // BORDER_ISOLATED gives the same result as blurring the level alone
+            GaussianBlur(mvImagePyramid[level], mvBlurredPyramid[level], Size(7, 7), 2, 2,
+                        BORDER_REFLECT_101+BORDER_ISOLATED);
         }
     }
 
+    void ORBextractor::ForEachLevel(const WorkerPool::Task& task)
+    {
+        if(mpWorkerPool)
+            mpWorkerPool->parallelFor(nlevels, task);
+        else
+            for (int level = 0; level < nlevels; ++level)
+                task(level);
+    }
+
     void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint>>& allKeypoints)
     {
         allKeypoints.resize(nlevels);
 
+        // The levels are independent once the pyramid is built.
+        ForEachLevel([&](size_t level)
+        {
+            ComputeKeyPointsLevel(level, allKeypoints[level]);
+        });
+    }
+
+    void ORBextractor::ComputeKeyPointsLevel(const int level, vector<KeyPoint>& keypoints)
+    {
         const float W = 30;
 
-        for (int level = 0; level < nlevels; ++level)
-        {
-            const int minBorderX = EDGE_THRESHOLD-3;
-            const int minBorderY = minBorderX;
-            const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
-            const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+        const int minBorderX = EDGE_THRESHOLD-3;
+        const int minBorderY = minBorderX;
+        const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+        const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
 
-            vector<cv::KeyPoint> vToDistributeKeys;
-            vToDistributeKeys.reserve(nfeatures*10);
+        vector<cv::KeyPoint> vToDistributeKeys;
+        vToDistributeKeys.reserve(nfeatures*10);
 
-            const float width = (maxBorderX-minBorderX);
-            const float height = (maxBorderY-minBorderY);
+        const float width = (maxBorderX-minBorderX);
+        const float height = (maxBorderY-minBorderY);
 
-            const int nCols = width/W;
-            const int nRows = height/W;
-            const int wCell = ceil(width/nCols);
-            const int hCell = ceil(height/nRows);
+        const int nCols = width/W;
+        const int nRows = height/W;
+        const int wCell = ceil(width/nCols);
+        const int hCell = ceil(height/nRows);
 
-            for(int i=0; i<nRows; i++)
-            {
-                const float iniY =minBorderY+i*hCell;
-                float maxY = iniY+hCell+6;
+        // The rows of cells are detected by the workers, and
+        // merged in the order of the serial detection.
+        vector<vector<cv::KeyPoint> > vRowKeys(nRows);
+        const WorkerPool::Task detectRow = [&](size_t row)
+        {
+            const int i = row;
+            const float iniY =minBorderY+i*hCell;
+            float maxY = iniY+hCell+6;
 
-                if(iniY>=maxBorderY-3)
+            if(iniY>=maxBorderY-3)
+                return;
+            if(maxY>maxBorderY)
+                maxY = maxBorderY;
+
+            for(int j=0; j<nCols; j++)
+            {
+                const float iniX =minBorderX+j*wCell;
+                float maxX = iniX+wCell+6;
+                if(iniX>=maxBorderX-6)
                     continue;
-                if(maxY>maxBorderY)
-                    maxY = maxBorderY;
+                if(maxX>maxBorderX)
+                    maxX = maxBorderX;
+
+                vector<cv::KeyPoint> vKeysCell;
+                FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+                    vKeysCell,iniThFAST,true);
 
-                for(int j=0; j<nCols; j++)
+                if(vKeysCell.empty())
                 {
-                    const float iniX =minBorderX+j*wCell;
-                    float maxX = iniX+wCell+6;
-                    if(iniX>=maxBorderX-6)
-                        continue;
-                    if(maxX>maxBorderX)
-                        maxX = maxBorderX;
-
-                    vector<cv::KeyPoint> vKeysCell;
                     FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                        vKeysCell,iniThFAST,true);
-
-                    if(vKeysCell.empty())
-                    {
-                        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                            vKeysCell,minThFAST,true);
-                    }
+                        vKeysCell,minThFAST,true);
+                }
 
-                    if(!vKeysCell.empty())
+                if(!vKeysCell.empty())
+                {
+                    for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
                     {
-                        for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
-                        {
-                            (*vit).pt.x+=j*wCell;
-                            (*vit).pt.y+=i*hCell;
-                            vToDistributeKeys.push_back(*vit);
-                        }
+                        (*vit).pt.x+=j*wCell;
+                        (*vit).pt.y+=i*hCell;
+                        vRowKeys[row].push_back(*vit);
                     }
-
                 }
+
             }
+        };
 
-            vector<KeyPoint> & keypoints = allKeypoints[level];
-            keypoints.reserve(nfeatures);
+        if(mpWorkerPool)
+            mpWorkerPool->parallelFor(nRows, detectRow);
+        else
+            for(int i=0; i<nRows; i++)
+                detectRow(i);
 
-            keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
-                                        minBorderY, maxBorderY,mnFeaturesPerLevel[level], level);
+        for(int i=0; i<nRows; i++)
+            vToDistributeKeys.insert(vToDistributeKeys.end(), vRowKeys[i].begin(), vRowKeys[i].end());
 
-            const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+        keypoints.reserve(nfeatures);
 
-            // Add border to coordinates and scale information
-            const int nkps = keypoints.size();
-            for(int i=0; i<nkps ; i++)
-            {
-                keypoints[i].pt.x+=minBorderX;
-                keypoints[i].pt.y+=minBorderY;
-                keypoints[i].octave=level;
-                keypoints[i].size = scaledPatchSize;
-            }
+        keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
+                                    minBorderY, maxBorderY,mnFeaturesPerLevel[level], level);
+
+        const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+
+        // Add border to coordinates and scale information
+        const int nkps = keypoints.size();
+        for(int i=0; i<nkps ; i++)
+        {
+            keypoints[i].pt.x+=minBorderX;
+            keypoints[i].pt.y+=minBorderY;
+            keypoints[i].octave=level;
+            keypoints[i].size = scaledPatchSize;
         }
 
         // compute orientations
-        for (int level = 0; level < nlevels; ++level)
-            computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+        computeOrientation(mvImagePyramid[level], keypoints, mPatchMoments);
     }
 
     static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Mat& descriptors,
@@ -841,15 +834,20 @@ namespace msckf_vio{
         // Pre-compute the scale pyramid
         ComputePyramid(image);
 
+        // The detection, distribution and orientation of the
+        // keypoints of each level are a task of their own.
         vector < vector<KeyPoint> > allKeypoints;
         ComputeKeyPointsOctTree(allKeypoints);
         //ComputeKeyPointsOld(allKeypoints);
 
         Mat descriptors;
 
-        int nkeypoints = 0;
+        // Each level is written to its own slice of the outputs,
+        // which are in the order of the levels as before.
+        vector<int> vLevelOffsets(nlevels+1, 0);
         for (int level = 0; level < nlevels; ++level)
-            nkeypoints += (int)allKeypoints[level].size();
+            vLevelOffsets[level+1] = vLevelOffsets[level] + (int)allKeypoints[level].size();
+        const int nkeypoints = vLevelOffsets[nlevels];
         if( nkeypoints == 0 )
             _descriptors.release();
         else
@@ -859,26 +857,21 @@ namespace msckf_vio{
         }
 
         _keypoints.clear();
-        _keypoints.reserve(nkeypoints);
+        _keypoints.resize(nkeypoints);
 
-        int offset = 0;
-        for (int level = 0; level < nlevels; ++level)
+        // The descriptors of each level are a task of their own
+        // as well.
+        ForEachLevel([&](size_t level)
         {
             vector<KeyPoint>& keypoints = allKeypoints[level];
             int nkeypointsLevel = (int)keypoints.size();
 
             if(nkeypointsLevel==0)
-                continue;
+                return;
 
-            // preprocess the resized image
-            Mat workingMat = mvImagePyramid[level].clone();
-            GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
-
-            // Compute the descriptors
-            Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-            computeDescriptors(workingMat, keypoints, desc, pattern);
-
-            offset += nkeypointsLevel;
+            // Compute the descriptors on the blurred level
+            Mat desc = descriptors.rowRange(vLevelOffsets[level], vLevelOffsets[level+1]);
+            computeDescriptors(mvBlurredPyramid[level], keypoints, desc, pattern);
 
             // Scale keypoint coordinates
             if (level != 0)
@@ -889,8 +882,8 @@ namespace msckf_vio{
                     keypoint->pt *= scale;
             }
             // And add the keypoints to the output
-            _keypoints.insert(_keypoints.end(), keypoints.begin(), keypoints.end());
-        }
+            std::copy(keypoints.begin(), keypoints.end(), _keypoints.begin()+vLevelOffsets[level]);
+        });
     }
 
 }
\ No newline at end of file
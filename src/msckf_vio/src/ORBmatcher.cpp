@@ -9,6 +9,8 @@
 
 #include <stdint-gcc.h>
 
+#include <msckf_vio/hamming.hpp>
+
 using namespace std;
 
 namespace msckf_vio{
@@ -49,7 +51,8 @@ namespace msckf_vio{
             if(vIndices.empty())
                 continue;
 
-            const cv::Mat MPdescriptor = pMP->GetDescriptor();
+            uint8_t MPdescriptor[DescriptorArena::DESCRIPTOR_SIZE];
+            pMP->GetDescriptor(MPdescriptor);
 
             int bestDist=256;
             int bestLevel= -1;
@@ -73,7 +76,7 @@ namespace msckf_vio{
                         continue;
                 }
 
-                const cv::Mat &d = F.mDescriptors.row(idx);
+                const uint8_t* d = F.mDescriptors[idx];
 
                 const int dist = DescriptorDistance(MPdescriptor,d);
 
@@ -174,7 +177,7 @@ namespace msckf_vio{
                     if(pMP->isBad())
                         continue;                
 
-                    const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);
+                    const uint8_t* dKF = pKF->mDescriptors[realIdxKF];
 
                     int bestDist1=256;
                     int bestIdxF =-1 ;
@@ -187,7 +190,7 @@ namespace msckf_vio{
                         if(vpMapPointMatches[realIdxF])
                             continue;
 
-                        const cv::Mat &dF = F.mDescriptors.row(realIdxF);
+                        const uint8_t* dF = F.mDescriptors[realIdxF];
 
                         const int dist =  DescriptorDistance(dKF,dF);
 
@@ -343,7 +346,8 @@ namespace msckf_vio{
                 continue;
 
             // Match to the most similar keypoint in the radius
-            const cv::Mat dMP = pMP->GetDescriptor();
+            uint8_t dMP[DescriptorArena::DESCRIPTOR_SIZE];
+            pMP->GetDescriptor(dMP);
 
             int bestDist = 256;
             int bestIdx = -1;
@@ -358,7 +362,7 @@ namespace msckf_vio{
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+                const uint8_t* dKF = pKF->mDescriptors[idx];
 
                 const int dist = DescriptorDistance(dMP,dKF);
 
@@ -405,7 +409,7 @@ namespace msckf_vio{
             if(vIndices2.empty())
                 continue;
 
-            cv::Mat d1 = F1.mDescriptors.row(i1);
+            const uint8_t* d1 = F1.mDescriptors[i1];
 
             int bestDist = INT_MAX;
             int bestDist2 = INT_MAX;
@@ -415,7 +419,7 @@ namespace msckf_vio{
             {
                 size_t i2 = *vit;
 
-                cv::Mat d2 = F2.mDescriptors.row(i2);
+                const uint8_t* d2 = F2.mDescriptors[i2];
 
                 int dist = DescriptorDistance(d1,d2);
 
@@ -502,12 +506,12 @@ namespace msckf_vio{
         const vector<cv::KeyPoint> &vKeysUn1 = pKF1->mvKeysUn;
         const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
         const vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
-        const cv::Mat &Descriptors1 = pKF1->mDescriptors;
+        const DescriptorArena &Descriptors1 = pKF1->mDescriptors;
 
         const vector<cv::KeyPoint> &vKeysUn2 = pKF2->mvKeysUn;
         const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
         const vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
-        const cv::Mat &Descriptors2 = pKF2->mDescriptors;
+        const DescriptorArena &Descriptors2 = pKF2->mDescriptors;
 
         vpMatches12 = vector<MapPoint*>(vpMapPoints1.size(),static_cast<MapPoint*>(NULL));
         vector<bool> vbMatched2(vpMapPoints2.size(),false);
@@ -539,7 +543,7 @@ namespace msckf_vio{
                     if(pMP1->isBad())
                         continue;
 
-                    const cv::Mat &d1 = Descriptors1.row(idx1);
+                    const uint8_t* d1 = Descriptors1[idx1];
 
                     int bestDist1=256;
                     int bestIdx2 =-1 ;
@@ -557,7 +561,7 @@ namespace msckf_vio{
                         if(pMP2->isBad())
                             continue;
 
-                        const cv::Mat &d2 = Descriptors2.row(idx2);
+                        const uint8_t* d2 = Descriptors2[idx2];
 
                         int dist = DescriptorDistance(d1,d2);
 
@@ -688,7 +692,7 @@ namespace msckf_vio{
                     
                     const cv::KeyPoint &kp1 = pKF1->mvKeysUn[idx1];
                     
-                    const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
+                    const uint8_t* d1 = pKF1->mDescriptors[idx1];
                     
                     int bestDist = TH_LOW;
                     int bestIdx2 = -1;
@@ -709,7 +713,7 @@ namespace msckf_vio{
                             if(!bStereo2)
                                 continue;
                         
-                        const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
+                        const uint8_t* d2 = pKF2->mDescriptors[idx2];
                         
                         const int dist = DescriptorDistance(d1,d2);
                         
@@ -874,7 +878,8 @@ namespace msckf_vio{
 
             // Match to the most similar keypoint in the radius
 
-            const cv::Mat dMP = pMP->GetDescriptor();
+            uint8_t dMP[DescriptorArena::DESCRIPTOR_SIZE];
+            pMP->GetDescriptor(dMP);
 
             int bestDist = 256;
             int bestIdx = -1;
@@ -915,7 +920,7 @@ namespace msckf_vio{
                         continue;
                 }
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+                const uint8_t* dKF = pKF->mDescriptors[idx];
 
                 const int dist = DescriptorDistance(dMP,dKF);
 
@@ -1033,7 +1038,8 @@ namespace msckf_vio{
 
             // Match to the most similar keypoint in the radius
 
-            const cv::Mat dMP = pMP->GetDescriptor();
+            uint8_t dMP[DescriptorArena::DESCRIPTOR_SIZE];
+            pMP->GetDescriptor(dMP);
 
             int bestDist = INT_MAX;
             int bestIdx = -1;
@@ -1045,7 +1051,7 @@ namespace msckf_vio{
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+                const uint8_t* dKF = pKF->mDescriptors[idx];
 
                 int dist = DescriptorDistance(dMP,dKF);
 
@@ -1173,7 +1179,8 @@ namespace msckf_vio{
                 continue;
 
             // Match to the most similar keypoint in the radius
-            const cv::Mat dMP = pMP->GetDescriptor();
+            uint8_t dMP[DescriptorArena::DESCRIPTOR_SIZE];
+            pMP->GetDescriptor(dMP);
 
             int bestDist = INT_MAX;
             int bestIdx = -1;
@@ -1186,7 +1193,7 @@ namespace msckf_vio{
                 if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
+                const uint8_t* dKF = pKF2->mDescriptors[idx];
 
                 const int dist = DescriptorDistance(dMP,dKF);
 
@@ -1253,7 +1260,8 @@ namespace msckf_vio{
                 continue;
 
             // Match to the most similar keypoint in the radius
-            const cv::Mat dMP = pMP->GetDescriptor();
+            uint8_t dMP[DescriptorArena::DESCRIPTOR_SIZE];
+            pMP->GetDescriptor(dMP);
 
             int bestDist = INT_MAX;
             int bestIdx = -1;
@@ -1266,7 +1274,7 @@ namespace msckf_vio{
                 if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
+                const uint8_t* dKF = pKF1->mDescriptors[idx];
 
                 const int dist = DescriptorDistance(dMP,dKF);
 
@@ -1371,7 +1379,8 @@ namespace msckf_vio{
                     if(vIndices2.empty())
                         continue;
 
-                    const cv::Mat dMP = pMP->GetDescriptor();
+                    uint8_t dMP[DescriptorArena::DESCRIPTOR_SIZE];
+                    pMP->GetDescriptor(dMP);
 
                     int bestDist = 256;
                     int bestIdx2 = -1;
@@ -1391,7 +1400,7 @@ namespace msckf_vio{
                                 continue;
                         }
 
-                        const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+                        const uint8_t* d = CurrentFrame.mDescriptors[i2];
 
                         const int dist = DescriptorDistance(dMP,d);
 
@@ -1509,7 +1518,8 @@ namespace msckf_vio{
                     if(vIndices2.empty())
                         continue;
 
-                    const cv::Mat dMP = pMP->GetDescriptor();
+                    uint8_t dMP[DescriptorArena::DESCRIPTOR_SIZE];
+                    pMP->GetDescriptor(dMP);
 
                     int bestDist = 256;
                     int bestIdx2 = -1;
@@ -1520,7 +1530,7 @@ namespace msckf_vio{
                         if(CurrentFrame.mvpMapPoints[i2])
                             continue;
 
-                        const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+                        const uint8_t* d = CurrentFrame.mDescriptors[i2];
 
                         const int dist = DescriptorDistance(dMP,d);
 
@@ -1621,23 +1631,9 @@ namespace msckf_vio{
     }
 
 
-    // Bit set count operation from
-    // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-    int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
+    // Hamming distance of two 256 bit descriptors, see hamming.hpp
+    int ORBmatcher::DescriptorDistance(const uint8_t* a, const uint8_t* b)
     {
-        const int *pa = a.ptr<int32_t>();
-        const int *pb = b.ptr<int32_t>();
-
-        int dist=0;
-
-        for(int i=0; i<8; i++, pa++, pb++)
-        {
-            unsigned  int v = *pa ^ *pb;
-            v = v - ((v >> 1) & 0x55555555);
-            v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-            dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-        }
-
-        return dist;
+        return descriptorDistance(a, b);
     }
 }
\ No newline at end of file
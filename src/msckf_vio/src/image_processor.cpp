@@ -11,9 +11,7 @@
 #include <Eigen/Dense>
 
 #include <sensor_msgs/image_encodings.h>
-#include <random_numbers/random_numbers.h>
 
-#include <msckf_vio/CameraMeasurement.h>
 #include <msckf_vio/TrackingInfo.h>
 #include <msckf_vio/image_processor.h>
 #include <msckf_vio/utils.h>
@@ -24,8 +22,10 @@ using namespace Eigen;
 
 namespace msckf_vio {
 ImageProcessor::ImageProcessor(ros::NodeHandle& n) :
-  nh(n),
+  nh_ptr(new ros::NodeHandle(n)),
+  param_reader(n),
   is_first_img(true),
+  next_feature_id(0),
   //img_transport(n),
   stereo_sub(10),
   prev_features_ptr(new GridFeatures()),
@@ -34,120 +34,113 @@ ImageProcessor::ImageProcessor(ros::NodeHandle& n) :
   return;
 }
 
+ImageProcessor::ImageProcessor(const utils::ParameterReader& params) :
+  param_reader(params),
+  is_first_img(true),
+  next_feature_id(0),
+  stereo_sub(10),
+  prev_features_ptr(new GridFeatures()),
+  curr_features_ptr(new GridFeatures())
+{
+  return;
+}
+
 ImageProcessor::~ImageProcessor() {
   destroyAllWindows();
-  //ROS_INFO("Feature lifetime statistics:");
-  //featureLifetimeStatistics();
   return;
 }
 
 bool ImageProcessor::loadParameters() {
-  // Camera calibration parameters
-  nh.param<string>("cam0/distortion_model",
-      cam0_distortion_model, string("radtan"));
-  nh.param<string>("cam1/distortion_model",
-      cam1_distortion_model, string("radtan"));
-
-  vector<int> cam0_resolution_temp(2);
-  nh.getParam("cam0/resolution", cam0_resolution_temp);
-  cam0_resolution[0] = cam0_resolution_temp[0];
-  cam0_resolution[1] = cam0_resolution_temp[1];
-
-  vector<int> cam1_resolution_temp(2);
-  nh.getParam("cam1/resolution", cam1_resolution_temp);
-  cam1_resolution[0] = cam1_resolution_temp[0];
-  cam1_resolution[1] = cam1_resolution_temp[1];
-
-  vector<double> cam0_intrinsics_temp(4);
-  nh.getParam("cam0/intrinsics", cam0_intrinsics_temp);
-  cam0_intrinsics[0] = cam0_intrinsics_temp[0];
-  cam0_intrinsics[1] = cam0_intrinsics_temp[1];
-  cam0_intrinsics[2] = cam0_intrinsics_temp[2];
-  cam0_intrinsics[3] = cam0_intrinsics_temp[3];
-
-  vector<double> cam1_intrinsics_temp(4);
-  nh.getParam("cam1/intrinsics", cam1_intrinsics_temp);
-  cam1_intrinsics[0] = cam1_intrinsics_temp[0];
-  cam1_intrinsics[1] = cam1_intrinsics_temp[1];
-  cam1_intrinsics[2] = cam1_intrinsics_temp[2];
-  cam1_intrinsics[3] = cam1_intrinsics_temp[3];
-
-  vector<double> cam0_distortion_coeffs_temp(4);
-  nh.getParam("cam0/distortion_coeffs",
-      cam0_distortion_coeffs_temp);
-  cam0_distortion_coeffs[0] = cam0_distortion_coeffs_temp[0];
-  cam0_distortion_coeffs[1] = cam0_distortion_coeffs_temp[1];
-  cam0_distortion_coeffs[2] = cam0_distortion_coeffs_temp[2];
-  cam0_distortion_coeffs[3] = cam0_distortion_coeffs_temp[3];
-
-  vector<double> cam1_distortion_coeffs_temp(4);
-  nh.getParam("cam1/distortion_coeffs",
-      cam1_distortion_coeffs_temp);
-  cam1_distortion_coeffs[0] = cam1_distortion_coeffs_temp[0];
-  cam1_distortion_coeffs[1] = cam1_distortion_coeffs_temp[1];
-  cam1_distortion_coeffs[2] = cam1_distortion_coeffs_temp[2];
-  cam1_distortion_coeffs[3] = cam1_distortion_coeffs_temp[3];
-
-  cv::Mat     T_imu_cam0 = utils::getTransformCV(nh, "cam0/T_cam_imu");
-  cv::Matx33d R_imu_cam0(T_imu_cam0(cv::Rect(0,0,3,3)));
-  cv::Vec3d   t_imu_cam0 = T_imu_cam0(cv::Rect(3,0,1,3));
-  R_cam0_imu = R_imu_cam0.t();
-  t_cam0_imu = -R_imu_cam0.t() * t_imu_cam0;
-
-  cv::Mat T_cam0_cam1 = utils::getTransformCV(nh, "cam1/T_cn_cnm1");
-  cv::Mat T_imu_cam1 = T_cam0_cam1 * T_imu_cam0;
-  cv::Matx33d R_imu_cam1(T_imu_cam1(cv::Rect(0,0,3,3)));
-  cv::Vec3d   t_imu_cam1 = T_imu_cam1(cv::Rect(3,0,1,3));
-  R_cam1_imu = R_imu_cam1.t();
-  t_cam1_imu = -R_imu_cam1.t() * t_imu_cam1;
+  // The stereo pair of the camera chain used by the filter.
+  param_reader.param<string>("camera_pair/left",
+      processor_config.left_camera, string("cam0"));
+  param_reader.param<string>("camera_pair/right",
+      processor_config.right_camera, string("cam1"));
+
+  // Camera calibration parameters, unless shared by the caller.
+  if (!calibration)
+    calibration = utils::loadCalibration(param_reader,
+        processor_config.left_camera, processor_config.right_camera);
+
+  const Eigen::Isometry3d T_cam0_imu =
+    calibration->T_imu_cam0.inverse();
+  const Eigen::Isometry3d T_cam1_imu =
+    (calibration->T_cam0_cam1 * calibration->T_imu_cam0).inverse();
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      R_cam0_imu(i, j) = T_cam0_imu.linear()(i, j);
+      R_cam1_imu(i, j) = T_cam1_imu.linear()(i, j);
+    }
+    t_cam0_imu[i] = T_cam0_imu.translation()(i);
+    t_cam1_imu[i] = T_cam1_imu.translation()(i);
+  }
 
   // Processor parameters
-  nh.param<int>("grid_row", processor_config.grid_row, 4);
-  nh.param<int>("grid_col", processor_config.grid_col, 4);
-  nh.param<int>("grid_min_feature_num",
+  param_reader.param<int>("grid_row", processor_config.grid_row, 4);
+  param_reader.param<int>("grid_col", processor_config.grid_col, 4);
+  param_reader.param<int>("grid_min_feature_num",
       processor_config.grid_min_feature_num, 2);
-  nh.param<int>("grid_max_feature_num",
+  param_reader.param<int>("grid_max_feature_num",
       processor_config.grid_max_feature_num, 4);
-  nh.param<int>("pyramid_levels",
+  param_reader.param<int>("pyramid_levels",
       processor_config.pyramid_levels, 3);
-  nh.param<int>("patch_size",
+  param_reader.param<int>("patch_size",
       processor_config.patch_size, 31);
-  nh.param<int>("fast_threshold",
+  param_reader.param<int>("fast_threshold",
       processor_config.fast_threshold, 20);
-  nh.param<int>("max_iteration",
+  param_reader.param<int>("max_iteration",
       processor_config.max_iteration, 30);
-  nh.param<double>("track_precision",
+  param_reader.param<double>("track_precision",
       processor_config.track_precision, 0.01);
-  nh.param<double>("ransac_threshold",
+  param_reader.param<double>("ransac_threshold",
       processor_config.ransac_threshold, 3);
-  nh.param<double>("stereo_threshold",
+  param_reader.param<double>("stereo_threshold",
       processor_config.stereo_threshold, 3);
+  param_reader.param<bool>("undistortion_lut",
+      processor_config.undistortion_lut, false);
+  param_reader.param<bool>("adaptive_tracking",
+      processor_config.adaptive_tracking, false);
+  param_reader.param<double>("track_error_threshold",
+      processor_config.track_error_threshold, 10.0);
+  param_reader.param<bool>("stereo_prior",
+      processor_config.stereo_prior, false);
+
+  // Chrome trace of the stages of the front end, disabled if empty.
+  string trace_file;
+  param_reader.param<string>("profiling/trace_file", trace_file, string(""));
+  if (!trace_file.empty() && !profiler.openTrace(trace_file))
+    ROS_WARN("Cannot open the trace file %s", trace_file.c_str());
 
   ROS_INFO("===========================================");
   ROS_INFO("cam0_resolution: %d, %d",
-      cam0_resolution[0], cam0_resolution[1]);
+      calibration->cam0.resolution[0], calibration->cam0.resolution[1]);
   ROS_INFO("cam0_intrinscs: %f, %f, %f, %f",
-      cam0_intrinsics[0], cam0_intrinsics[1],
-      cam0_intrinsics[2], cam0_intrinsics[3]);
+      calibration->cam0.intrinsics[0], calibration->cam0.intrinsics[1],
+      calibration->cam0.intrinsics[2], calibration->cam0.intrinsics[3]);
   ROS_INFO("cam0_distortion_model: %s",
-      cam0_distortion_model.c_str());
+      calibration->cam0.distortion_model.c_str());
   ROS_INFO("cam0_distortion_coefficients: %f, %f, %f, %f",
-      cam0_distortion_coeffs[0], cam0_distortion_coeffs[1],
-      cam0_distortion_coeffs[2], cam0_distortion_coeffs[3]);
+      calibration->cam0.distortion_coeffs[0],
+      calibration->cam0.distortion_coeffs[1],
+      calibration->cam0.distortion_coeffs[2],
+      calibration->cam0.distortion_coeffs[3]);
 
   ROS_INFO("cam1_resolution: %d, %d",
-      cam1_resolution[0], cam1_resolution[1]);
+      calibration->cam1.resolution[0], calibration->cam1.resolution[1]);
   ROS_INFO("cam1_intrinscs: %f, %f, %f, %f",
-      cam1_intrinsics[0], cam1_intrinsics[1],
-      cam1_intrinsics[2], cam1_intrinsics[3]);
+      calibration->cam1.intrinsics[0], calibration->cam1.intrinsics[1],
+      calibration->cam1.intrinsics[2], calibration->cam1.intrinsics[3]);
   ROS_INFO("cam1_distortion_model: %s",
-      cam1_distortion_model.c_str());
+      calibration->cam1.distortion_model.c_str());
   ROS_INFO("cam1_distortion_coefficients: %f, %f, %f, %f",
-      cam1_distortion_coeffs[0], cam1_distortion_coeffs[1],
-      cam1_distortion_coeffs[2], cam1_distortion_coeffs[3]);
+      calibration->cam1.distortion_coeffs[0],
+      calibration->cam1.distortion_coeffs[1],
+      calibration->cam1.distortion_coeffs[2],
+      calibration->cam1.distortion_coeffs[3]);
 
-  cout << R_imu_cam0 << endl;
-  cout << t_imu_cam0.t() << endl;
+  ROS_INFO_STREAM("R_imu_cam0:\n" << calibration->T_imu_cam0.linear());
+  ROS_INFO_STREAM("t_imu_cam0: " <<
+      calibration->T_imu_cam0.translation().transpose());
 
   ROS_INFO("grid_row: %d",
       processor_config.grid_row);
@@ -171,12 +164,25 @@ bool ImageProcessor::loadParameters() {
       processor_config.ransac_threshold);
   ROS_INFO("stereo_threshold: %f",
       processor_config.stereo_threshold);
+  ROS_INFO("undistortion_lut: %d",
+      processor_config.undistortion_lut);
+  ROS_INFO("adaptive_tracking: %d",
+      processor_config.adaptive_tracking);
+  ROS_INFO("track_error_threshold: %f",
+      processor_config.track_error_threshold);
+  ROS_INFO("stereo_prior: %d",
+      processor_config.stereo_prior);
+  ROS_INFO("trace file: %s", trace_file.c_str());
+  ROS_INFO("camera pair: %s, %s",
+      processor_config.left_camera.c_str(),
+      processor_config.right_camera.c_str());
   ROS_INFO("===========================================");
   return true;
 }
 
 bool ImageProcessor::createRosIO() {
-  feature_pub = nh.advertise<CameraMeasurement>(
+  ros::NodeHandle& nh = *nh_ptr;
+  feature_pub = nh.advertise<FeatureBatch>(
       "features", 3);
   tracking_info_pub = nh.advertise<TrackingInfo>(
       "tracking_info", 1);
@@ -194,9 +200,27 @@ bool ImageProcessor::createRosIO() {
   imu_sub = nh.subscribe("imu", 50,
       &ImageProcessor::imuCallback, this);
 
+  diagnostics_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>(
+      "/diagnostics", 1);
+  diagnostics_timer = nh.createWallTimer(ros::WallDuration(1.0),
+      &ImageProcessor::diagnosticsCallback, this);
+
   return true;
 }
 
+void ImageProcessor::diagnosticsCallback(
+    const ros::WallTimerEvent& event) {
+  const vector<profiling::StageStatistics> statistics =
+    profiler.collect();
+  if (statistics.empty()) return;
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  utils::getDiagnostics(ros::this_node::getName(),
+      statistics, diagnostics);
+  diagnostics_pub.publish(diagnostics);
+  return;
+}
+
 bool ImageProcessor::initialize() {
   if (!loadParameters()) return false;
   ROS_INFO("Finish loading ROS parameters...");
@@ -205,6 +229,29 @@ bool ImageProcessor::initialize() {
   detector_ptr = FastFeatureDetector::create(
       processor_config.fast_threshold);
 
+  // The worker lives as long as the processor, so that no
+  // thread is created per frame.
+  cam1_worker.reset(new WorkerPool(1));
+
+  // The stereo errors are bounded by the stereo threshold.
+  track_statistics = TrackStatistics(
+      50, processor_config.stereo_threshold, 20);
+
+  // Cache the calibration for undistortion.
+  const CameraCalibration& cam0 = calibration->cam0;
+  const CameraCalibration& cam1 = calibration->cam1;
+  if (!cam0_undistorter.initialize(cam0.resolution, cam0.intrinsics,
+        cam0.distortion_model, cam0.distortion_coeffs,
+        processor_config.undistortion_lut))
+    ROS_WARN("The model %s is unrecognized, use radtan instead...",
+        cam0.distortion_model.c_str());
+  if (!cam1_undistorter.initialize(cam1.resolution, cam1.intrinsics,
+        cam1.distortion_model, cam1.distortion_coeffs,
+        processor_config.undistortion_lut))
+    ROS_WARN("The model %s is unrecognized, use radtan instead...",
+        cam1.distortion_model.c_str());
+
+  if (!nh_ptr) return true;
   if (!createRosIO()) return false;
   ROS_INFO("Finish creating ROS IO...");
 
@@ -214,11 +261,14 @@ bool ImageProcessor::initialize() {
 void ImageProcessor::stereoCallback(
     const sensor_msgs::ImageConstPtr& cam0_img,
     const sensor_msgs::ImageConstPtr& cam1_img) {
-    
+  MSCKF_VIO_PROFILE_SCOPE(profiler, "stereoCallback");
+
     // if (cam_pub_counter == 0)
     // {
-      cam0_img_pub.publish(cam0_img);
-      cam1_img_pub.publish(cam1_img);
+      if (nh_ptr) {
+        cam0_img_pub.publish(cam0_img);
+        cam1_img_pub.publish(cam1_img);
+      }
     //   cam_pub_counter = 0;
 
     // } else {
@@ -232,57 +282,53 @@ void ImageProcessor::stereoCallback(
   cam1_curr_img_ptr = cv_bridge::toCvShare(cam1_img);
 
   // Build the image pyramids once since they're used at multiple places
-  createImagePyramids();
+  {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "createImagePyramids");
+    createImagePyramids();
+  }
 
   // Detect features in the first frame.
   if (is_first_img) {
-    ros::Time start_time = ros::Time::now();
-    initializeFirstFrame();
-    //ROS_INFO("Detection time: %f",
-    //    (ros::Time::now()-start_time).toSec());
+    {
+      MSCKF_VIO_PROFILE_SCOPE(profiler, "initializeFirstFrame");
+      initializeFirstFrame();
+    }
     is_first_img = false;
 
     // Draw results.
-    start_time = ros::Time::now();
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "drawFeaturesStereo");
     drawFeaturesStereo();
-    //ROS_INFO("Draw features: %f",
-    //    (ros::Time::now()-start_time).toSec());
   } else {
     // Track the feature in the previous image.
-    ros::Time start_time = ros::Time::now();
-    trackFeatures();
-    //ROS_INFO("Tracking time: %f",
-    //    (ros::Time::now()-start_time).toSec());
+    {
+      MSCKF_VIO_PROFILE_SCOPE(profiler, "trackFeatures");
+      trackFeatures();
+    }
 
     // Add new features into the current image.
-    start_time = ros::Time::now();
-    addNewFeatures();
-    //ROS_INFO("Addition time: %f",
-    //    (ros::Time::now()-start_time).toSec());
+    {
+      MSCKF_VIO_PROFILE_SCOPE(profiler, "addNewFeatures");
+      addNewFeatures();
+    }
 
     // Add new features into the current image.
-    start_time = ros::Time::now();
-    pruneGridFeatures();
-    //ROS_INFO("Prune grid features: %f",
-    //    (ros::Time::now()-start_time).toSec());
+    {
+      MSCKF_VIO_PROFILE_SCOPE(profiler, "pruneGridFeatures");
+      pruneGridFeatures();
+    }
 
     // Draw results.
-    start_time = ros::Time::now();
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "drawFeaturesStereo");
     drawFeaturesStereo();
-    //ROS_INFO("Draw features: %f",
-    //    (ros::Time::now()-start_time).toSec());
   }
 
-  //ros::Time start_time = ros::Time::now();
-  //updateFeatureLifetime();
-  //ROS_INFO("Statistics: %f",
-  //    (ros::Time::now()-start_time).toSec());
+  updateTrackStatistics();
 
   // Publish features in the current image.
-  ros::Time start_time = ros::Time::now();
-  publish();
-  //ROS_INFO("Publishing: %f",
-  //    (ros::Time::now()-start_time).toSec());
+  {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "publish");
+    publish();
+  }
 
   // Update the previous image and previous features.
   cam0_prev_img_ptr = cam0_curr_img_ptr;
@@ -308,19 +354,18 @@ void ImageProcessor::imuCallback(
 }
 
 void ImageProcessor::createImagePyramids() {
-  const Mat& curr_cam0_img = cam0_curr_img_ptr->image;
-  buildOpticalFlowPyramid(
-      curr_cam0_img, curr_cam0_pyramid_,
-      Size(processor_config.patch_size, processor_config.patch_size),
-      processor_config.pyramid_levels, true, BORDER_REFLECT_101,
-      BORDER_CONSTANT, false);
-
-  const Mat& curr_cam1_img = cam1_curr_img_ptr->image;
-  buildOpticalFlowPyramid(
-      curr_cam1_img, curr_cam1_pyramid_,
-      Size(processor_config.patch_size, processor_config.patch_size),
-      processor_config.pyramid_levels, true, BORDER_REFLECT_101,
-      BORDER_CONSTANT, false);
+  // The pyramids of the two cameras are independent, so that
+  // cam1 is built on its worker. The levels are reused from
+  // the previous frames if the sizes do not change.
+  cam1_worker->parallelFor(2, [this](const size_t cam) {
+    const Mat& curr_img = cam == 0 ?
+      cam0_curr_img_ptr->image : cam1_curr_img_ptr->image;
+    buildOpticalFlowPyramid(
+        curr_img, cam == 0 ? curr_cam0_pyramid_ : curr_cam1_pyramid_,
+        Size(processor_config.patch_size, processor_config.patch_size),
+        processor_config.pyramid_levels, true, BORDER_REFLECT_101,
+        BORDER_CONSTANT, false);
+  });
 }
 
 void ImageProcessor::initializeFirstFrame() {
@@ -427,6 +472,44 @@ void ImageProcessor::predictFeatureTracking(
   return;
 }
 
+void ImageProcessor::selectTrackingParameters(
+    const cv::Matx33f& R_p_c,
+    const cv::Vec4d& intrinsics,
+    int& pyramid_levels,
+    int& patch_size) {
+
+  // Magnitude of the rotation between the frames in pixels.
+  const double cos_angle = std::max(-1.0, std::min(1.0,
+        (R_p_c(0, 0)+R_p_c(1, 1)+R_p_c(2, 2)-1.0) / 2.0));
+  const double rotation_pixels = std::acos(cos_angle) *
+    0.5 * (intrinsics[0]+intrinsics[1]);
+
+  // The rotation is compensated by the prediction. However,
+  // the error of the prediction grows with the rotation, and
+  // the translation always needs at least half of a window.
+  const int half_patch = processor_config.patch_size / 2;
+  const double search_radius = half_patch + rotation_pixels;
+
+  // The displacement which can be recovered with level L
+  // on top of the original image is about
+  // half_patch * (2^(L+1)-1).
+  pyramid_levels = 1;
+  while (pyramid_levels < processor_config.pyramid_levels &&
+      half_patch*((2<<pyramid_levels)-1) < search_radius)
+    ++pyramid_levels;
+  pyramid_levels = std::min(pyramid_levels, processor_config.pyramid_levels);
+
+  // The window only needs to cover the share of the search
+  // radius on each level, but is not shrunk below 9 pixels.
+  const int min_patch_size = std::min(9, processor_config.patch_size);
+  const int needed_half_patch = static_cast<int>(std::ceil(
+        search_radius / ((2<<pyramid_levels)-1)));
+  patch_size = std::max(min_patch_size,
+      std::min(processor_config.patch_size, 2*needed_half_patch+1));
+
+  return;
+}
+
 void ImageProcessor::trackFeatures() {
   // Size of each grid.
   static int grid_height =
@@ -467,19 +550,64 @@ void ImageProcessor::trackFeatures() {
   vector<unsigned char> track_inliers(0);
 
   predictFeatureTracking(prev_cam0_points,
-      cam0_R_p_c, cam0_intrinsics, curr_cam0_points);
+      cam0_R_p_c, calibration->cam0.intrinsics, curr_cam0_points);
+  const vector<Point2f> predicted_cam0_points = curr_cam0_points;
+
+  int pyramid_levels = processor_config.pyramid_levels;
+  int patch_size = processor_config.patch_size;
+  if (processor_config.adaptive_tracking)
+    selectTrackingParameters(cam0_R_p_c, calibration->cam0.intrinsics,
+        pyramid_levels, patch_size);
 
+  vector<float> track_errors(0);
   calcOpticalFlowPyrLK(
       prev_cam0_pyramid_, curr_cam0_pyramid_,
       prev_cam0_points, curr_cam0_points,
-      track_inliers, noArray(),
-      Size(processor_config.patch_size, processor_config.patch_size),
-      processor_config.pyramid_levels,
+      track_inliers, track_errors,
+      Size(patch_size, patch_size),
+      pyramid_levels,
       TermCriteria(TermCriteria::COUNT+TermCriteria::EPS,
         processor_config.max_iteration,
         processor_config.track_precision),
       cv::OPTFLOW_USE_INITIAL_FLOW);
 
+  // Features which are lost or poorly matched with the reduced
+  // pyramid and window are tracked again with the full ones.
+  // The confidently tracked features are not touched.
+  if (pyramid_levels < processor_config.pyramid_levels ||
+      patch_size < processor_config.patch_size) {
+    vector<int> retrack_idx(0);
+    vector<Point2f> retrack_prev_points(0);
+    vector<Point2f> retrack_curr_points(0);
+    for (int i = 0; i < prev_cam0_points.size(); ++i) {
+      if (track_inliers[i] != 0 &&
+          track_errors[i] < processor_config.track_error_threshold)
+        continue;
+      retrack_idx.push_back(i);
+      retrack_prev_points.push_back(prev_cam0_points[i]);
+      retrack_curr_points.push_back(predicted_cam0_points[i]);
+    }
+
+    if (retrack_idx.size() > 0) {
+      vector<unsigned char> retrack_inliers(0);
+      calcOpticalFlowPyrLK(
+          prev_cam0_pyramid_, curr_cam0_pyramid_,
+          retrack_prev_points, retrack_curr_points,
+          retrack_inliers, noArray(),
+          Size(processor_config.patch_size, processor_config.patch_size),
+          processor_config.pyramid_levels,
+          TermCriteria(TermCriteria::COUNT+TermCriteria::EPS,
+            processor_config.max_iteration,
+            processor_config.track_precision),
+          cv::OPTFLOW_USE_INITIAL_FLOW);
+
+      for (int k = 0; k < retrack_idx.size(); ++k) {
+        curr_cam0_points[retrack_idx[k]] = retrack_curr_points[k];
+        track_inliers[retrack_idx[k]] = retrack_inliers[k];
+      }
+    }
+  }
+
   // Mark those tracked points out of the image region
   // as untracked.
   for (int i = 0; i < curr_cam0_points.size(); ++i) {
@@ -532,7 +660,16 @@ void ImageProcessor::trackFeatures() {
   // The stereo matching results are directly used in the RANSAC.
 
   // Step 1: stereo matching.
+  // The disparity of the tracked features changes little
+  // between consecutive frames, which gives a good prior
+  // of the locations in the current cam1 image.
   vector<Point2f> curr_cam1_points(0);
+  if (processor_config.stereo_prior) {
+    curr_cam1_points.resize(curr_tracked_cam0_points.size());
+    for (int i = 0; i < curr_tracked_cam0_points.size(); ++i)
+      curr_cam1_points[i] = curr_tracked_cam0_points[i] +
+        (prev_tracked_cam1_points[i]-prev_tracked_cam0_points[i]);
+  }
   vector<unsigned char> match_inliers(0);
   stereoMatch(curr_tracked_cam0_points, curr_cam1_points, match_inliers);
 
@@ -560,17 +697,22 @@ void ImageProcessor::trackFeatures() {
   after_matching = curr_matched_cam0_points.size();
 
   // Step 2 and 3: RANSAC on temporal image pairs of cam0 and cam1.
+  // The two are independent, so that cam1 runs on its worker.
   vector<int> cam0_ransac_inliers(0);
-  twoPointRansac(prev_matched_cam0_points, curr_matched_cam0_points,
-      cam0_R_p_c, cam0_intrinsics, cam0_distortion_model,
-      cam0_distortion_coeffs, processor_config.ransac_threshold,
-      0.99, cam0_ransac_inliers);
-
   vector<int> cam1_ransac_inliers(0);
-  twoPointRansac(prev_matched_cam1_points, curr_matched_cam1_points,
-      cam1_R_p_c, cam1_intrinsics, cam1_distortion_model,
-      cam1_distortion_coeffs, processor_config.ransac_threshold,
-      0.99, cam1_ransac_inliers);
+  cam1_worker->parallelFor(2, [&](const size_t cam) {
+    if (cam == 0) {
+      twoPointRansac(prev_matched_cam0_points, curr_matched_cam0_points,
+          cam0_R_p_c, calibration->cam0.intrinsics,
+          cam0_undistorter, cam0_ransac,
+          processor_config.ransac_threshold, 0.99, cam0_ransac_inliers);
+    } else {
+      twoPointRansac(prev_matched_cam1_points, curr_matched_cam1_points,
+          cam1_R_p_c, calibration->cam1.intrinsics,
+          cam1_undistorter, cam1_ransac,
+          processor_config.ransac_threshold, 0.99, cam1_ransac_inliers);
+    }
+  });
 
   // Number of features after ransac.
   after_ransac = 0;
@@ -625,29 +767,74 @@ void ImageProcessor::stereoMatch(
     vector<unsigned char>& inlier_markers) {
 
   if (cam0_points.size() == 0) return;
+  MSCKF_VIO_PROFILE_SCOPE(profiler, "stereoMatch");
 
-  if(cam1_points.size() == 0) {
-    // Initialize cam1_points by projecting cam0_points to cam1 using the
-    // rotation from stereo extrinsics
-    const cv::Matx33d R_cam0_cam1 = R_cam1_imu.t() * R_cam0_imu;
-    vector<cv::Point2f> cam0_points_undistorted;
-    undistortPoints(cam0_points, cam0_intrinsics, cam0_distortion_model,
-                    cam0_distortion_coeffs, cam0_points_undistorted,
-                    R_cam0_cam1);
-    cam1_points = distortPoints(cam0_points_undistorted, cam1_intrinsics,
-                                cam1_distortion_model, cam1_distortion_coeffs);
-  }
+  // Initialize cam1_points by projecting cam0_points to cam1 using the
+  // rotation from stereo extrinsics
+  const cv::Matx33d R_cam0_cam1 = R_cam1_imu.t() * R_cam0_imu;
+  auto projectToCam1 = [&](const vector<cv::Point2f>& pts0)
+      -> vector<cv::Point2f> {
+    vector<cv::Point2f> pts0_undistorted;
+    cam0_undistorter.undistort(pts0, pts0_undistorted, R_cam0_cam1);
+    return cam1_undistorter.distort(pts0_undistorted);
+  };
+
+  const TermCriteria term_criteria(
+      TermCriteria::COUNT+TermCriteria::EPS,
+      processor_config.max_iteration,
+      processor_config.track_precision);
 
-  // Track features using LK optical flow method.
-  calcOpticalFlowPyrLK(curr_cam0_pyramid_, curr_cam1_pyramid_,
-      cam0_points, cam1_points,
-      inlier_markers, noArray(),
-      Size(processor_config.patch_size, processor_config.patch_size),
-      processor_config.pyramid_levels,
-      TermCriteria(TermCriteria::COUNT+TermCriteria::EPS,
-                   processor_config.max_iteration,
-                   processor_config.track_precision),
-      cv::OPTFLOW_USE_INITIAL_FLOW);
+  if (cam1_points.size() == 0) {
+    cam1_points = projectToCam1(cam0_points);
+
+    // Track features using LK optical flow method.
+    calcOpticalFlowPyrLK(curr_cam0_pyramid_, curr_cam1_pyramid_,
+        cam0_points, cam1_points,
+        inlier_markers, noArray(),
+        Size(processor_config.patch_size, processor_config.patch_size),
+        processor_config.pyramid_levels, term_criteria,
+        cv::OPTFLOW_USE_INITIAL_FLOW);
+  } else {
+    // The prior is close to the solution, so that two pyramid
+    // levels (0 and 1) and a small window are enough.
+    const int prior_patch_size = std::min(9, processor_config.patch_size);
+    vector<float> match_errors(0);
+    calcOpticalFlowPyrLK(curr_cam0_pyramid_, curr_cam1_pyramid_,
+        cam0_points, cam1_points,
+        inlier_markers, match_errors,
+        Size(prior_patch_size, prior_patch_size),
+        std::min(1, processor_config.pyramid_levels), term_criteria,
+        cv::OPTFLOW_USE_INITIAL_FLOW);
+
+    // Fall back to the full search from the extrinsic
+    // projection for the features with a bad prior.
+    vector<int> rematch_idx(0);
+    vector<cv::Point2f> rematch_cam0_points(0);
+    for (int i = 0; i < cam0_points.size(); ++i) {
+      if (inlier_markers[i] != 0 &&
+          match_errors[i] < processor_config.track_error_threshold)
+        continue;
+      rematch_idx.push_back(i);
+      rematch_cam0_points.push_back(cam0_points[i]);
+    }
+
+    if (rematch_idx.size() > 0) {
+      vector<cv::Point2f> rematch_cam1_points =
+        projectToCam1(rematch_cam0_points);
+      vector<unsigned char> rematch_inliers(0);
+      calcOpticalFlowPyrLK(curr_cam0_pyramid_, curr_cam1_pyramid_,
+          rematch_cam0_points, rematch_cam1_points,
+          rematch_inliers, noArray(),
+          Size(processor_config.patch_size, processor_config.patch_size),
+          processor_config.pyramid_levels, term_criteria,
+          cv::OPTFLOW_USE_INITIAL_FLOW);
+
+      for (int k = 0; k < rematch_idx.size(); ++k) {
+        cam1_points[rematch_idx[k]] = rematch_cam1_points[k];
+        inlier_markers[rematch_idx[k]] = rematch_inliers[k];
+      }
+    }
+  }
 
   // Mark those tracked points out of the image region
   // as untracked.
@@ -660,9 +847,8 @@ void ImageProcessor::stereoMatch(
       inlier_markers[i] = 0;
   }
 
-  // Compute the relative rotation between the cam0
+  // Compute the relative translation between the cam0
   // frame and cam1 frame.
-  const cv::Matx33d R_cam0_cam1 = R_cam1_imu.t() * R_cam0_imu;
   const cv::Vec3d t_cam0_cam1 = R_cam1_imu.t() * (t_cam0_imu-t_cam1_imu);
   // Compute the essential matrix.
   const cv::Matx33d t_cam0_cam1_hat(
@@ -675,16 +861,12 @@ void ImageProcessor::stereoMatch(
   // essential matrix.
   vector<cv::Point2f> cam0_points_undistorted(0);
   vector<cv::Point2f> cam1_points_undistorted(0);
-  undistortPoints(
-      cam0_points, cam0_intrinsics, cam0_distortion_model,
-      cam0_distortion_coeffs, cam0_points_undistorted);
-  undistortPoints(
-      cam1_points, cam1_intrinsics, cam1_distortion_model,
-      cam1_distortion_coeffs, cam1_points_undistorted);
+  cam0_undistorter.undistort(cam0_points, cam0_points_undistorted);
+  cam1_undistorter.undistort(cam1_points, cam1_points_undistorted);
 
   double norm_pixel_unit = 4.0 / (
-      cam0_intrinsics[0]+cam0_intrinsics[1]+
-      cam1_intrinsics[0]+cam1_intrinsics[1]);
+      calibration->cam0.intrinsics[0]+calibration->cam0.intrinsics[1]+
+      calibration->cam1.intrinsics[0]+calibration->cam1.intrinsics[1]);
 
   for (int i = 0; i < cam0_points_undistorted.size(); ++i) {
     if (inlier_markers[i] == 0) continue;
@@ -698,6 +880,8 @@ void ImageProcessor::stereoMatch(
         epipolar_line[1]*epipolar_line[1]);
     if (error > processor_config.stereo_threshold*norm_pixel_unit)
       inlier_markers[i] = 0;
+    else
+      track_statistics.addError(error / norm_pixel_unit);
   }
 
   return;
@@ -733,31 +917,25 @@ void ImageProcessor::addNewFeatures() {
     }
   }
 
-  // Detect new features.
-  vector<KeyPoint> new_features(0);
-  detector_ptr->detect(curr_img, new_features, mask);
-
-  // Collect the new detected features based on the grid.
-  // Select the ones with top response within each grid afterwards.
-  vector<vector<KeyPoint> > new_feature_sieve(
-      processor_config.grid_row*processor_config.grid_col);
-  for (const auto& feature : new_features) {
-    int row = static_cast<int>(feature.pt.y / grid_height);
-    int col = static_cast<int>(feature.pt.x / grid_width);
-    new_feature_sieve[
-      row*processor_config.grid_col+col].push_back(feature);
+  // Only the grids which still have vacancies can take new
+  // features, so detection is skipped on the full ones.
+  const int grid_num =
+    processor_config.grid_row*processor_config.grid_col;
+  vector<int> grid_quota(grid_num, 0);
+  for (int code = 0; code < grid_num; ++code) {
+    if (static_cast<int>((*curr_features_ptr)[code].size()) <
+        processor_config.grid_min_feature_num)
+      grid_quota[code] = processor_config.grid_max_feature_num;
   }
 
-  new_features.clear();
-  for (auto& item : new_feature_sieve) {
-    if (item.size() > processor_config.grid_max_feature_num) {
-      std::sort(item.begin(), item.end(),
-          &ImageProcessor::keyPointCompareByResponse);
-      item.erase(
-          item.begin()+processor_config.grid_max_feature_num, item.end());
-    }
+  // Detect new features within each grid. Only the ones with
+  // top response within each grid are kept.
+  vector<vector<KeyPoint> > new_feature_sieve(0);
+  detectGridFeatures(curr_img, mask, grid_quota, new_feature_sieve);
+
+  vector<KeyPoint> new_features(0);
+  for (const auto& item : new_feature_sieve)
     new_features.insert(new_features.end(), item.begin(), item.end());
-  }
 
   int detected_new_features = new_features.size();
 
@@ -844,6 +1022,67 @@ void ImageProcessor::addNewFeatures() {
   return;
 }
 
+void ImageProcessor::detectGridFeatures(
+    const Mat& img, const Mat& mask,
+    const vector<int>& grid_quota,
+    vector<vector<KeyPoint> >& new_feature_sieve) {
+
+  // Size of each grid.
+  const int grid_height = img.rows / processor_config.grid_row;
+  const int grid_width = img.cols / processor_config.grid_col;
+
+  // FAST does not respond within 3 pixels of the image
+  // boundary. Enlarge each grid by this border so that
+  // the features on the grid boundaries are not lost.
+  const int border = 3;
+
+  new_feature_sieve.clear();
+  new_feature_sieve.resize(
+      processor_config.grid_row*processor_config.grid_col);
+
+  parallel_for_(Range(0, new_feature_sieve.size()),
+      [&](const Range& range) {
+    for (int code = range.start; code < range.end; ++code) {
+      const int quota = grid_quota[code];
+      if (quota <= 0) continue;
+
+      const int row = code / processor_config.grid_col;
+      const int col = code % processor_config.grid_col;
+      const Rect grid_rect(col*grid_width, row*grid_height,
+          grid_width, grid_height);
+      const Rect roi = Rect(
+          grid_rect.x-border, grid_rect.y-border,
+          grid_rect.width+2*border, grid_rect.height+2*border) &
+        Rect(0, 0, img.cols, img.rows);
+
+      vector<KeyPoint> grid_features(0);
+      FAST(img(roi), grid_features,
+          processor_config.fast_threshold, true);
+      KeyPointsFilter::runByPixelsMask(grid_features, mask(roi));
+
+      // Drop the features detected within the enlarged border,
+      // which belong to the neighboring grids.
+      vector<KeyPoint>& item = new_feature_sieve[code];
+      for (auto& feature : grid_features) {
+        feature.pt.x += roi.x;
+        feature.pt.y += roi.y;
+        if (grid_rect.contains(Point(feature.pt.x, feature.pt.y)))
+          item.push_back(feature);
+      }
+
+      // Only the top responses are needed, so a full sort
+      // of the grid is not necessary.
+      if (item.size() > quota) {
+        std::nth_element(item.begin(), item.begin()+quota-1, item.end(),
+            &ImageProcessor::keyPointCompareByResponse);
+        item.erase(item.begin()+quota, item.end());
+      }
+    }
+  });
+
+  return;
+}
+
 void ImageProcessor::pruneGridFeatures() {
   for (auto& item : *curr_features_ptr) {
     auto& grid_features = item.second;
@@ -860,73 +1099,6 @@ void ImageProcessor::pruneGridFeatures() {
   return;
 }
 
-void ImageProcessor::undistortPoints(
-    const vector<cv::Point2f>& pts_in,
-    const cv::Vec4d& intrinsics,
-    const string& distortion_model,
-    const cv::Vec4d& distortion_coeffs,
-    vector<cv::Point2f>& pts_out,
-    const cv::Matx33d &rectification_matrix,
-    const cv::Vec4d &new_intrinsics) {
-
-  if (pts_in.size() == 0) return;
-
-  const cv::Matx33d K(
-      intrinsics[0], 0.0, intrinsics[2],
-      0.0, intrinsics[1], intrinsics[3],
-      0.0, 0.0, 1.0);
-
-  const cv::Matx33d K_new(
-      new_intrinsics[0], 0.0, new_intrinsics[2],
-      0.0, new_intrinsics[1], new_intrinsics[3],
-      0.0, 0.0, 1.0);
-
-  if (distortion_model == "radtan") {
-    cv::undistortPoints(pts_in, pts_out, K, distortion_coeffs,
-                        rectification_matrix, K_new);
-  } else if (distortion_model == "equidistant") {
-    cv::fisheye::undistortPoints(pts_in, pts_out, K, distortion_coeffs,
-                                 rectification_matrix, K_new);
-  } else {
-    ROS_WARN_ONCE("The model %s is unrecognized, use radtan instead...",
-                  distortion_model.c_str());
-    cv::undistortPoints(pts_in, pts_out, K, distortion_coeffs,
-                        rectification_matrix, K_new);
-  }
-
-  return;
-}
-
-vector<cv::Point2f> ImageProcessor::distortPoints(
-    const vector<cv::Point2f>& pts_in,
-    const cv::Vec4d& intrinsics,
-    const string& distortion_model,
-    const cv::Vec4d& distortion_coeffs) {
-
-  const cv::Matx33d K(intrinsics[0], 0.0, intrinsics[2],
-                      0.0, intrinsics[1], intrinsics[3],
-                      0.0, 0.0, 1.0);
-
-  vector<cv::Point2f> pts_out;
-  if (distortion_model == "radtan") {
-    vector<cv::Point3f> homogenous_pts;
-    cv::convertPointsToHomogeneous(pts_in, homogenous_pts);
-    cv::projectPoints(homogenous_pts, cv::Vec3d::zeros(), cv::Vec3d::zeros(), K,
-                      distortion_coeffs, pts_out);
-  } else if (distortion_model == "equidistant") {
-    cv::fisheye::distortPoints(pts_in, pts_out, K, distortion_coeffs);
-  } else {
-    ROS_WARN_ONCE("The model %s is unrecognized, using radtan instead...",
-                  distortion_model.c_str());
-    vector<cv::Point3f> homogenous_pts;
-    cv::convertPointsToHomogeneous(pts_in, homogenous_pts);
-    cv::projectPoints(homogenous_pts, cv::Vec3d::zeros(), cv::Vec3d::zeros(), K,
-                      distortion_coeffs, pts_out);
-  }
-
-  return pts_out;
-}
-
 void ImageProcessor::integrateImuData(
     Matx33f& cam0_R_p_c, Matx33f& cam1_R_p_c) {
   // Find the start and the end limit within the imu msg buffer.
@@ -1000,11 +1172,12 @@ void ImageProcessor::rescalePoints(
 void ImageProcessor::twoPointRansac(
     const vector<Point2f>& pts1, const vector<Point2f>& pts2,
     const cv::Matx33f& R_p_c, const cv::Vec4d& intrinsics,
-    const std::string& distortion_model,
-    const cv::Vec4d& distortion_coeffs,
+    const PointUndistorter& undistorter,
+    TwoPointRansac& ransac,
     const double& inlier_error,
     const double& success_probability,
     vector<int>& inlier_markers) {
+  MSCKF_VIO_PROFILE_SCOPE(profiler, "twoPointRansac");
 
   // Check the size of input point size.
   if (pts1.size() != pts2.size())
@@ -1012,22 +1185,12 @@ void ImageProcessor::twoPointRansac(
         pts1.size(), pts2.size());
 
   double norm_pixel_unit = 2.0 / (intrinsics[0]+intrinsics[1]);
-  int iter_num = static_cast<int>(
-      ceil(log(1-success_probability) / log(1-0.7*0.7)));
-
-  // Initially, mark all points as inliers.
-  inlier_markers.clear();
-  inlier_markers.resize(pts1.size(), 1);
 
   // Undistort all the points.
   vector<Point2f> pts1_undistorted(pts1.size());
   vector<Point2f> pts2_undistorted(pts2.size());
-  undistortPoints(
-      pts1, intrinsics, distortion_model,
-      distortion_coeffs, pts1_undistorted);
-  undistortPoints(
-      pts2, intrinsics, distortion_model,
-      distortion_coeffs, pts2_undistorted);
+  undistorter.undistort(pts1, pts1_undistorted);
+  undistorter.undistort(pts2, pts2_undistorted);
 
   // Compenstate the points in the previous image with
   // the relative rotation.
@@ -1044,200 +1207,9 @@ void ImageProcessor::twoPointRansac(
   rescalePoints(pts1_undistorted, pts2_undistorted, scaling_factor);
   norm_pixel_unit *= scaling_factor;
 
-  // Compute the difference between previous and current points,
-  // which will be used frequently later.
-  vector<Point2d> pts_diff(pts1_undistorted.size());
-  for (int i = 0; i < pts1_undistorted.size(); ++i)
-    pts_diff[i] = pts1_undistorted[i] - pts2_undistorted[i];
-
-  // Mark the point pairs with large difference directly.
-  // BTW, the mean distance of the rest of the point pairs
-  // are computed.
-  double mean_pt_distance = 0.0;
-  int raw_inlier_cntr = 0;
-  for (int i = 0; i < pts_diff.size(); ++i) {
-    double distance = sqrt(pts_diff[i].dot(pts_diff[i]));
-    // 25 pixel distance is a pretty large tolerance for normal motion.
-    // However, to be used with aggressive motion, this tolerance should
-    // be increased significantly to match the usage.
-    if (distance > 50.0*norm_pixel_unit) {
-      inlier_markers[i] = 0;
-    } else {
-      mean_pt_distance += distance;
-      ++raw_inlier_cntr;
-    }
-  }
-  mean_pt_distance /= raw_inlier_cntr;
-
-  // If the current number of inliers is less than 3, just mark
-  // all input as outliers. This case can happen with fast
-  // rotation where very few features are tracked.
-  if (raw_inlier_cntr < 3) {
-    for (auto& marker : inlier_markers) marker = 0;
-    return;
-  }
-
-  // Before doing 2-point RANSAC, we have to check if the motion
-  // is degenerated, meaning that there is no translation between
-  // the frames, in which case, the model of the RANSAC does not
-  // work. If so, the distance between the matched points will
-  // be almost 0.
-  //if (mean_pt_distance < inlier_error*norm_pixel_unit) {
-  if (mean_pt_distance < norm_pixel_unit) {
-    //ROS_WARN_THROTTLE(1.0, "Degenerated motion...");
-    for (int i = 0; i < pts_diff.size(); ++i) {
-      if (inlier_markers[i] == 0) continue;
-      if (sqrt(pts_diff[i].dot(pts_diff[i])) >
-          inlier_error*norm_pixel_unit)
-        inlier_markers[i] = 0;
-    }
-    return;
-  }
-
-  // In the case of general motion, the RANSAC model can be applied.
-  // The three column corresponds to tx, ty, and tz respectively.
-  MatrixXd coeff_t(pts_diff.size(), 3);
-  for (int i = 0; i < pts_diff.size(); ++i) {
-    coeff_t(i, 0) = pts_diff[i].y;
-    coeff_t(i, 1) = -pts_diff[i].x;
-    coeff_t(i, 2) = pts1_undistorted[i].x*pts2_undistorted[i].y -
-      pts1_undistorted[i].y*pts2_undistorted[i].x;
-  }
-
-  vector<int> raw_inlier_idx;
-  for (int i = 0; i < inlier_markers.size(); ++i) {
-    if (inlier_markers[i] != 0)
-      raw_inlier_idx.push_back(i);
-  }
-
-  vector<int> best_inlier_set;
-  double best_error = 1e10;
-  random_numbers::RandomNumberGenerator random_gen;
-
-  for (int iter_idx = 0; iter_idx < iter_num; ++iter_idx) {
-    // Randomly select two point pairs.
-    // Although this is a weird way of selecting two pairs, but it
-    // is able to efficiently avoid selecting repetitive pairs.
-    int select_idx1 = random_gen.uniformInteger(
-        0, raw_inlier_idx.size()-1);
-    int select_idx_diff = random_gen.uniformInteger(
-        1, raw_inlier_idx.size()-1);
-    int select_idx2 = select_idx1+select_idx_diff<raw_inlier_idx.size() ?
-      select_idx1+select_idx_diff :
-      select_idx1+select_idx_diff-raw_inlier_idx.size();
-
-    int pair_idx1 = raw_inlier_idx[select_idx1];
-    int pair_idx2 = raw_inlier_idx[select_idx2];
-
-    // Construct the model;
-    Vector2d coeff_tx(coeff_t(pair_idx1, 0), coeff_t(pair_idx2, 0));
-    Vector2d coeff_ty(coeff_t(pair_idx1, 1), coeff_t(pair_idx2, 1));
-    Vector2d coeff_tz(coeff_t(pair_idx1, 2), coeff_t(pair_idx2, 2));
-    vector<double> coeff_l1_norm(3);
-    coeff_l1_norm[0] = coeff_tx.lpNorm<1>();
-    coeff_l1_norm[1] = coeff_ty.lpNorm<1>();
-    coeff_l1_norm[2] = coeff_tz.lpNorm<1>();
-    int base_indicator = min_element(coeff_l1_norm.begin(),
-        coeff_l1_norm.end())-coeff_l1_norm.begin();
-
-    Vector3d model(0.0, 0.0, 0.0);
-    if (base_indicator == 0) {
-      Matrix2d A;
-      A << coeff_ty, coeff_tz;
-      Vector2d solution = A.inverse() * (-coeff_tx);
-      model(0) = 1.0;
-      model(1) = solution(0);
-      model(2) = solution(1);
-    } else if (base_indicator ==1) {
-      Matrix2d A;
-      A << coeff_tx, coeff_tz;
-      Vector2d solution = A.inverse() * (-coeff_ty);
-      model(0) = solution(0);
-      model(1) = 1.0;
-      model(2) = solution(1);
-    } else {
-      Matrix2d A;
-      A << coeff_tx, coeff_ty;
-      Vector2d solution = A.inverse() * (-coeff_tz);
-      model(0) = solution(0);
-      model(1) = solution(1);
-      model(2) = 1.0;
-    }
-
-    // Find all the inliers among point pairs.
-    VectorXd error = coeff_t * model;
-
-    vector<int> inlier_set;
-    for (int i = 0; i < error.rows(); ++i) {
-      if (inlier_markers[i] == 0) continue;
-      if (std::abs(error(i)) < inlier_error*norm_pixel_unit)
-        inlier_set.push_back(i);
-    }
-
-    // If the number of inliers is small, the current
-    // model is probably wrong.
-    if (inlier_set.size() < 0.2*pts1_undistorted.size())
-      continue;
-
-    // Refit the model using all of the possible inliers.
-    VectorXd coeff_tx_better(inlier_set.size());
-    VectorXd coeff_ty_better(inlier_set.size());
-    VectorXd coeff_tz_better(inlier_set.size());
-    for (int i = 0; i < inlier_set.size(); ++i) {
-      coeff_tx_better(i) = coeff_t(inlier_set[i], 0);
-      coeff_ty_better(i) = coeff_t(inlier_set[i], 1);
-      coeff_tz_better(i) = coeff_t(inlier_set[i], 2);
-    }
-
-    Vector3d model_better(0.0, 0.0, 0.0);
-    if (base_indicator == 0) {
-      MatrixXd A(inlier_set.size(), 2);
-      A << coeff_ty_better, coeff_tz_better;
-      Vector2d solution =
-          (A.transpose() * A).inverse() * A.transpose() * (-coeff_tx_better);
-      model_better(0) = 1.0;
-      model_better(1) = solution(0);
-      model_better(2) = solution(1);
-    } else if (base_indicator ==1) {
-      MatrixXd A(inlier_set.size(), 2);
-      A << coeff_tx_better, coeff_tz_better;
-      Vector2d solution =
-          (A.transpose() * A).inverse() * A.transpose() * (-coeff_ty_better);
-      model_better(0) = solution(0);
-      model_better(1) = 1.0;
-      model_better(2) = solution(1);
-    } else {
-      MatrixXd A(inlier_set.size(), 2);
-      A << coeff_tx_better, coeff_ty_better;
-      Vector2d solution =
-          (A.transpose() * A).inverse() * A.transpose() * (-coeff_tz_better);
-      model_better(0) = solution(0);
-      model_better(1) = solution(1);
-      model_better(2) = 1.0;
-    }
-
-    // Compute the error and upate the best model if possible.
-    VectorXd new_error = coeff_t * model_better;
-
-    double this_error = 0.0;
-    for (const auto& inlier_idx : inlier_set)
-      this_error += std::abs(new_error(inlier_idx));
-    this_error /= inlier_set.size();
-
-    if (inlier_set.size() > best_inlier_set.size()) {
-      best_error = this_error;
-      best_inlier_set = inlier_set;
-    }
-  }
-
-  // Fill in the markers.
-  inlier_markers.clear();
-  inlier_markers.resize(pts1.size(), 0);
-  for (const auto& inlier_idx : best_inlier_set)
-    inlier_markers[inlier_idx] = 1;
-
-  //printf("inlier ratio: %lu/%lu\n",
-  //    best_inlier_set.size(), inlier_markers.size());
+  ransac.estimate(pts1_undistorted, pts2_undistorted,
+      norm_pixel_unit, inlier_error, success_probability,
+      inlier_markers);
 
   return;
 }
@@ -1245,7 +1217,7 @@ void ImageProcessor::twoPointRansac(
 void ImageProcessor::publish() {
 
   // Publish features.
-  CameraMeasurementPtr feature_msg_ptr(new CameraMeasurement);
+  FeatureBatchPtr feature_msg_ptr(new FeatureBatch);
   feature_msg_ptr->header.stamp = cam0_curr_img_ptr->header.stamp;
 
   vector<FeatureIDType> curr_ids(0);
@@ -1263,23 +1235,26 @@ void ImageProcessor::publish() {
   vector<Point2f> curr_cam0_points_undistorted(0);
   vector<Point2f> curr_cam1_points_undistorted(0);
 
-  undistortPoints(
-      curr_cam0_points, cam0_intrinsics, cam0_distortion_model,
-      cam0_distortion_coeffs, curr_cam0_points_undistorted);
-  undistortPoints(
-      curr_cam1_points, cam1_intrinsics, cam1_distortion_model,
-      cam1_distortion_coeffs, curr_cam1_points_undistorted);
+  cam0_undistorter.undistort(
+      curr_cam0_points, curr_cam0_points_undistorted);
+  cam1_undistorter.undistort(
+      curr_cam1_points, curr_cam1_points_undistorted);
 
+  FeatureBatch& batch = *feature_msg_ptr;
+  batch.resize(curr_ids.size());
   for (int i = 0; i < curr_ids.size(); ++i) {
-    feature_msg_ptr->features.push_back(FeatureMeasurement());
-    feature_msg_ptr->features[i].id = curr_ids[i];
-    feature_msg_ptr->features[i].u0 = curr_cam0_points_undistorted[i].x;
-    feature_msg_ptr->features[i].v0 = curr_cam0_points_undistorted[i].y;
-    feature_msg_ptr->features[i].u1 = curr_cam1_points_undistorted[i].x;
-    feature_msg_ptr->features[i].v1 = curr_cam1_points_undistorted[i].y;
+    batch.id[i] = curr_ids[i];
+    batch.u0[i] = curr_cam0_points_undistorted[i].x;
+    batch.v0[i] = curr_cam0_points_undistorted[i].y;
+    batch.u1[i] = curr_cam1_points_undistorted[i].x;
+    batch.v1[i] = curr_cam1_points_undistorted[i].y;
   }
 
-  feature_pub.publish(feature_msg_ptr);
+  if (feature_callback) feature_callback(feature_msg_ptr);
+  if (!nh_ptr) return;
+  // Only the pointer is passed to the subscribers in the
+  // same nodelet manager.
+  feature_pub.publish(FeatureBatchConstPtr(feature_msg_ptr));
 
   // Publish tracking info.
   TrackingInfoPtr tracking_info_msg_ptr(new TrackingInfo());
@@ -1288,6 +1263,16 @@ void ImageProcessor::publish() {
   tracking_info_msg_ptr->after_tracking = after_tracking;
   tracking_info_msg_ptr->after_matching = after_matching;
   tracking_info_msg_ptr->after_ransac = after_ransac;
+  tracking_info_msg_ptr->ended_track_num =
+    track_statistics.trackNumber();
+  tracking_info_msg_ptr->mean_track_lifetime =
+    track_statistics.meanLifetime();
+  tracking_info_msg_ptr->lifetime_histogram =
+    track_statistics.lifetimeHistogram();
+  tracking_info_msg_ptr->stereo_error_bin_width =
+    track_statistics.errorBinWidth();
+  tracking_info_msg_ptr->stereo_error_histogram =
+    track_statistics.errorHistogram();
   tracking_info_pub.publish(tracking_info_msg_ptr);
 
   return;
@@ -1466,35 +1451,23 @@ void ImageProcessor::drawFeaturesStereo() {
   return;
 }
 
-void ImageProcessor::updateFeatureLifetime() {
-  for (int code = 0; code <
-      processor_config.grid_row*processor_config.grid_col; ++code) {
-    vector<FeatureMetaData>& features = (*curr_features_ptr)[code];
-    for (const auto& feature : features) {
-      if (feature_lifetime.find(feature.id) == feature_lifetime.end())
-        feature_lifetime[feature.id] = 1;
-      else
-        ++feature_lifetime[feature.id];
-    }
-  }
-
-  return;
-}
-
-void ImageProcessor::featureLifetimeStatistics() {
+void ImageProcessor::updateTrackStatistics() {
+  // The features of the previous frame which are missing in
+  // the current frame were lost or pruned, so their tracks
+  // end with the lifetime of the previous frame.
+  vector<FeatureIDType> curr_ids(0);
+  for (const auto& grid_features : *curr_features_ptr)
+    for (const auto& feature : grid_features.second)
+      curr_ids.push_back(feature.id);
+  sort(curr_ids.begin(), curr_ids.end());
 
-  map<int, int> lifetime_statistics;
-  for (const auto& data : feature_lifetime) {
-    if (lifetime_statistics.find(data.second) ==
-        lifetime_statistics.end())
-      lifetime_statistics[data.second] = 1;
-    else
-      ++lifetime_statistics[data.second];
+  for (const auto& grid_features : *prev_features_ptr) {
+    for (const auto& feature : grid_features.second) {
+      if (!binary_search(curr_ids.begin(), curr_ids.end(), feature.id))
+        track_statistics.addTrack(feature.lifetime);
+    }
   }
 
-  for (const auto& data : lifetime_statistics)
-    cout << data.first << " : " << data.second << endl;
-
   return;
 }
 
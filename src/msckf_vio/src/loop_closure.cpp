@@ -2,6 +2,7 @@
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <limits>
 #include <set>
 #include <Eigen/Dense>
 #include <tf_conversions/tf_eigen.h>
@@ -44,6 +45,29 @@ namespace msckf_vio{
 		return (index != std::string::npos);
 	}
 
+	// Loads the vocabulary. A binary vocabulary which is missing or
+	// cannot be mapped is replaced by the text vocabulary of the same
+	// name. Nothing is written, since the package folder is usually
+	// read-only once installed; vocabulary_converter creates the file.
+	bool loadVocabulary(ORBVocabulary* pVocabulary, const std::string &strVocFile)
+	{
+		if (has_suffix(strVocFile, ".txt"))
+			return pVocabulary->loadFromTextFile(strVocFile);
+		if (pVocabulary->loadFromBinaryFile(strVocFile))
+			return true;
+
+		std::size_t dot = strVocFile.rfind('.');
+		if (dot == std::string::npos || strVocFile.find('/', dot) != std::string::npos)
+			dot = strVocFile.size();
+		const std::string strTextFile = strVocFile.substr(0, dot) + ".txt";
+		ROS_WARN("Cannot map the vocabulary %s, parsing %s instead. "
+			"Run \"rosrun msckf_vio vocabulary_converter %s %s\" "
+			"to create it and skip the parsing.",
+			strVocFile.c_str(), strTextFile.c_str(),
+			strTextFile.c_str(), strVocFile.c_str());
+		return pVocabulary->loadFromTextFile(strTextFile);
+	}
+
 	bool loop_closure::createRosIO() {
 		pose_pub = nh.advertise<nav_msgs::Odometry>(
 			"correct_pose", 3);
@@ -62,80 +86,117 @@ namespace msckf_vio{
     								const sensor_msgs::ImageConstPtr& cam1_img,
     								const nav_msgs::Odometry::ConstPtr& odom_msg)
 	{
+		// Only the msgs are referenced here. The ORB extraction
+		// and the keyframes are left to the frame processing thread.
+		FrameData frameData;
+		frameData.cam0_img = cv_bridge::toCvShare(cam0_img);
+		frameData.cam1_img = cv_bridge::toCvShare(cam1_img);
+		frameData.timestamp = cam0_img->header.stamp.toSec();
 
-			// Get the current image.
-		cam0_curr_img_ptr = cv_bridge::toCvShare(cam0_img);
-		cam1_curr_img_ptr = cv_bridge::toCvShare(cam1_img);
-				
-		cam0_img_input = cam0_curr_img_ptr->image;
-		cam1_img_input = cam1_curr_img_ptr->image;
-		timestamp = cam0_img->header.stamp.toSec();
-		updateImg(cam0_img_input,cam1_img_input,timestamp);
-
-		// ROS_INFO("=====================MileStone 1======================");
 		//获得Msckf算出的位姿，设定Frame Pose
 		//msg.pose.pose.orientation---->quaternion---->Rotation Matrix
 		//msg.pose.pose.translation.x/y/z ---->Translation Matrix
-		Eigen::Isometry3d T_b_w;
 		Eigen::Quaterniond q (	odom_msg->pose.pose.orientation.w,
 								odom_msg->pose.pose.orientation.x,
 								odom_msg->pose.pose.orientation.y,
 								odom_msg->pose.pose.orientation.z);
-		Eigen::Translation3d t(	odom_msg->pose.pose.position.x,
-							 	odom_msg->pose.pose.position.y,
-								odom_msg->pose.pose.position.z);
 
 		Eigen::Matrix3d R = q.toRotationMatrix(); 
 		Eigen::Matrix4d T;
-		cv::Mat T_c_w(4,4,CV_32F);
 		T   << 	R(0,0),R(0,1),R(0,2),odom_msg->pose.pose.position.x,
 				R(1,0),R(1,1),R(1,2),odom_msg->pose.pose.position.y,
 				R(2,0),R(2,1),R(2,2),odom_msg->pose.pose.position.z,
 				0,     0,     0,     1;
-		T_c_w = converter.toCvMat(T);
-
-		// ROS_INFO("=====================MileStone 2======================");
+		frameData.T_c_w = converter.toCvMat(T);
 
-		tf::poseMsgToEigen(odom_msg->pose.pose,T_b_w); //得到Msckf 算出的位姿　用于构造KF　odom_msg.pose.pose－> T_b_w;
-		// ROS_INFO("=====================MileStone 3======================");
+		// Skip the frames which are not keyframe candidates before
+		// the ORB extraction, which is the most of the cost.
+		const Eigen::Vector3d t(odom_msg->pose.pose.position.x,
+								odom_msg->pose.pose.position.y,
+								odom_msg->pose.pose.position.z);
+		if (mIntakePolicy == KEYFRAME_CANDIDATES &&
+			!isKeyFrameCandidate(frameData, R, t))
+			return;
 
-		// T_c_w = converter.toCvMat(T_b_w);
-	
-		createFrame(imgQueue.back());
+		if (!frameDataQueue.push(frameData))
+			ROS_WARN_THROTTLE(5.0, "Loop closure is behind, %lu frames dropped...",
+				static_cast<unsigned long>(frameDataQueue.droppedNumber()));
+		return;
+	}
 
-		// ROS_INFO("=====================MileStone 4======================");
+	bool loop_closure::isKeyFrameCandidate(const FrameData& frameData,
+		const Eigen::Matrix3d& R, const Eigen::Vector3d& t)
+	{
+		++mFramesSinceCandidate;
+		if (mFramesSinceCandidate < mMinFrames ||
+			frameData.timestamp-mLastCandidateTime < mMinCandidateInterval)
+			return false;
+
+		const double translation = (t-mLastCandidatePosition).norm();
+		const double rotation = Eigen::AngleAxisd(
+			mLastCandidateRotation.transpose()*R).angle();
+		if (translation < mCandidateTranslationThreshold &&
+			rotation < mCandidateRotationThreshold &&
+			mFramesSinceCandidate < mMaxFrames)
+			return false;
+
+		mLastCandidateTime = frameData.timestamp;
+		mLastCandidateRotation = R;
+		mLastCandidatePosition = t;
+		mFramesSinceCandidate = 0;
+		return true;
+	}
 
-		frameQueue.back().SetPose(T_c_w);
+	void loop_closure::ProcessFrames()
+	{
+		FrameData frameData;
+		while (frameDataQueue.pop(frameData))
+			processFrame(frameData);
+		return;
+	}
 
-		// ROS_INFO("=====================MileStone 5======================");
+	void loop_closure::processFrame(const FrameData& frameData)
+	{
+		createFrame(frameData);
+		newFrame.SetPose(frameData.T_c_w);
 
 		if (!mpKeyFrameDatabase->getKFDB().size())
 		{
-			// ROS_INFO("=====================Checkpoint 1======================");
 			KFInitialization();
 		}
 		else
 		{
-			// ROS_INFO("=====================Checkpoint 2======================");
 			creatKF();
 		}
-		// cout << "cam timestamp=" << timestamp << endl;
-		// cout << "pose timestamp=" <<  odom_msg->header.stamp.toSec() << endl;
-  		// cout << "Position-> x: " << odom_msg->pose.pose.position.x << "y: " << odom_msg->pose.pose.position.y << "z: " << odom_msg->pose.pose.position.z << endl;
-  		// cout << "Orientation-> x: " << odom_msg->pose.pose.orientation.x << "y: " << odom_msg->pose.pose.orientation.y 
-		//   << "z: " << odom_msg->pose.pose.orientation.z << "w: " << odom_msg->pose.pose.orientation.w << endl;
-		
-		
 		return;
 	}
 
-	loop_closure::loop_closure(ros::NodeHandle& n):nh(n)
+	loop_closure::loop_closure(ros::NodeHandle& n):
+		mpExtractionPool(NULL),
+		mptFrameProcessing(NULL),
+		mIntakePolicy(LATEST),
+		mMinCandidateInterval(0.0),
+		mCandidateTranslationThreshold(0.0),
+		mCandidateRotationThreshold(0.0),
+		mLastCandidateTime(-1e9),
+		mFramesSinceCandidate(std::numeric_limits<int>::max()-1),
+		mLastCandidateRotation(Eigen::Matrix3d::Identity()),
+		mLastCandidatePosition(Eigen::Vector3d::Zero()),
+		nh(n)
 	{
 		return;
 	}
 
 	loop_closure::~loop_closure() 
 	{
+		// Let the frame processing thread finish the frame at hand.
+		frameDataQueue.close();
+		if (mptFrameProcessing)
+		{
+			mptFrameProcessing->join();
+			delete mptFrameProcessing;
+		}
+		delete mpExtractionPool;
 		destroyAllWindows();
 		return;
 	}
@@ -152,7 +213,6 @@ namespace msckf_vio{
 			cerr << "打不开设置文件 :  " << strSettingPath << endl;
 			exit(-1);
 		}
-		imgQueue.clear();
 		cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);//读取配置文件
 		//【1】------------------ 相机内参数矩阵 K------------------------
 	    //     |fx  0   cx|
@@ -234,6 +294,16 @@ namespace msckf_vio{
 
         mpORBextractorLeft = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
         mpORBextractorRight = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
+
+		// The workers are started once, and run both the images and
+		// the cells of each. The frame processing thread is a worker too.
+		int nExtractionWorkers;
+		nh.param<int>("orb/worker_num", nExtractionWorkers,
+			std::max(static_cast<int>(thread::hardware_concurrency())-1, 1));
+		mpExtractionPool = new WorkerPool(std::max(nExtractionWorkers, 0));
+		mpORBextractorLeft->SetWorkerPool(mpExtractionPool);
+		mpORBextractorRight->SetWorkerPool(mpExtractionPool);
+		ROS_INFO("ORB extraction workers: %d", nExtractionWorkers);
         oe = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
 
     	
@@ -256,15 +326,10 @@ namespace msckf_vio{
 		// 1. 创建字典 mpVocabulary = new ORBVocabulary()；并从文件中载入字典=========================
 	    mpVocabulary = new ORBVocabulary();//关键帧字典数据库
 	    
-		//bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
-	    bool bVocLoad = false; //  bool量  打开字典flag
-	    
-		if (has_suffix(strVocFile, ".txt"))//
-		  bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);//txt格式打开  
-		
-		// -> 指针对象 的 解引用和 访问成员函数  相当于  (*mpVocabulary).loadFromTextFile(strVocFile);
-	    // else
-		//   bVocLoad = mpVocabulary->loadFromBinaryFile(strVocFile);//bin格式打开
+		// The binary vocabulary is created by vocabulary_converter and
+		// memory-mapped, so it loads at once and the pages are shared
+		nh.param<string>("vocabulary_file", strVocFile, strVocFile);
+	    bool bVocLoad = loadVocabulary(mpVocabulary, strVocFile); //  bool量  打开字典flag
 	    if(!bVocLoad)
 	    {
 		cerr << "字典路径错误 " << endl;
@@ -300,8 +365,38 @@ namespace msckf_vio{
 		mpLocalMapper->SetLoopCloser(mpLoopCloser);
 		mpLoopCloser->SetLocalMapper(mpLocalMapper);
 
+		// Intake of the frames. The queue is bounded, so that the
+		// memory does not grow if the processing falls behind.
+		int queueSize;
+		string intakePolicy;
+		nh.param<int>("intake/queue_size", queueSize, 2);
+		nh.param<string>("intake/policy", intakePolicy, string("latest"));
+		nh.param<double>("intake/min_candidate_interval",
+			mMinCandidateInterval, 0.0);
+		nh.param<double>("intake/translation_threshold",
+			mCandidateTranslationThreshold, 0.2);
+		nh.param<double>("intake/rotation_threshold",
+			mCandidateRotationThreshold, 0.2);
+		nh.param<int>("intake/min_frames", mMinFrames, mMinFrames);
+		nh.param<int>("intake/max_frames", mMaxFrames, mMaxFrames);
+		frameDataQueue.setCapacity(std::max(queueSize, 1));
+		if (intakePolicy == "keyframe")
+			mIntakePolicy = KEYFRAME_CANDIDATES;
+		else if (intakePolicy == "latest")
+			mIntakePolicy = LATEST;
+		else
+			ROS_WARN("Unknown intake policy %s, using latest...", intakePolicy.c_str());
+
+		mptFrameProcessing = new thread(&msckf_vio::loop_closure::ProcessFrames, this);
+
 		//////////////////////////////////////////////////////////
 		if (!createRosIO()) return false;
+ 		ROS_INFO("intake queue size: %d", queueSize);
+ 		ROS_INFO("intake policy: %s", intakePolicy.c_str());
+ 		ROS_INFO("intake min candidate interval: %f", mMinCandidateInterval);
+ 		ROS_INFO("intake translation threshold: %f", mCandidateTranslationThreshold);
+ 		ROS_INFO("intake rotation threshold: %f", mCandidateRotationThreshold);
+ 		ROS_INFO("intake min/max frames: %d, %d", mMinFrames, mMaxFrames);
  		ROS_INFO("===========================================");
  		ROS_INFO("Finish Initializing Loop_Closure");
 		ROS_INFO("===========================================");
@@ -309,28 +404,27 @@ namespace msckf_vio{
 		return true;
 	}
 
-    loop_closure::loop_closure()
+    loop_closure::loop_closure():
+		mpExtractionPool(NULL),
+		mptFrameProcessing(NULL),
+		mIntakePolicy(LATEST),
+		mMinCandidateInterval(0.0),
+		mCandidateTranslationThreshold(0.0),
+		mCandidateRotationThreshold(0.0),
+		mLastCandidateTime(-1e9),
+		mFramesSinceCandidate(std::numeric_limits<int>::max()-1),
+		mLastCandidateRotation(Eigen::Matrix3d::Identity()),
+		mLastCandidatePosition(Eigen::Vector3d::Zero())
     {
         return;
     }
 
-    void loop_closure::updateImg(Mat img0, Mat img1, double timestamp){
-
-		imgQueue.push_back(make_pair(make_pair(img0, img1), timestamp));
-		// ROS_INFO("===========================================");
- 		// ROS_INFO("Im at updateImg!!!!!!!!!!!!!!!!!!!!!!!!!!");
-		// ROS_INFO("===========================================");
-        
-		return;
-    }
-
-    void loop_closure::createFrame(pair<pair<Mat, Mat>, double> imgData)
+    void loop_closure::createFrame(const FrameData& frameData)
     {
 		// unique_lock<mutex> lock(globalLock);
 		// unique_lock<mutex> lock2(loopLock);
-        newFrame = Frame(imgData.first.first, imgData.first.second, imgData.second, 
-			mpORBextractorLeft, mpORBextractorRight,mpVocabulary,mK,mDistCoef,mbf,mThDepth); 
-		frameQueue.push_back(newFrame);
+        newFrame = Frame(frameData.cam0_img->image, frameData.cam1_img->image, frameData.timestamp, 
+			mpORBextractorLeft, mpORBextractorRight,mpVocabulary,mK,mDistCoef,mbf,mThDepth,mpExtractionPool);
 		// ROS_INFO("===========================================");
  		// ROS_INFO("Im at CreateFrame!!!!!!!!!!!!!!!!!!!!!!!!!!");
 		// ROS_INFO("===========================================");
@@ -339,13 +433,13 @@ namespace msckf_vio{
 
     void loop_closure::KFInitialization()
 	{
-	    if(frameQueue.back().N>500)
+	    if(newFrame.N>500)
   		// 【0】找到的关键点个数 大于 500 时进行初始化将当前帧构建为第一个关键帧
 	    {
 		// Set Frame pose to the origin
        	//【1】 初始化 第一帧为世界坐标系原点 变换矩阵 对角单位阵 R = eye(3,3)   t=zero(3,1)
 		// 步骤1：设定初始位姿
-		frameQueue.back().SetPose(cv::Mat::eye(4,4,CV_32F));
+		newFrame.SetPose(cv::Mat::eye(4,4,CV_32F));
 
        	// 【2】创建第一帧为关键帧  Create KeyFrame  普通帧      地图       关键帧数据库
 		// 加入地图 加入关键帧数据库
@@ -355,7 +449,7 @@ namespace msckf_vio{
 		// KeyFrame里有一个mpMap，Tracking里有一个mpMap，而KeyFrame里的mpMap都指向Tracking里的这个mpMap
 		// KeyFrame里有一个mpKeyFrameDB，Tracking里有一个mpKeyFrameDB，而KeyFrame里的mpMap都指向Tracking里的这个mpKeyFrameDB
 		
-		KeyFrame* pKFini = new KeyFrame(frameQueue.back(),mpMap,mpKeyFrameDatabase);
+		KeyFrame* pKFini = new KeyFrame(newFrame,mpMap,mpKeyFrameDatabase);
 		// 地图添加第一帧关键帧 关键帧存入地图关键帧set集合里 Insert KeyFrame in the map
       
 		// KeyFrame中包含了地图、反过来地图中也包含了KeyFrame，相互包含
@@ -365,13 +459,13 @@ namespace msckf_vio{
 		// Create MapPoints and asscoiate to KeyFrame
     	// 【3】创建地图点 并关联到 相应的关键帧  关键帧也添加地图点  地图添加地图点 地图点描述子 距离
 		// 步骤4：为每个特征点构造MapPoint		
-		for(int i=0; i<frameQueue.back().N;i++)// 该帧的每一个关键点
+		for(int i=0; i<newFrame.N;i++)// 该帧的每一个关键点
 		{
-		    float z = frameQueue.back().mvDepth[i];// 关键点对应的深度值  双目和 深度相机有深度值
+		    float z = newFrame.mvDepth[i];// 关键点对应的深度值  双目和 深度相机有深度值
 		    if(z>0)// 有效深度 
 		    {
 		   	// 步骤4.1：通过反投影得到该特征点的3D坐标  
-			cv::Mat x3D = frameQueue.back().UnprojectStereo(i);// 投影到 在世界坐标系下的三维点坐标
+			cv::Mat x3D = newFrame.UnprojectStereo(i);// 投影到 在世界坐标系下的三维点坐标
 		   	// 步骤4.2：将3D点构造为MapPoint	
 			// 每个 具有有效深度 关键点 对应的3d点 转换到 地图点对象
 			MapPoint* pNewMP = new MapPoint(x3D,pKFini,mpMap);
@@ -394,7 +488,7 @@ namespace msckf_vio{
 			 pKFini->AddMapPoint(pNewMP,i);
 		   	// 步骤4.6：将该MapPoint添加到当前帧的mvpMapPoints中
                         // 为当前Frame的特征点与MapPoint之间建立索引
-			frameQueue.back().mvpMapPoints[i]=pNewMP;//当前帧 添加地图点
+			newFrame.mvpMapPoints[i]=pNewMP;//当前帧 添加地图点
 		    }
 		}
 		// cout << "新地图创建成功 new map ,具有 地图点数 : " << mpMap->MapPointsInMap() << "  地图点 points" << endl;
@@ -434,7 +528,7 @@ namespace msckf_vio{
 	    // 关键帧 加入到地图 加入到 关键帧数据库
 	    
 // 步骤1：将当前帧构造成关键帧	    
-	    KeyFrame* pKF = new KeyFrame(frameQueue.back(),mpMap,mpKeyFrameDatabase);
+	    KeyFrame* pKF = new KeyFrame(newFrame,mpMap,mpKeyFrameDatabase);
 	    
 // 步骤2：将当前关键帧设置为当前帧的参考关键帧
     // 在UpdateLocalKeyFrames函数中会将与当前关键帧共视程度最高的关键帧设定为当前帧的参考关键帧
@@ -446,7 +540,7 @@ namespace msckf_vio{
 	    // if(mSensor != System::MONOCULAR)
 	    
 	      // 根据Tcw计算mRcw、mtcw和mRwc、mOw
-		frameQueue.back().UpdatePoseMatrices();
+		newFrame.UpdatePoseMatrices();
 
 		// We sort points by the measured depth by the stereo/RGBD sensor.
 		// We create all those MapPoints whose depth < mThDepth.
@@ -455,10 +549,10 @@ namespace msckf_vio{
      // 步骤3.1：得到当前帧深度小于阈值的特征点
                // 创建新的MapPoint, depth < mThDepth
 		vector<pair<float,int> > vDepthIdx;
-		vDepthIdx.reserve(frameQueue.back().N);
-		for(int i=0; i<frameQueue.back().N; i++)
+		vDepthIdx.reserve(newFrame.N);
+		for(int i=0; i<newFrame.N; i++)
 		{
-		    float z = frameQueue.back().mvDepth[i];
+		    float z = newFrame.mvDepth[i];
 		    if(z>0)
 		    {
 			vDepthIdx.push_back(make_pair(z,i));
@@ -477,18 +571,18 @@ namespace msckf_vio{
 
 			bool bCreateNew = false;
 
-			MapPoint* pMP = frameQueue.back().mvpMapPoints[i];
+			MapPoint* pMP = newFrame.mvpMapPoints[i];
 			if(!pMP)
 			    bCreateNew = true;
 			else if(pMP->Observations()<1)
 			{
 			    bCreateNew = true;
-			    frameQueue.back().mvpMapPoints[i] = static_cast<MapPoint*>(NULL);
+			    newFrame.mvpMapPoints[i] = static_cast<MapPoint*>(NULL);
 			}
 
 			if(bCreateNew)
 			{
-			    cv::Mat x3D = frameQueue.back().UnprojectStereo(i);
+			    cv::Mat x3D = newFrame.UnprojectStereo(i);
 			    MapPoint* pNewMP = new MapPoint(x3D,pKF,mpMap);
 			    // 这些添加属性的操作是每次创建MapPoint后都要做的
 			    pNewMP->AddObservation(pKF,i);
@@ -497,7 +591,7 @@ namespace msckf_vio{
 			    pNewMP->UpdateNormalAndDepth();
 			    mpMap->AddMapPoint(pNewMP);
 
-			    frameQueue.back().mvpMapPoints[i]=pNewMP;
+			    newFrame.mvpMapPoints[i]=pNewMP;
 			    nPoints++;
 			}
 			else
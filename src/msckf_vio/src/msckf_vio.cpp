@@ -39,10 +39,6 @@ double IMUState::acc_noise = 0.01;
 double IMUState::gyro_bias_noise = 0.001;
 double IMUState::acc_bias_noise = 0.01;
 Vector3d IMUState::gravity = Vector3d(0, 0, -GRAVITY_ACCELERATION);
-Isometry3d IMUState::T_imu_body = Isometry3d::Identity();
-
-// Static member variables in CAMState class.
-Isometry3d CAMState::T_cam0_cam1 = Isometry3d::Identity();
 
 // Static member variables in Feature class.
 FeatureIDType Feature::next_id = 0;
@@ -56,33 +52,69 @@ cv::Mat T_o_c(4,4,CV_32F);
 MsckfVio::MsckfVio(ros::NodeHandle& pnh):
   is_gravity_set(false),
   is_first_img(true),
-  nh(pnh) {
-    visual_tools_.reset(new moveit_visual_tools::MoveItVisualTools("base_frame","/moveit_visual_markers"));
+  nh_ptr(new ros::NodeHandle(pnh)),
+  param_reader(pnh),
+  publish_imu_rate_odom(false),
+  is_imu_rate_state_set(false),
+  imu_rate_gyro(Vector3d::Zero()) {
+  return;
+}
+
+MsckfVio::MsckfVio(const utils::ParameterReader& params):
+  is_gravity_set(false),
+  is_first_img(true),
+  param_reader(params),
+  publish_imu_rate_odom(false),
+  is_imu_rate_state_set(false),
+  imu_rate_gyro(Vector3d::Zero()) {
   return;
 }
 
+MsckfVio::~MsckfVio() {
+  // Stop the imu rate thread before its state is destroyed.
+  if (imu_rate_spinner) imu_rate_spinner->stop();
+  imu_rate_sub.shutdown();
+}
+
 bool MsckfVio::loadParameters() {
   // Frame id
-  nh.param<string>("fixed_frame_id", fixed_frame_id, "world");
-  nh.param<string>("child_frame_id", child_frame_id, "robot");
-  nh.param<bool>("publish_tf", publish_tf, true);
-  nh.param<double>("frame_rate", frame_rate, 40.0);
-  nh.param<double>("position_std_threshold", position_std_threshold, 8.0);
-
-  nh.param<double>("rotation_threshold", rotation_threshold, 0.2618);
-  nh.param<double>("translation_threshold", translation_threshold, 0.4);
-  nh.param<double>("tracking_rate_threshold", tracking_rate_threshold, 0.5);
+  param_reader.param<string>("fixed_frame_id", fixed_frame_id, "world");
+  param_reader.param<string>("child_frame_id", child_frame_id, "robot");
+  param_reader.param<bool>("publish_tf", publish_tf, true);
+  param_reader.param<double>("frame_rate", frame_rate, 40.0);
+  param_reader.param<double>("position_std_threshold", position_std_threshold, 8.0);
+
+  // Odometry at the imu rate besides the one of each update.
+  param_reader.param<bool>("imu_rate_odom", publish_imu_rate_odom, false);
+
+  // Duration of the poses kept for the loop closure corrections.
+  double pose_history_duration;
+  param_reader.param<double>("pose_history_duration",
+      pose_history_duration, 10.0);
+  pose_history.setDuration(pose_history_duration);
+
+  // Decimation and size of the published trajectory.
+  param_reader.param<double>("trajectory/min_distance",
+      trajectory_min_distance, 0.05);
+  param_reader.param<double>("trajectory/min_angle",
+      trajectory_min_angle, 0.05);
+  param_reader.param<int>("trajectory/max_size",
+      trajectory_max_size, 10000);
+
+  param_reader.param<double>("rotation_threshold", rotation_threshold, 0.2618);
+  param_reader.param<double>("translation_threshold", translation_threshold, 0.4);
+  param_reader.param<double>("tracking_rate_threshold", tracking_rate_threshold, 0.5);
 
   // Feature optimization parameters
-  nh.param<double>("feature/config/translation_threshold",
+  param_reader.param<double>("feature/config/translation_threshold",
       Feature::optimization_config.translation_threshold, 0.2);
 
   // Noise related parameters
-  nh.param<double>("noise/gyro", IMUState::gyro_noise, 0.001);
-  nh.param<double>("noise/acc", IMUState::acc_noise, 0.01);
-  nh.param<double>("noise/gyro_bias", IMUState::gyro_bias_noise, 0.001);
-  nh.param<double>("noise/acc_bias", IMUState::acc_bias_noise, 0.01);
-  nh.param<double>("noise/feature", Feature::observation_noise, 0.01);
+  param_reader.param<double>("noise/gyro", IMUState::gyro_noise, 0.001);
+  param_reader.param<double>("noise/acc", IMUState::acc_noise, 0.01);
+  param_reader.param<double>("noise/gyro_bias", IMUState::gyro_bias_noise, 0.001);
+  param_reader.param<double>("noise/acc_bias", IMUState::acc_bias_noise, 0.01);
+  param_reader.param<double>("noise/feature", Feature::observation_noise, 0.01);
 
   // Use variance instead of standard deviation.
   IMUState::gyro_noise *= IMUState::gyro_noise;
@@ -96,28 +128,28 @@ bool MsckfVio::loadParameters() {
   // implicitly. But the initial velocity and bias can be
   // set by parameters.
   // TODO: is it reasonable to set the initial bias to 0?
-  nh.param<double>("initial_state/velocity/x",
+  param_reader.param<double>("initial_state/velocity/x",
       state_server.imu_state.velocity(0), 0.0);
-  nh.param<double>("initial_state/velocity/y",
+  param_reader.param<double>("initial_state/velocity/y",
       state_server.imu_state.velocity(1), 0.0);
-  nh.param<double>("initial_state/velocity/z",
+  param_reader.param<double>("initial_state/velocity/z",
       state_server.imu_state.velocity(2), 0.0);
 
   // The initial covariance of orientation and position can be
   // set to 0. But for velocity, bias and extrinsic parameters,
   // there should be nontrivial uncertainty.
   double gyro_bias_cov, acc_bias_cov, velocity_cov;
-  nh.param<double>("initial_covariance/velocity",
+  param_reader.param<double>("initial_covariance/velocity",
       velocity_cov, 0.25);
-  nh.param<double>("initial_covariance/gyro_bias",
+  param_reader.param<double>("initial_covariance/gyro_bias",
       gyro_bias_cov, 1e-4);
-  nh.param<double>("initial_covariance/acc_bias",
+  param_reader.param<double>("initial_covariance/acc_bias",
       acc_bias_cov, 1e-2);
 
   double extrinsic_rotation_cov, extrinsic_translation_cov;
-  nh.param<double>("initial_covariance/extrinsic_rotation_cov",
+  param_reader.param<double>("initial_covariance/extrinsic_rotation_cov",
       extrinsic_rotation_cov, 3.0462e-4);
-  nh.param<double>("initial_covariance/extrinsic_translation_cov",
+  param_reader.param<double>("initial_covariance/extrinsic_translation_cov",
       extrinsic_translation_cov, 1e-4);
 
   state_server.state_cov = MatrixXd::Zero(21, 21);
@@ -132,19 +164,23 @@ bool MsckfVio::loadParameters() {
   for (int i = 18; i < 21; ++i)
     state_server.state_cov(i, i) = extrinsic_translation_cov;
 
-  // Transformation offsets between the frames involved.
-  Isometry3d T_imu_cam0 = utils::getTransformEigen(nh, "cam0/T_cam_imu");
+  // Transformation offsets between the frames involved,
+  // unless the calibration is shared by the caller.
+  if (!calibration) calibration = utils::loadCalibration(param_reader);
+  const Isometry3d& T_imu_cam0 = calibration->T_imu_cam0;
   Isometry3d T_cam0_imu = T_imu_cam0.inverse();
 
   state_server.imu_state.R_imu_cam0 = T_cam0_imu.linear().transpose();
   state_server.imu_state.t_cam0_imu = T_cam0_imu.translation();
-  CAMState::T_cam0_cam1 =
-    utils::getTransformEigen(nh, "cam1/T_cn_cnm1");
-  IMUState::T_imu_body =
-    utils::getTransformEigen(nh, "T_imu_body").inverse();
 
   // Maximum number of camera states to be stored
-  nh.param<int>("max_cam_state_size", max_cam_state_size, 30);
+  param_reader.param<int>("max_cam_state_size", max_cam_state_size, 30);
+
+  // Chrome trace of the stages of the filter, disabled if empty.
+  string trace_file;
+  param_reader.param<string>("profiling/trace_file", trace_file, string(""));
+  if (!trace_file.empty() && !profiler.openTrace(trace_file))
+    ROS_WARN("Cannot open the trace file %s", trace_file.c_str());
 
   ROS_INFO("===========================================");
   ROS_INFO("fixed frame id: %s", fixed_frame_id.c_str());
@@ -152,6 +188,11 @@ bool MsckfVio::loadParameters() {
   ROS_INFO("publish tf: %d", publish_tf);
   ROS_INFO("frame rate: %f", frame_rate);
   ROS_INFO("position std threshold: %f", position_std_threshold);
+  ROS_INFO("imu rate odom: %d", publish_imu_rate_odom);
+  ROS_INFO("pose history duration: %f", pose_history_duration);
+  ROS_INFO("trajectory min distance: %f", trajectory_min_distance);
+  ROS_INFO("trajectory min angle: %f", trajectory_min_angle);
+  ROS_INFO("trajectory max size: %d", trajectory_max_size);
   ROS_INFO("Keyframe rotation threshold: %f", rotation_threshold);
   ROS_INFO("Keyframe translation threshold: %f", translation_threshold);
   ROS_INFO("Keyframe tracking rate threshold: %f", tracking_rate_threshold);
@@ -176,11 +217,17 @@ bool MsckfVio::loadParameters() {
   cout << T_imu_cam0.translation().transpose() << endl;
 
   ROS_INFO("max camera state #: %d", max_cam_state_size);
+  ROS_INFO("trace file: %s", trace_file.c_str());
   ROS_INFO("===========================================");
   return true;
 }
 
 bool MsckfVio::createRosIO() {
+  ros::NodeHandle& nh = *nh_ptr;
+  visual_tools_.reset(new moveit_visual_tools::MoveItVisualTools(
+        "base_frame", "/moveit_visual_markers"));
+  tf_pub_ptr.reset(new tf::TransformBroadcaster());
+
   odom_pub = nh.advertise<nav_msgs::Odometry>("odom", 10);
   feature_pub = nh.advertise<sensor_msgs::PointCloud2>(
       "feature_point_cloud", 10);
@@ -204,11 +251,119 @@ bool MsckfVio::createRosIO() {
 
   self_odom_sub  = nh.subscribe<nav_msgs::Odometry>("odom", 10, &MsckfVio::odomCallback, this);
 
-  path_pub = nh.advertise<nav_msgs::Path>("trajectory",10);
+  path_pub = nh.advertise<nav_msgs::Path>("trajectory", 10);
+  full_path_pub = nh.advertise<nav_msgs::Path>(
+      "full_trajectory", 1, true);
+  full_path_srv = nh.advertiseService("publish_full_trajectory",
+      &MsckfVio::fullPathCallback, this);
+
+  diagnostics_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>(
+      "/diagnostics", 1);
+  diagnostics_timer = nh.createWallTimer(ros::WallDuration(1.0),
+      &MsckfVio::diagnosticsCallback, this);
+
+  // The imu msgs for the imu rate odometry are served by a
+  // queue and a thread of their own.
+  if (publish_imu_rate_odom) {
+    imu_rate_odom_pub = nh.advertise<nav_msgs::Odometry>(
+        "imu_rate_odom", 100);
+    ros::SubscribeOptions options =
+      ros::SubscribeOptions::create<sensor_msgs::Imu>("imu", 100,
+          boost::bind(&MsckfVio::imuRateCallback, this, _1),
+          ros::VoidConstPtr(), &imu_rate_queue);
+    options.transport_hints = ros::TransportHints().tcpNoDelay();
+    imu_rate_sub = nh.subscribe(options);
+    imu_rate_spinner.reset(new ros::AsyncSpinner(1, &imu_rate_queue));
+    imu_rate_spinner->start();
+  }
+
+  return true;
+}
+
+void MsckfVio::imuRateCallback(
+    const sensor_msgs::ImuConstPtr& msg) {
+  nav_msgs::Odometry odom_msg;
+  {
+    std::lock_guard<std::mutex> lock(imu_rate_mutex);
+    imu_rate_buffer.push_back(*msg);
+
+    // Bound the buffer, which is only trimmed by the filter
+    // updates, in case they stop, e.g. with no features.
+    if (imu_rate_buffer.size() > 1000) imu_rate_buffer.pop_front();
+
+    if (!is_imu_rate_state_set) return;
+    if (!propagateImuRateState(*msg)) return;
+
+    // Convert the IMU frame to the body frame.
+    Eigen::Isometry3d T_i_w = Eigen::Isometry3d::Identity();
+    T_i_w.linear() = quaternionToRotation(
+        imu_rate_state.orientation).transpose();
+    T_i_w.translation() = imu_rate_state.position;
+
+    const Eigen::Isometry3d& T_imu_body = calibration->T_imu_body;
+    Eigen::Isometry3d T_b_w = T_imu_body * T_i_w * T_imu_body.inverse();
+    Eigen::Vector3d body_velocity =
+      T_imu_body.linear() * imu_rate_state.velocity;
+    Eigen::Vector3d body_angular_velocity =
+      T_imu_body.linear() * imu_rate_gyro;
+
+    odom_msg.header.stamp = msg->header.stamp;
+    odom_msg.header.frame_id = fixed_frame_id;
+    odom_msg.child_frame_id = child_frame_id;
+    tf::poseEigenToMsg(T_b_w, odom_msg.pose.pose);
+    tf::vectorEigenToMsg(body_velocity, odom_msg.twist.twist.linear);
+    tf::vectorEigenToMsg(body_angular_velocity,
+        odom_msg.twist.twist.angular);
+  }
+
+  imu_rate_odom_pub.publish(odom_msg);
+  return;
+}
+
+bool MsckfVio::propagateImuRateState(const sensor_msgs::Imu& msg) {
+  const double imu_time = msg.header.stamp.toSec();
+  if (imu_time <= imu_rate_state.time) return false;
 
+  Vector3d m_gyro, m_acc;
+  tf::vectorMsgToEigen(msg.angular_velocity, m_gyro);
+  tf::vectorMsgToEigen(msg.linear_acceleration, m_acc);
+  imu_rate_gyro = m_gyro - imu_rate_state.gyro_bias;
+  const Vector3d acc = m_acc - imu_rate_state.acc_bias;
+
+  predictNewState(imu_time-imu_rate_state.time, imu_rate_gyro, acc,
+      imu_rate_state.orientation, imu_rate_state.velocity,
+      imu_rate_state.position);
+  imu_rate_state.time = imu_time;
   return true;
 }
 
+void MsckfVio::resetImuRateState() {
+  std::lock_guard<std::mutex> lock(imu_rate_mutex);
+  imu_rate_state = state_server.imu_state;
+  is_imu_rate_state_set = true;
+
+  // Drop the imu msgs used by the filter already, and
+  // propagate the new state with the rest of them.
+  while (!imu_rate_buffer.empty() &&
+      imu_rate_buffer.front().header.stamp.toSec() <= imu_rate_state.time)
+    imu_rate_buffer.pop_front();
+  for (const auto& msg : imu_rate_buffer)
+    propagateImuRateState(msg);
+  return;
+}
+
+void MsckfVio::diagnosticsCallback(const ros::WallTimerEvent& event) {
+  const vector<profiling::StageStatistics> statistics =
+    profiler.collect();
+  if (statistics.empty()) return;
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  utils::getDiagnostics(ros::this_node::getName(),
+      statistics, diagnostics);
+  diagnostics_pub.publish(diagnostics);
+  return;
+}
+
 bool MsckfVio::initialize() {
   if (!loadParameters()) return false;
   ROS_INFO("Finish loading ROS parameters...");
@@ -233,8 +388,10 @@ bool MsckfVio::initialize() {
       boost::math::quantile(chi_squared_dist, 0.05);
   }
 
-  if (!createRosIO()) return false;
-  ROS_INFO("Finish creating ROS IO...");
+  if (nh_ptr) {
+    if (!createRosIO()) return false;
+    ROS_INFO("Finish creating ROS IO...");
+  }
 
   // Initialize the transformation matrix between the current 
   // frame and loop-closed frame
@@ -330,20 +487,22 @@ bool MsckfVio::resetCallback(
 
   // Remove all existing camera states.
   state_server.cam_states.clear();
+  pose_history.clear();
+  trajectory.clear();
 
   // Reset the state covariance.
   double gyro_bias_cov, acc_bias_cov, velocity_cov;
-  nh.param<double>("initial_covariance/velocity",
+  param_reader.param<double>("initial_covariance/velocity",
       velocity_cov, 0.25);
-  nh.param<double>("initial_covariance/gyro_bias",
+  param_reader.param<double>("initial_covariance/gyro_bias",
       gyro_bias_cov, 1e-4);
-  nh.param<double>("initial_covariance/acc_bias",
+  param_reader.param<double>("initial_covariance/acc_bias",
       acc_bias_cov, 1e-2);
 
   double extrinsic_rotation_cov, extrinsic_translation_cov;
-  nh.param<double>("initial_covariance/extrinsic_rotation_cov",
+  param_reader.param<double>("initial_covariance/extrinsic_rotation_cov",
       extrinsic_rotation_cov, 3.0462e-4);
-  nh.param<double>("initial_covariance/extrinsic_translation_cov",
+  param_reader.param<double>("initial_covariance/extrinsic_translation_cov",
       extrinsic_translation_cov, 1e-4);
 
   state_server.state_cov = MatrixXd::Zero(21, 21);
@@ -363,12 +522,18 @@ bool MsckfVio::resetCallback(
 
   // Clear the IMU msg buffer.
   imu_msg_buffer.clear();
+  {
+    std::lock_guard<std::mutex> lock(imu_rate_mutex);
+    imu_rate_buffer.clear();
+    is_imu_rate_state_set = false;
+  }
 
   // Reset the starting flags.
   is_gravity_set = false;
   is_first_img = true;
 
   // Restart the subscribers.
+  ros::NodeHandle& nh = *nh_ptr;
   imu_sub = nh.subscribe("imu", 100,
       &MsckfVio::imuCallback, this);
   feature_sub = nh.subscribe("features", 40,
@@ -387,7 +552,6 @@ void MsckfVio::correctPoseCallback(
   
   Eigen::Isometry3d T_b_w;
   tf::poseMsgToEigen(pose_msg->pose.pose, T_b_w);
-  double corrected_frame_timestamp = pose_msg->header.stamp.toSec();
 
   Eigen::Quaterniond q (	pose_msg->pose.pose.orientation.w,
 							          	pose_msg->pose.pose.orientation.x,
@@ -409,8 +573,8 @@ void MsckfVio::correctPoseCallback(
 
   //////////////////////////////////////////////////////////
   //
-  // Find the frame with the same timestamp as  
-  // corrected_frame_timestamp from finalOdomMsgBuffer
+  // Find the pose at the time stamp of the corrected
+  // frame in the pose history
   //
   // Form the offset transformation matrix between the 
   // two frames
@@ -420,36 +584,15 @@ void MsckfVio::correctPoseCallback(
   //////////////////////////////////////////////////////////
 
 
-  nav_msgs::Odometry old_odom_msg;
-  int odom_loop_flag = 0;
-
-  for (int i = 0; i < finalOdomMsgBuffer.size(); i++) {
-    if (finalOdomMsgBuffer.at(i).header.stamp.toSec() == corrected_frame_timestamp) {
-      old_odom_msg = finalOdomMsgBuffer.at(i);
-    } else {
-      odom_loop_flag++;
-    }
-  }
-
-  if (odom_loop_flag == finalOdomMsgBuffer.size()) {
+  // The corrections refer to the time stamps of the images,
+  // at which the poses are published, so the lookup is
+  // usually exact.
+  Eigen::Isometry3d T_old;
+  if (!pose_history.interpolate(
+        pose_msg->header.stamp.toNSec(), T_old)) {
     ROS_INFO("NO COMMON FRAME IN BUFFER!!!----------------------------------");
   } else {
-    Eigen::Quaterniond q1 (	old_odom_msg.pose.pose.orientation.w,
-	  							          old_odom_msg.pose.pose.orientation.x,
-		  						          old_odom_msg.pose.pose.orientation.y,
-			  			          		old_odom_msg.pose.pose.orientation.z);
-	  Eigen::Translation3d t1(	old_odom_msg.pose.pose.position.x,
-		  				            	 	old_odom_msg.pose.pose.position.y,
-			  			            		old_odom_msg.pose.pose.position.z);
-
-	  Eigen::Matrix3d R1 = q1.toRotationMatrix(); 
-	  Eigen::Matrix4d T1;
-	  cv::Mat T_c_w1(4,4,CV_32F);
-	  T1   << 	R1(0,0),R1(0,1),R1(0,2),old_odom_msg.pose.pose.position.x,
-		  	      R1(1,0),R1(1,1),R1(1,2),old_odom_msg.pose.pose.position.y,
-		        	R1(2,0),R1(2,1),R1(2,2),old_odom_msg.pose.pose.position.z,
-		        	0,     0,     0,     1;
-	  T_c_w1 = toCvMat(T1);
+    cv::Mat T_c_w1 = toCvMat(T_old.matrix());
 
     T_o_c = T_c_w1.inv(DECOMP_SVD)*T_c_w;
     ROS_INFO("Successfully stored Transformation Matrix!!!------------------");
@@ -458,7 +601,7 @@ void MsckfVio::correctPoseCallback(
 }
 
 void MsckfVio::featureCallback(
-    const CameraMeasurementConstPtr& msg) {
+    const FeatureBatchConstPtr& msg) {
     
   // ROS_INFO("Triggered featureCallback!!!------------------");
   // Return if the gravity vector has not been set.
@@ -472,51 +615,54 @@ void MsckfVio::featureCallback(
     state_server.imu_state.time = msg->header.stamp.toSec();
   }
 
-  static double max_processing_time = 0.0;
+  MSCKF_VIO_PROFILE_SCOPE(profiler, "featureCallback");
   static int critical_time_cntr = 0;
   double processing_start_time = ros::Time::now().toSec();
 
   // ROS_INFO("Propagaing IMU!!!------------------");
   // Propogate the IMU state.
   // that are received before the image msg.
-  ros::Time start_time = ros::Time::now();
-  batchImuProcessing(msg->header.stamp.toSec());
-  double imu_processing_time = (
-      ros::Time::now()-start_time).toSec();
+  {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "batchImuProcessing");
+    batchImuProcessing(msg->header.stamp.toSec());
+  }
 
   // ROS_INFO("Augmenting State!!!------------------");
   // Augment the state vector.
-  start_time = ros::Time::now();
-  stateAugmentation(msg->header.stamp.toSec());
-  double state_augmentation_time = (
-      ros::Time::now()-start_time).toSec();
+  {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "stateAugmentation");
+    stateAugmentation(msg->header.stamp.toSec());
+  }
 
   // ROS_INFO("Adding new observations!!!------------------");
   // Add new observations for existing features or new
   // features in the map server.
-  start_time = ros::Time::now();
-  addFeatureObservations(msg);
-  double add_observations_time = (
-      ros::Time::now()-start_time).toSec();
+  {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "addFeatureObservations");
+    addFeatureObservations(msg);
+  }
 
   // ROS_INFO("Performing measurement update!!!------------------");
   // Perform measurement update if necessary.
-  start_time = ros::Time::now();
-  removeLostFeatures();
-  double remove_lost_features_time = (
-      ros::Time::now()-start_time).toSec();
+  {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "removeLostFeatures");
+    removeLostFeatures();
+  }
 
-  start_time = ros::Time::now();
-  pruneCamStateBuffer();
-  double prune_cam_states_time = (
-      ros::Time::now()-start_time).toSec();
+  {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "pruneCamStateBuffer");
+    pruneCamStateBuffer();
+  }
 
   // ROS_INFO("Going to publish the odom------------------");
   // Publish the odometry.
-  start_time = ros::Time::now();
-  publish(msg->header.stamp);
-  double publish_time = (
-      ros::Time::now()-start_time).toSec();
+  {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "publish");
+    publish(msg->header.stamp);
+  }
+
+  // Restart the imu rate odometry from the updated state.
+  if (publish_imu_rate_odom) resetImuRateState();
   // ROS_INFO("PUBLISHED THE ODOM!!!------------------");
 
 
@@ -550,18 +696,7 @@ void MsckfVio::featureCallback(
     ++critical_time_cntr;
     ROS_INFO("\033[1;31mTotal processing time %f/%d...\033[0m",
         processing_time, critical_time_cntr);
-    //printf("IMU processing time: %f/%f\n",
-    //    imu_processing_time, imu_processing_time/processing_time);
-    //printf("State augmentation time: %f/%f\n",
-    //    state_augmentation_time, state_augmentation_time/processing_time);
-    //printf("Add observations time: %f/%f\n",
-    //    add_observations_time, add_observations_time/processing_time);
-    printf("Remove lost features time: %f/%f\n",
-        remove_lost_features_time, remove_lost_features_time/processing_time);
-    printf("Remove camera states time: %f/%f\n",
-        prune_cam_states_time, prune_cam_states_time/processing_time);
-    //printf("Publish time: %f/%f\n",
-    //    publish_time, publish_time/processing_time);
+    // The time of each stage is in the diagnostics.
   }
 
   loopClosureCheck = false;
@@ -617,7 +752,7 @@ void MsckfVio::mocapOdomCallback(
   if (publish_tf) {
     tf::Transform T_b_w_gt_tf;
     tf::transformEigenToTF(T_b_w_gt, T_b_w_gt_tf);
-    tf_pub.sendTransform(tf::StampedTransform(
+    tf_pub_ptr->sendTransform(tf::StampedTransform(
           T_b_w_gt_tf, msg->header.stamp, fixed_frame_id, child_frame_id+"_mocap"));
   }
 
@@ -769,6 +904,16 @@ void MsckfVio::processModel(const double& time,
 void MsckfVio::predictNewState(const double& dt,
     const Vector3d& gyro,
     const Vector3d& acc) {
+  IMUState& imu_state = state_server.imu_state;
+  predictNewState(dt, gyro, acc, imu_state.orientation,
+      imu_state.velocity, imu_state.position);
+  return;
+}
+
+void MsckfVio::predictNewState(const double& dt,
+    const Vector3d& gyro,
+    const Vector3d& acc,
+    Vector4d& q, Vector3d& v, Vector3d& p) {
 
   // TODO: Will performing the forward integration using
   //    the inverse of the quaternion give better accuracy?
@@ -778,10 +923,6 @@ void MsckfVio::predictNewState(const double& dt,
   Omega.block<3, 1>(0, 3) = gyro;
   Omega.block<1, 3>(3, 0) = -gyro;
 
-  Vector4d& q = state_server.imu_state.orientation;
-  Vector3d& v = state_server.imu_state.velocity;
-  Vector3d& p = state_server.imu_state.position;
-
   // Some pre-calculation
   Vector4d dq_dt, dq_dt2;
   if (gyro_norm > 1e-5) {
@@ -894,7 +1035,7 @@ void MsckfVio::stateAugmentation(const double& time) {
 }
 
 void MsckfVio::addFeatureObservations(
-    const CameraMeasurementConstPtr& msg) {
+    const FeatureBatchConstPtr& msg) {
 
   StateIDType state_id = state_server.imu_state.id;
   int curr_feature_num = map_server.size();
@@ -902,20 +1043,22 @@ void MsckfVio::addFeatureObservations(
 
   // Add new observations for existing features or new
   // features in the map server.
-  for (const auto& feature : msg->features) {
-    if (map_server.find(feature.id) == map_server.end()) {
+  const FeatureBatch& batch = *msg;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    const FeatureIDType feature_id = batch.id[i];
+    const Vector4d observation(
+        batch.u0[i], batch.v0[i], batch.u1[i], batch.v1[i]);
+
+    auto feature_iter = map_server.find(feature_id);
+    if (feature_iter == map_server.end()) {
       // This is a new feature.
-      map_server[feature.id] = Feature(feature.id);
-      map_server[feature.id].observations[state_id] =
-        Vector4d(feature.u0, feature.v0,
-            feature.u1, feature.v1);
+      feature_iter = map_server.insert(
+          make_pair(feature_id, Feature(feature_id))).first;
     } else {
       // This is an old feature.
-      map_server[feature.id].observations[state_id] =
-        Vector4d(feature.u0, feature.v0,
-            feature.u1, feature.v1);
       ++tracked_feature_num;
     }
+    feature_iter->second.observations[state_id] = observation;
   }
 
   tracking_rate =
@@ -939,9 +1082,10 @@ void MsckfVio::measurementJacobian(
   const Vector3d& t_c0_w = cam_state.position;
 
   // Cam1 pose.
-  Matrix3d R_c0_c1 = CAMState::T_cam0_cam1.linear();
-  Matrix3d R_w_c1 = CAMState::T_cam0_cam1.linear() * R_w_c0;
-  Vector3d t_c1_w = t_c0_w - R_w_c1.transpose()*CAMState::T_cam0_cam1.translation();
+  const Isometry3d& T_cam0_cam1 = calibration->T_cam0_cam1;
+  Matrix3d R_c0_c1 = T_cam0_cam1.linear();
+  Matrix3d R_w_c1 = T_cam0_cam1.linear() * R_w_c0;
+  Vector3d t_c1_w = t_c0_w - R_w_c1.transpose()*T_cam0_cam1.translation();
 
   // 3d feature position in the world frame.
   // And its observation with the stereo cameras.
@@ -1058,6 +1202,7 @@ void MsckfVio::measurementUpdate(
     const MatrixXd& H, const VectorXd& r) {
 
   if (H.rows() == 0 || r.rows() == 0) return;
+  MSCKF_VIO_PROFILE_SCOPE(profiler, "measurementUpdate");
 
   // Decompose the final Jacobian matrix to reduce computational
   // complexity as in Equation (28), (29).
@@ -1206,7 +1351,8 @@ void MsckfVio::removeLostFeatures() {
         invalid_feature_ids.push_back(feature.id);
         continue;
       } else {
-        if(!feature.initializePosition(state_server.cam_states)) {
+        if(!feature.initializePosition(
+            state_server.cam_states, calibration->T_cam0_cam1)) {
           invalid_feature_ids.push_back(feature.id);
           continue;
         }
@@ -1354,7 +1500,8 @@ void MsckfVio::pruneCamStateBuffer() {
           feature.observations.erase(cam_id);
         continue;
       } else {
-        if(!feature.initializePosition(state_server.cam_states)) {
+        if(!feature.initializePosition(
+            state_server.cam_states, calibration->T_cam0_cam1)) {
           for (const auto& cam_id : involved_cam_state_ids)
             feature.observations.erase(cam_id);
           continue;
@@ -1471,19 +1618,25 @@ void MsckfVio::onlineReset() {
   // Clear all exsiting features in the map.
   map_server.clear();
 
+  // Stop the imu rate odometry until the next filter update.
+  {
+    std::lock_guard<std::mutex> lock(imu_rate_mutex);
+    is_imu_rate_state_set = false;
+  }
+
   // Reset the state covariance.
   double gyro_bias_cov, acc_bias_cov, velocity_cov;
-  nh.param<double>("initial_covariance/velocity",
+  param_reader.param<double>("initial_covariance/velocity",
       velocity_cov, 0.25);
-  nh.param<double>("initial_covariance/gyro_bias",
+  param_reader.param<double>("initial_covariance/gyro_bias",
       gyro_bias_cov, 1e-4);
-  nh.param<double>("initial_covariance/acc_bias",
+  param_reader.param<double>("initial_covariance/acc_bias",
       acc_bias_cov, 1e-2);
 
   double extrinsic_rotation_cov, extrinsic_translation_cov;
-  nh.param<double>("initial_covariance/extrinsic_rotation_cov",
+  param_reader.param<double>("initial_covariance/extrinsic_rotation_cov",
       extrinsic_rotation_cov, 3.0462e-4);
-  nh.param<double>("initial_covariance/extrinsic_translation_cov",
+  param_reader.param<double>("initial_covariance/extrinsic_translation_cov",
       extrinsic_translation_cov, 1e-4);
 
   state_server.state_cov = MatrixXd::Zero(21, 21);
@@ -1511,16 +1664,16 @@ void MsckfVio::publish(const ros::Time& time) {
       imu_state.orientation).transpose();
   T_i_w.translation() = imu_state.position;
 
-  Eigen::Isometry3d T_b_w = IMUState::T_imu_body * T_i_w *
-    IMUState::T_imu_body.inverse();
+  Eigen::Isometry3d T_b_w = calibration->T_imu_body * T_i_w *
+    calibration->T_imu_body.inverse();
   Eigen::Vector3d body_velocity =
-    IMUState::T_imu_body.linear() * imu_state.velocity;
+    calibration->T_imu_body.linear() * imu_state.velocity;
 
   // Publish tf
-  if (publish_tf) {
+  if (publish_tf && tf_pub_ptr) {
     tf::Transform T_b_w_tf;
     tf::transformEigenToTF(T_b_w, T_b_w_tf);
-    tf_pub.sendTransform(tf::StampedTransform(
+    tf_pub_ptr->sendTransform(tf::StampedTransform(
           T_b_w_tf, time, fixed_frame_id, child_frame_id));
   }
 
@@ -1549,8 +1702,8 @@ void MsckfVio::publish(const ros::Time& time) {
   P_imu_pose << P_pp, P_po, P_op, P_oo;
 
   Matrix<double, 6, 6> H_pose = Matrix<double, 6, 6>::Zero();
-  H_pose.block<3, 3>(0, 0) = IMUState::T_imu_body.linear();
-  H_pose.block<3, 3>(3, 3) = IMUState::T_imu_body.linear();
+  H_pose.block<3, 3>(0, 0) = calibration->T_imu_body.linear();
+  H_pose.block<3, 3>(3, 3) = calibration->T_imu_body.linear();
   Matrix<double, 6, 6> P_body_pose = H_pose *
     P_imu_pose * H_pose.transpose();
 
@@ -1562,7 +1715,7 @@ void MsckfVio::publish(const ros::Time& time) {
 
   // Construct the covariance for the velocity.
   Matrix3d P_imu_vel = state_server.state_cov.block<3, 3>(6, 6);
-  Matrix3d H_vel = IMUState::T_imu_body.linear();
+  Matrix3d H_vel = calibration->T_imu_body.linear();
   Matrix3d P_body_vel = H_vel * P_imu_vel * H_vel.transpose();
   for (int i = 0; i < 3; ++i)
     for (int j = 0; j < 3; ++j){
@@ -1573,10 +1726,8 @@ void MsckfVio::publish(const ros::Time& time) {
 /////////////////////////////////////////////////////////////////////////////
 
 
-  finalOdomMsgBuffer.push_back(odom_msg);  // Add current odom msg into buffer
-
-  if (finalOdomMsgBuffer.size() >= 10)
-    finalOdomMsgBuffer.erase(finalOdomMsgBuffer.begin());
+  // Keep the pose for the delayed loop closure corrections.
+  pose_history.push(time.toNSec(), T_b_w);
 
   //////////////////////////////////////////////////////////////
   //
@@ -1645,6 +1796,8 @@ void MsckfVio::publish(const ros::Time& time) {
 
   ////////////////////////////////////////////////////////////////////////////////
   // final_odom_pub.publish (final_odom_msg);
+  if (odometry_callback) odometry_callback(odom_msg);
+  if (!nh_ptr) return;
   odom_pub.publish(odom_msg);
 
   // Publish the 3D positions of the features that
@@ -1657,7 +1810,7 @@ void MsckfVio::publish(const ros::Time& time) {
     const auto& feature = item.second;
     if (feature.is_initialized) {
       Vector3d feature_position =
-        IMUState::T_imu_body.linear() * feature.position;
+        calibration->T_imu_body.linear() * feature.position;
       feature_msg_ptr->points.push_back(pcl::PointXYZ(
             feature_position(0), feature_position(1), feature_position(2)));
     }
@@ -1730,25 +1883,60 @@ void MsckfVio::getQuaternion(Mat R, double Q[])
 }
 
 void MsckfVio::odomCallback(const nav_msgs::Odometry::ConstPtr& odom)
- {
-    geometry_msgs::PoseStamped this_pose_stamped;
-    this_pose_stamped.pose.position.x = odom->pose.pose.position.x;
-    this_pose_stamped.pose.position.y = odom->pose.pose.position.y;
+{
+  geometry_msgs::PoseStamped this_pose_stamped;
+  this_pose_stamped.pose.position.x = odom->pose.pose.position.x;
+  this_pose_stamped.pose.position.y = odom->pose.pose.position.y;
+
+  this_pose_stamped.pose.orientation = odom->pose.pose.orientation;
+
+  this_pose_stamped.header.stamp = odom->header.stamp;
+  this_pose_stamped.header.frame_id = "odom";
+
+  // Skip the poses close to the last one in the trajectory.
+  if (!trajectory.empty()) {
+    const geometry_msgs::Pose& last_pose = trajectory.back().pose;
+    Eigen::Quaterniond last_q, this_q;
+    tf::quaternionMsgToEigen(last_pose.orientation, last_q);
+    tf::quaternionMsgToEigen(this_pose_stamped.pose.orientation, this_q);
+
+    const double distance = std::hypot(
+        this_pose_stamped.pose.position.x-last_pose.position.x,
+        this_pose_stamped.pose.position.y-last_pose.position.y);
+    if (distance < trajectory_min_distance &&
+        last_q.angularDistance(this_q) < trajectory_min_angle)
+      return;
+  }
 
-    this_pose_stamped.pose.orientation = odom->pose.pose.orientation;
+  // Publish the new segment only.
+  nav_msgs::Path segment;
+  segment.header = this_pose_stamped.header;
+  if (!trajectory.empty())
+    segment.poses.push_back(trajectory.back());
+  segment.poses.push_back(this_pose_stamped);
+  path_pub.publish(segment);
 
-    this_pose_stamped.header.stamp = ros::Time::now();
-    this_pose_stamped.header.frame_id = "odom";
+  trajectory.push_back(this_pose_stamped);
+  while (trajectory.size() > static_cast<size_t>(trajectory_max_size))
+    trajectory.pop_front();
 
-    path.poses.push_back(this_pose_stamped);
+  return;
+}
 
-    path.header.stamp = ros::Time::now();
-    path.header.frame_id="odom";
-    path_pub.publish(path);
-    printf("path_pub ");
+bool MsckfVio::fullPathCallback(
+    std_srvs::Trigger::Request& req,
+    std_srvs::Trigger::Response& res) {
+  nav_msgs::Path path;
+  path.header.stamp = ros::Time::now();
+  path.header.frame_id = "odom";
+  path.poses.assign(trajectory.begin(), trajectory.end());
+  full_path_pub.publish(path);
 
-    printf("odom %.3lf %.3lf\n",odom->pose.pose.position.x,odom->pose.pose.position.y);
- }
+  res.success = true;
+  res.message = "Published " + std::to_string(path.poses.size()) +
+    " poses on full_trajectory";
+  return true;
+}
 
 } // namespace msckf_vio
 
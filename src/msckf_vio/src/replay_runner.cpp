@@ -0,0 +1,346 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+/*
+ * Replays a dataset in the EuRoC format through the image
+ * processor and the filter without a roscore.
+ *
+ * All the msgs are passed to the callbacks in the order of
+ * their time stamps on a single thread, as fast as possible,
+ * so that the results of two runs can be compared directly.
+ *
+ * Usage:
+ *   replay_runner <mav0 folder> <calibration yaml>
+ *       <config yaml> <output folder>
+ *
+ * The config yaml contains the parameters of the two nodes
+ * under the namespaces image_processor and vio, see
+ * config/replay_euroc.yaml. The output folder receives
+ *   trajectory.txt: the odometry in the TUM format, and
+ *   timing.csv: the processing time of each stereo frame.
+ * The time and the heap allocations of the stages of each
+ * node are printed at the end.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <cv_bridge/cv_bridge.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/image_encodings.h>
+#include <nav_msgs/Odometry.h>
+
+#include <msckf_vio/image_processor.h>
+#include <msckf_vio/msckf_vio.h>
+#include <msckf_vio/profiler.hpp>
+#include <msckf_vio/utils.h>
+
+using namespace std;
+using namespace msckf_vio;
+
+MSCKF_VIO_DEFINE_ALLOCATION_COUNTER()
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/*
+ * @brief ReplayEvent A reading in the dataset. Imu
+ *    readings go first if the time stamps are the same,
+ *    since the filter uses the imu msgs up to the image.
+ */
+struct ReplayEvent {
+  enum Type {
+    IMU = 0,
+    STEREO = 1
+  };
+
+  uint64_t stamp;
+  Type type;
+  // Angular velocity and linear acceleration.
+  double imu[6];
+  std::string cam0_file;
+  std::string cam1_file;
+
+  bool operator<(const ReplayEvent& other) const {
+    if (stamp != other.stamp) return stamp < other.stamp;
+    return type < other.type;
+  }
+};
+
+/*
+ * @brief readCsv Reads the rows of a EuRoC csv file,
+ *    skipping the comments.
+ */
+bool readCsv(const string& filename,
+    vector<vector<string> >& rows) {
+  ifstream fin(filename.c_str());
+  if (!fin) return false;
+
+  string line;
+  while (getline(fin, line)) {
+    if (!line.empty() && line[line.size()-1] == '\r')
+      line.erase(line.size()-1);
+    if (line.empty() || line[0] == '#') continue;
+
+    vector<string> fields;
+    stringstream line_stream(line);
+    string field;
+    while (getline(line_stream, field, ',')) {
+      const size_t begin = field.find_first_not_of(" \t");
+      const size_t end = field.find_last_not_of(" \t");
+      fields.push_back(begin == string::npos ?
+          string() : field.substr(begin, end-begin+1));
+    }
+    rows.push_back(fields);
+  }
+  return true;
+}
+
+bool readImu(const string& mav0, vector<ReplayEvent>& events) {
+  vector<vector<string> > rows;
+  if (!readCsv(mav0 + "/imu0/data.csv", rows)) return false;
+
+  for (const auto& row : rows) {
+    if (row.size() < 7) continue;
+    ReplayEvent event;
+    event.stamp = stoull(row[0]);
+    event.type = ReplayEvent::IMU;
+    for (int i = 0; i < 6; ++i)
+      event.imu[i] = stod(row[i+1]);
+    events.push_back(event);
+  }
+  return true;
+}
+
+bool readStereo(const string& mav0, vector<ReplayEvent>& events) {
+  vector<vector<string> > cam0_rows, cam1_rows;
+  if (!readCsv(mav0 + "/cam0/data.csv", cam0_rows) ||
+      !readCsv(mav0 + "/cam1/data.csv", cam1_rows)) return false;
+
+  map<uint64_t, string> cam1_files;
+  for (const auto& row : cam1_rows) {
+    if (row.size() < 2) continue;
+    cam1_files[stoull(row[0])] = mav0 + "/cam1/data/" + row[1];
+  }
+
+  // Only the synchronized pairs are used, which is
+  // what the stereo subscriber of the node does.
+  for (const auto& row : cam0_rows) {
+    if (row.size() < 2) continue;
+    ReplayEvent event;
+    event.stamp = stoull(row[0]);
+    event.type = ReplayEvent::STEREO;
+
+    const auto cam1_iter = cam1_files.find(event.stamp);
+    if (cam1_iter == cam1_files.end()) continue;
+    event.cam0_file = mav0 + "/cam0/data/" + row[1];
+    event.cam1_file = cam1_iter->second;
+    events.push_back(event);
+  }
+  return true;
+}
+
+sensor_msgs::ImagePtr loadImage(const string& filename,
+    const ros::Time& stamp) {
+  const cv::Mat image = cv::imread(filename, cv::IMREAD_GRAYSCALE);
+  if (image.empty()) return sensor_msgs::ImagePtr();
+
+  std_msgs::Header header;
+  header.stamp = stamp;
+  return cv_bridge::CvImage(header,
+      sensor_msgs::image_encodings::MONO8, image).toImageMsg();
+}
+
+double elapsedMs(const Clock::time_point& start) {
+  return std::chrono::duration<double, std::milli>(
+      Clock::now()-start).count();
+}
+
+/*
+ * @brief TimingStatistics Summary of the processing
+ *    time of a stage in milliseconds.
+ */
+struct TimingStatistics {
+  vector<double> samples;
+
+  void print(const string& name) {
+    if (samples.empty()) return;
+    sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (const auto& sample : samples) sum += sample;
+    printf("%-16s mean %8.3f  p50 %8.3f  p99 %8.3f  max %8.3f ms\n",
+        name.c_str(), sum/samples.size(),
+        samples[samples.size()/2],
+        samples[min(samples.size()-1, samples.size()*99/100)],
+        samples.back());
+  }
+};
+
+void printStages(const string& node_name,
+    profiling::Profiler& profiler) {
+  printf("%s stages:\n", node_name.c_str());
+  for (const auto& stage : profiler.collect()) {
+    printf("  %-24s mean %8.3f  p50 %8.3f  p99 %8.3f  max %8.3f ms"
+        "  %8.1f allocs\n", stage.name.c_str(),
+        stage.mean*1e3, stage.p50*1e3, stage.p99*1e3, stage.max*1e3,
+        stage.allocations);
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 5) {
+    cerr << "Usage: " << argv[0] << " <mav0 folder> "
+      << "<calibration yaml> <config yaml> <output folder>" << endl;
+    return 1;
+  }
+  const string mav0(argv[1]);
+  const string calibration_file(argv[2]);
+  const string config_file(argv[3]);
+  const string output_folder(argv[4]);
+
+  // The calibration is loaded once and shared by the nodes,
+  // and each node gets its own parameters.
+  StereoCalibrationConstPtr calibration;
+  try {
+    calibration = utils::loadCalibration(calibration_file);
+  } catch (const std::runtime_error& error) {
+    cerr << error.what() << endl;
+  }
+  if (!calibration) {
+    cerr << "Cannot load the calibration " << calibration_file << endl;
+    return 1;
+  }
+
+  XmlRpc::XmlRpcValue processor_params, vio_params;
+  if (!utils::ParameterReader::loadYaml(
+        config_file, processor_params, "image_processor") ||
+      !utils::ParameterReader::loadYaml(
+        config_file, vio_params, "vio")) {
+    cerr << "Cannot load the config " << config_file << endl;
+    return 1;
+  }
+
+  vector<ReplayEvent> events;
+  if (!readImu(mav0, events) || !readStereo(mav0, events)) {
+    cerr << "Cannot read the dataset in " << mav0 << endl;
+    return 1;
+  }
+  stable_sort(events.begin(), events.end());
+
+  ofstream trajectory_file((output_folder+"/trajectory.txt").c_str());
+  ofstream timing_file((output_folder+"/timing.csv").c_str());
+  if (!trajectory_file || !timing_file) {
+    cerr << "Cannot write to " << output_folder << endl;
+    return 1;
+  }
+  trajectory_file << fixed << setprecision(9);
+  timing_file << fixed << setprecision(6);
+  timing_file << "#timestamp [ns],image_processor [ms],msckf_vio [ms]"
+    << endl;
+
+  // The nodes only use the wall time for profiling.
+  ros::Time::init();
+
+  ImageProcessor processor((utils::ParameterReader(processor_params)));
+  MsckfVio vio((utils::ParameterReader(vio_params)));
+  processor.setCalibration(calibration);
+  vio.setCalibration(calibration);
+  if (!processor.initialize() || !vio.initialize()) {
+    cerr << "Cannot initialize the nodes" << endl;
+    return 1;
+  }
+
+  // The features are handed to the filter directly, whose
+  // time is then excluded from the one of the processor.
+  double vio_time = 0.0;
+  processor.setFeatureCallback(
+      [&vio, &vio_time](const FeatureBatchConstPtr& msg) {
+        const Clock::time_point start = Clock::now();
+        vio.featureCallback(msg);
+        vio_time = elapsedMs(start);
+      });
+
+  vio.setOdometryCallback(
+      [&trajectory_file](const nav_msgs::Odometry& odom) {
+        const geometry_msgs::Pose& pose = odom.pose.pose;
+        trajectory_file << odom.header.stamp.toSec() << " "
+          << pose.position.x << " "
+          << pose.position.y << " "
+          << pose.position.z << " "
+          << pose.orientation.x << " "
+          << pose.orientation.y << " "
+          << pose.orientation.z << " "
+          << pose.orientation.w << "\n";
+      });
+
+  TimingStatistics processor_stats, vio_stats;
+  int frame_num = 0;
+  const Clock::time_point replay_start = Clock::now();
+
+  for (const auto& event : events) {
+    ros::Time stamp;
+    stamp.fromNSec(event.stamp);
+
+    if (event.type == ReplayEvent::IMU) {
+      sensor_msgs::ImuPtr imu_msg(new sensor_msgs::Imu());
+      imu_msg->header.stamp = stamp;
+      imu_msg->angular_velocity.x = event.imu[0];
+      imu_msg->angular_velocity.y = event.imu[1];
+      imu_msg->angular_velocity.z = event.imu[2];
+      imu_msg->linear_acceleration.x = event.imu[3];
+      imu_msg->linear_acceleration.y = event.imu[4];
+      imu_msg->linear_acceleration.z = event.imu[5];
+      processor.imuCallback(imu_msg);
+      vio.imuCallback(imu_msg);
+      continue;
+    }
+
+    const sensor_msgs::ImagePtr cam0_img = loadImage(event.cam0_file, stamp);
+    const sensor_msgs::ImagePtr cam1_img = loadImage(event.cam1_file, stamp);
+    if (!cam0_img || !cam1_img) {
+      cerr << "Skip the unreadable images at " << event.stamp << endl;
+      continue;
+    }
+
+    vio_time = 0.0;
+    const Clock::time_point start = Clock::now();
+    processor.stereoCallback(cam0_img, cam1_img);
+    const double processor_time = elapsedMs(start) - vio_time;
+
+    processor_stats.samples.push_back(processor_time);
+    vio_stats.samples.push_back(vio_time);
+    timing_file << event.stamp << "," << processor_time
+      << "," << vio_time << "\n";
+    ++frame_num;
+  }
+
+  const double replay_time = elapsedMs(replay_start) / 1000.0;
+  const double dataset_time = events.empty() ? 0.0 :
+    (events.back().stamp-events.front().stamp) * 1e-9;
+  printf("Replayed %d stereo frames of %.1f s in %.1f s\n",
+      frame_num, dataset_time, replay_time);
+  processor_stats.print("image_processor");
+  vio_stats.print("msckf_vio");
+  printStages("image_processor", processor.getProfiler());
+  printStages("msckf_vio", vio.getProfiler());
+
+  return 0;
+}
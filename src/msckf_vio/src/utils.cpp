@@ -7,11 +7,180 @@
 
 #include <msckf_vio/utils.h>
 #include <vector>
+#include <fstream>
+#include <sstream>
+#include <opencv2/core/persistence.hpp>
 
 namespace msckf_vio {
 namespace utils {
 
-Eigen::Isometry3d getTransformEigen(const ros::NodeHandle &nh,
+namespace {
+
+// Conversions from the entries of a parameter tree, which
+// accept the same types as ros::NodeHandle::getParam.
+bool toDouble(XmlRpc::XmlRpcValue &v, double &value) {
+  if (v.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+    value = static_cast<double>(v);
+  else if (v.getType() == XmlRpc::XmlRpcValue::TypeInt)
+    value = static_cast<int>(v);
+  else
+    return false;
+  return true;
+}
+
+bool toInt(XmlRpc::XmlRpcValue &v, int &value) {
+  if (v.getType() != XmlRpc::XmlRpcValue::TypeInt) return false;
+  value = static_cast<int>(v);
+  return true;
+}
+
+bool toBool(XmlRpc::XmlRpcValue &v, bool &value) {
+  if (v.getType() == XmlRpc::XmlRpcValue::TypeBoolean) {
+    value = static_cast<bool>(v);
+    return true;
+  }
+  // OpenCV reads yaml booleans as strings.
+  if (v.getType() == XmlRpc::XmlRpcValue::TypeString) {
+    const std::string& s = static_cast<std::string&>(v);
+    if (s == "true" || s == "True") value = true;
+    else if (s == "false" || s == "False") value = false;
+    else return false;
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+bool toVector(XmlRpc::XmlRpcValue &v, std::vector<T> &value,
+    bool (*convert)(XmlRpc::XmlRpcValue&, T&)) {
+  if (v.getType() != XmlRpc::XmlRpcValue::TypeArray) return false;
+  std::vector<T> result(v.size());
+  for (int i = 0; i < v.size(); ++i)
+    if (!convert(v[i], result[i])) return false;
+  value.swap(result);
+  return true;
+}
+
+XmlRpc::XmlRpcValue fileNodeToXmlRpc(const cv::FileNode &node) {
+  XmlRpc::XmlRpcValue value;
+  if (node.isMap()) {
+    for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it)
+      value[(*it).name()] = fileNodeToXmlRpc(*it);
+  } else if (node.isSeq()) {
+    value.setSize(node.size());
+    for (int i = 0; i < node.size(); ++i)
+      value[i] = fileNodeToXmlRpc(node[i]);
+  } else if (node.isInt()) {
+    value = static_cast<int>(node);
+  } else if (node.isReal()) {
+    value = static_cast<double>(node);
+  } else if (node.isString()) {
+    value = static_cast<std::string>(node);
+  }
+  return value;
+}
+
+} // namespace
+
+ParameterReader::ParameterReader(const ros::NodeHandle &nh) :
+  nh_ptr(new ros::NodeHandle(nh)) {
+  return;
+}
+
+ParameterReader::ParameterReader(const XmlRpc::XmlRpcValue &t) :
+  tree(t) {
+  return;
+}
+
+bool ParameterReader::getParam(const std::string &key,
+                               XmlRpc::XmlRpcValue &value) const {
+  if (nh_ptr) return nh_ptr->getParam(key, value);
+
+  // Walk down the tree along the namespaces in the key.
+  XmlRpc::XmlRpcValue* node = &tree;
+  std::stringstream key_stream(key);
+  std::string name;
+  while (std::getline(key_stream, name, '/')) {
+    if (name.empty()) continue;
+    if (node->getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+        !node->hasMember(name)) return false;
+    node = &(*node)[name];
+  }
+  value = *node;
+  return true;
+}
+
+bool ParameterReader::getParam(const std::string &key,
+                               std::string &value) const {
+  if (nh_ptr) return nh_ptr->getParam(key, value);
+  XmlRpc::XmlRpcValue v;
+  if (!getParam(key, v) ||
+      v.getType() != XmlRpc::XmlRpcValue::TypeString) return false;
+  value = static_cast<std::string&>(v);
+  return true;
+}
+
+bool ParameterReader::getParam(const std::string &key,
+                               double &value) const {
+  if (nh_ptr) return nh_ptr->getParam(key, value);
+  XmlRpc::XmlRpcValue v;
+  return getParam(key, v) && toDouble(v, value);
+}
+
+bool ParameterReader::getParam(const std::string &key,
+                               int &value) const {
+  if (nh_ptr) return nh_ptr->getParam(key, value);
+  XmlRpc::XmlRpcValue v;
+  return getParam(key, v) && toInt(v, value);
+}
+
+bool ParameterReader::getParam(const std::string &key,
+                               bool &value) const {
+  if (nh_ptr) return nh_ptr->getParam(key, value);
+  XmlRpc::XmlRpcValue v;
+  return getParam(key, v) && toBool(v, value);
+}
+
+bool ParameterReader::getParam(const std::string &key,
+                               std::vector<double> &value) const {
+  if (nh_ptr) return nh_ptr->getParam(key, value);
+  XmlRpc::XmlRpcValue v;
+  return getParam(key, v) && toVector(v, value, &toDouble);
+}
+
+bool ParameterReader::getParam(const std::string &key,
+                               std::vector<int> &value) const {
+  if (nh_ptr) return nh_ptr->getParam(key, value);
+  XmlRpc::XmlRpcValue v;
+  return getParam(key, v) && toVector(v, value, &toInt);
+}
+
+bool ParameterReader::loadYaml(const std::string &filename,
+                               XmlRpc::XmlRpcValue &tree,
+                               const std::string &ns) {
+  std::ifstream fin(filename.c_str());
+  if (!fin) return false;
+  std::stringstream buffer;
+  buffer << fin.rdbuf();
+
+  // OpenCV requires the yaml directive, which is
+  // usually missing in the kalibr output.
+  std::string content = buffer.str();
+  if (content.compare(0, 5, "%YAML") != 0)
+    content = "%YAML:1.0\n" + content;
+
+  cv::FileStorage fs(content,
+      cv::FileStorage::READ | cv::FileStorage::MEMORY);
+  if (!fs.isOpened()) return false;
+
+  const cv::FileNode root = ns.empty() ? fs.root() : fs[ns];
+  if (!root.isMap()) return false;
+  for (cv::FileNodeIterator it = root.begin(); it != root.end(); ++it)
+    tree[(*it).name()] = fileNodeToXmlRpc(*it);
+  return true;
+}
+
+Eigen::Isometry3d getTransformEigen(const ParameterReader &nh,
                                     const std::string &field) {
   Eigen::Isometry3d T;
   cv::Mat c = getTransformCV(nh, field);
@@ -31,7 +200,7 @@ Eigen::Isometry3d getTransformEigen(const ros::NodeHandle &nh,
   return T;
 }
 
-cv::Mat getTransformCV(const ros::NodeHandle &nh,
+cv::Mat getTransformCV(const ParameterReader &nh,
                        const std::string &field) {
   cv::Mat T;
   try {
@@ -52,7 +221,7 @@ cv::Mat getTransformCV(const ros::NodeHandle &nh,
   return T;
 }
 
-cv::Mat getVec16Transform(const ros::NodeHandle &nh,
+cv::Mat getVec16Transform(const ParameterReader &nh,
                           const std::string &field) {
   std::vector<double> v;
   nh.getParam(field, v);
@@ -63,7 +232,7 @@ cv::Mat getVec16Transform(const ros::NodeHandle &nh,
   return T;
 }
 
-cv::Mat getKalibrStyleTransform(const ros::NodeHandle &nh,
+cv::Mat getKalibrStyleTransform(const ParameterReader &nh,
                                 const std::string &field) {
   cv::Mat T = cv::Mat::eye(4, 4, CV_64FC1);
   XmlRpc::XmlRpcValue lines;
@@ -88,5 +257,92 @@ cv::Mat getKalibrStyleTransform(const ros::NodeHandle &nh,
   return T;
 }
 
+namespace {
+
+void loadCamera(const ParameterReader &params, const std::string &ns,
+                CameraCalibration &camera) {
+  params.param<std::string>(ns + "/distortion_model",
+      camera.distortion_model, std::string("radtan"));
+
+  std::vector<int> resolution(2);
+  params.getParam(ns + "/resolution", resolution);
+  camera.resolution = cv::Vec2i(resolution[0], resolution[1]);
+
+  std::vector<double> intrinsics(4);
+  params.getParam(ns + "/intrinsics", intrinsics);
+  for (int i = 0; i < 4; ++i) camera.intrinsics[i] = intrinsics[i];
+
+  std::vector<double> distortion_coeffs(4);
+  params.getParam(ns + "/distortion_coeffs", distortion_coeffs);
+  for (int i = 0; i < 4; ++i)
+    camera.distortion_coeffs[i] = distortion_coeffs[i];
+  return;
+}
+
+} // namespace
+
+StereoCalibrationConstPtr loadCalibration(const ParameterReader &params,
+    const std::string &left, const std::string &right) {
+  // Fetch the calibration in one go, so that the lookups
+  // below do not hit the parameter server.
+  XmlRpc::XmlRpcValue tree;
+  const std::string keys[] = {left, right, "T_imu_body"};
+  for (const auto &key : keys) {
+    XmlRpc::XmlRpcValue value;
+    if (params.getParam(key, value)) tree[key] = value;
+  }
+  const ParameterReader reader(tree);
+
+  boost::shared_ptr<StereoCalibration> calibration =
+    StereoCalibration::create();
+  loadCamera(reader, left, calibration->cam0);
+  loadCamera(reader, right, calibration->cam1);
+
+  calibration->T_imu_cam0 = getTransformEigen(reader, left + "/T_cam_imu");
+  calibration->T_cam0_cam1 = getTransformEigen(reader, right + "/T_cn_cnm1");
+  calibration->T_imu_body =
+    getTransformEigen(reader, "T_imu_body").inverse();
+  return calibration;
+}
+
+StereoCalibrationConstPtr loadCalibration(const std::string &filename,
+    const std::string &left, const std::string &right) {
+  XmlRpc::XmlRpcValue tree;
+  if (!ParameterReader::loadYaml(filename, tree))
+    return StereoCalibrationConstPtr();
+  return loadCalibration(ParameterReader(tree), left, right);
+}
+
+void getDiagnostics(const std::string &node_name,
+                    const std::vector<profiling::StageStatistics> &statistics,
+                    diagnostic_msgs::DiagnosticArray &diagnostics) {
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.clear();
+
+  for (const auto &stage : statistics) {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = node_name + ": " + stage.name;
+    status.hardware_id = node_name;
+    status.message = "profiling";
+
+    const std::pair<const char*, double> values[] = {
+      {"count", static_cast<double>(stage.count)},
+      {"mean_ms", stage.mean*1e3},
+      {"p50_ms", stage.p50*1e3},
+      {"p99_ms", stage.p99*1e3},
+      {"max_ms", stage.max*1e3},
+      {"allocations", stage.allocations}};
+    for (const auto &value : values) {
+      diagnostic_msgs::KeyValue key_value;
+      key_value.key = value.first;
+      key_value.value = std::to_string(value.second);
+      status.values.push_back(key_value);
+    }
+    diagnostics.status.push_back(status);
+  }
+  return;
+}
+
 } // namespace utils
 } // namespace msckf_vio
@@ -0,0 +1,93 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+/*
+ * Converts the ORB vocabulary from the text format of
+ * ORB-SLAM2 into the binary format, which the loop closure
+ * maps into memory at startup.
+ *
+ * Usage:
+ *   vocabulary_converter <ORBvoc.txt> <ORBvoc.bin>
+ *
+ * The binary file is read back and compared word by word
+ * with the text one before the converter returns.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <msckf_vio/ORBVocabulary.h>
+
+using namespace std;
+using namespace msckf_vio;
+
+namespace {
+
+double secondsSince(const chrono::steady_clock::time_point& start) {
+  return chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
+
+bool sameWords(const ORBVocabulary& a, const ORBVocabulary& b) {
+  if (a.size() != b.size() ||
+      a.getBranchingFactor() != b.getBranchingFactor() ||
+      a.getDepthLevels() != b.getDepthLevels() ||
+      a.getScoringType() != b.getScoringType() ||
+      a.getWeightingType() != b.getWeightingType())
+    return false;
+
+  for (unsigned int wid = 0; wid < a.size(); ++wid) {
+    const cv::Mat word_a = a.getWord(wid);
+    const cv::Mat word_b = b.getWord(wid);
+    if (a.getWordWeight(wid) != b.getWordWeight(wid) ||
+        a.getParentNode(wid, 1) != b.getParentNode(wid, 1) ||
+        memcmp(word_a.data, word_b.data, DBoW2::FORB::L) != 0)
+      return false;
+  }
+  return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    cerr << "Usage: " << argv[0] << " <ORBvoc.txt> <ORBvoc.bin>" << endl;
+    return 1;
+  }
+  const string text_file(argv[1]);
+  const string binary_file(argv[2]);
+
+  ORBVocabulary text_vocabulary;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  if (!text_vocabulary.loadFromTextFile(text_file)) {
+    cerr << "Cannot load the vocabulary " << text_file << endl;
+    return 1;
+  }
+  cout << "Loaded " << text_vocabulary.size() << " words from "
+    << text_file << " in " << secondsSince(start) << "s" << endl;
+
+  if (!text_vocabulary.saveToBinaryFile(binary_file)) {
+    cerr << "Cannot write the vocabulary " << binary_file << endl;
+    return 1;
+  }
+
+  ORBVocabulary binary_vocabulary;
+  start = chrono::steady_clock::now();
+  if (!binary_vocabulary.loadFromBinaryFile(binary_file)) {
+    cerr << "Cannot load the written vocabulary " << binary_file << endl;
+    return 1;
+  }
+  cout << "Loaded " << binary_vocabulary.size() << " words from "
+    << binary_file << " in " << secondsSince(start) << "s" << endl;
+
+  if (!sameWords(text_vocabulary, binary_vocabulary)) {
+    cerr << "The written vocabulary differs from " << text_file << endl;
+    return 1;
+  }
+  return 0;
+}
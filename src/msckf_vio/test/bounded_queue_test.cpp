@@ -0,0 +1,80 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <msckf_vio/bounded_queue.hpp>
+
+using namespace msckf_vio;
+
+TEST(BoundedQueueTest, latestWins) {
+  BoundedQueue<int> queue(3);
+  EXPECT_TRUE(queue.push(1));
+  EXPECT_TRUE(queue.push(2));
+  EXPECT_TRUE(queue.push(3));
+  // The oldest items are dropped for the new ones.
+  EXPECT_FALSE(queue.push(4));
+  EXPECT_FALSE(queue.push(5));
+  EXPECT_EQ(queue.size(), 3u);
+  EXPECT_EQ(queue.droppedNumber(), 2u);
+
+  int item = 0;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(item, 3);
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(item, 4);
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(item, 5);
+  EXPECT_EQ(queue.size(), 0u);
+}
+
+TEST(BoundedQueueTest, setCapacity) {
+  BoundedQueue<int> queue(4);
+  for (int i = 0; i < 4; ++i) queue.push(i);
+  queue.setCapacity(1);
+  EXPECT_EQ(queue.size(), 1u);
+  EXPECT_EQ(queue.droppedNumber(), 3u);
+
+  int item = 0;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(item, 3);
+}
+
+TEST(BoundedQueueTest, close) {
+  BoundedQueue<int> queue(2);
+  queue.push(1);
+  queue.close();
+  EXPECT_FALSE(queue.push(2));
+
+  // The items left are still served after closing.
+  int item = 0;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(item, 1);
+  EXPECT_FALSE(queue.pop(item));
+}
+
+TEST(BoundedQueueTest, worker) {
+  BoundedQueue<int> queue(1000);
+  std::vector<int> received;
+  std::thread worker([&]() {
+    int item = 0;
+    while (queue.pop(item)) received.push_back(item);
+  });
+
+  for (int i = 0; i < 100; ++i) queue.push(i);
+  queue.close();
+  worker.join();
+
+  ASSERT_EQ(received.size(), 100u);
+  for (int i = 0; i < 100; ++i) EXPECT_EQ(received[i], i);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
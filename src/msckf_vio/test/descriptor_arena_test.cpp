@@ -0,0 +1,85 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <msckf_vio/descriptor_arena.hpp>
+
+using namespace std;
+using namespace msckf_vio;
+
+namespace {
+
+// Descriptor i has all bytes set to i+offset.
+vector<uint8_t> makeRows(const size_t n, const size_t step, const int offset) {
+  vector<uint8_t> rows(n*step, 0xee);
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < 32; ++j)
+      rows[i*step+j] = static_cast<uint8_t>(i+offset);
+  return rows;
+}
+
+void expectRows(const DescriptorArena& arena, const size_t n, const int offset) {
+  ASSERT_EQ(arena.size(), n);
+  for (size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(arena[i]) % 32, 0u);
+    for (size_t j = 0; j < 32; ++j)
+      ASSERT_EQ(arena[i][j], static_cast<uint8_t>(i+offset));
+  }
+}
+
+}
+
+TEST(DescriptorArenaTest, assign) {
+  DescriptorArena arena;
+  EXPECT_TRUE(arena.empty());
+
+  // Packed and padded rows.
+  const vector<uint8_t> packed = makeRows(10, 32, 0);
+  arena.assign(&packed[0], 10, 32);
+  expectRows(arena, 10, 0);
+
+  const vector<uint8_t> padded = makeRows(5, 48, 3);
+  arena.assign(&padded[0], 5, 48);
+  expectRows(arena, 5, 3);
+
+  arena.clear();
+  EXPECT_TRUE(arena.empty());
+}
+
+TEST(DescriptorArenaTest, pushBack) {
+  DescriptorArena arena;
+  const vector<uint8_t> rows = makeRows(100, 32, 1);
+  for (size_t i = 0; i < 100; ++i)
+    EXPECT_EQ(arena.push_back(&rows[32*i]), i);
+  expectRows(arena, 100, 1);
+}
+
+TEST(DescriptorArenaTest, copyAndMove) {
+  const vector<uint8_t> rows = makeRows(20, 32, 2);
+  DescriptorArena arena(&rows[0], 20, 32);
+
+  DescriptorArena copy(arena);
+  expectRows(copy, 20, 2);
+  // The copy is independent.
+  copy[0][0] = 0;
+  EXPECT_EQ(arena[0][0], 2);
+
+  DescriptorArena moved(std::move(copy));
+  EXPECT_TRUE(copy.empty());
+  EXPECT_EQ(moved[0][0], 0);
+
+  DescriptorArena assigned;
+  assigned = arena;
+  expectRows(assigned, 20, 2);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,89 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include <msckf_vio/hamming.hpp>
+
+using namespace std;
+using namespace msckf_vio;
+
+namespace {
+
+// The bit counting of the matchers before the kernels.
+int referenceDistance(const uint8_t* a, const uint8_t* b) {
+  int dist = 0;
+  for (int i = 0; i < 32; ++i) {
+    unsigned int v = a[i] ^ b[i];
+    for (; v; v >>= 1) dist += v & 1;
+  }
+  return dist;
+}
+
+// Descriptors with a padding between them, to exercise the
+// step and the unaligned loads.
+vector<uint8_t> randomDescriptors(const size_t n, const size_t step,
+    mt19937& generator) {
+  uniform_int_distribution<int> byte(0, 255);
+  vector<uint8_t> descriptors(n*step+1);
+  for (size_t i = 0; i < descriptors.size(); ++i)
+    descriptors[i] = static_cast<uint8_t>(byte(generator));
+  return descriptors;
+}
+
+}
+
+TEST(HammingTest, descriptorDistance) {
+  uint8_t a[32], b[32];
+  for (int i = 0; i < 32; ++i) {
+    a[i] = 0;
+    b[i] = 0xff;
+  }
+  EXPECT_EQ(descriptorDistance(a, a), 0);
+  EXPECT_EQ(descriptorDistance(a, b), 256);
+
+  mt19937 generator(3);
+  const vector<uint8_t> d = randomDescriptors(64, 32, generator);
+  for (size_t i = 0; i < 64; ++i)
+    for (size_t j = 0; j < 64; ++j)
+      ASSERT_EQ(descriptorDistance(&d[32*i], &d[32*j]),
+          referenceDistance(&d[32*i], &d[32*j]));
+}
+
+TEST(HammingTest, oneToMany) {
+  mt19937 generator(5);
+  const size_t step = 37;
+  const vector<uint8_t> query = randomDescriptors(1, 32, generator);
+  const vector<uint8_t> train = randomDescriptors(100, step, generator);
+
+  vector<int> distances(100, -1);
+  descriptorDistances(&query[0], &train[1], 100, step, &distances[0]);
+  for (size_t i = 0; i < 100; ++i)
+    EXPECT_EQ(distances[i], referenceDistance(&query[0], &train[1+i*step]));
+
+  // Nothing to compare.
+  descriptorDistances(&query[0], &train[1], 0, step, &distances[0]);
+}
+
+TEST(HammingTest, manyToMany) {
+  mt19937 generator(11);
+  const vector<uint8_t> query = randomDescriptors(7, 32, generator);
+  const vector<uint8_t> train = randomDescriptors(9, 48, generator);
+
+  vector<int> distances(7*9, -1);
+  descriptorDistances(&query[0], 7, 32, &train[0], 9, 48, &distances[0]);
+  for (size_t i = 0; i < 7; ++i)
+    for (size_t j = 0; j < 9; ++j)
+      EXPECT_EQ(distances[i*9+j],
+          referenceDistance(&query[32*i], &train[48*j]));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,321 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+/*
+ * Benchmarks of the front end stages.
+ *
+ * By default, the stereo frames are synthesized from a random
+ * texture with an ideal pinhole calibration. Recorded frames
+ * can be used instead with
+ *   image_processor_benchmark [benchmark flags] <calibration yaml>
+ *       <cam0 prev> <cam1 prev> <cam0 curr> <cam1 curr>
+ * Use --benchmark_out=<file> --benchmark_out_format=json to keep
+ * the results for comparison.
+ */
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <opencv2/opencv.hpp>
+#include <cv_bridge/cv_bridge.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include <msckf_vio/image_processor.h>
+#include <msckf_vio/two_point_ransac.hpp>
+#include <msckf_vio/utils.h>
+
+using namespace std;
+using namespace msckf_vio;
+
+namespace msckf_vio {
+
+/*
+ * @brief ImageProcessorBenchmark Gives access to the
+ *    internal stages of the image processor.
+ */
+class ImageProcessorBenchmark {
+public:
+  // Sets the current images as in stereoCallback.
+  static void loadFrame(ImageProcessor& processor,
+      const sensor_msgs::ImageConstPtr& cam0_img,
+      const sensor_msgs::ImageConstPtr& cam1_img) {
+    processor.cam0_curr_img_ptr = cv_bridge::toCvShare(cam0_img);
+    processor.cam1_curr_img_ptr = cv_bridge::toCvShare(cam1_img);
+    processor.createImagePyramids();
+    return;
+  }
+
+  static void resetCurrentFeatures(ImageProcessor& processor) {
+    processor.curr_features_ptr.reset(
+        new ImageProcessor::GridFeatures());
+    for (int code = 0; code < processor.processor_config.grid_row*
+        processor.processor_config.grid_col; ++code)
+      (*processor.curr_features_ptr)[code] =
+        vector<ImageProcessor::FeatureMetaData>(0);
+    return;
+  }
+
+  // Detects the features on the current images, and
+  // returns their locations in cam0.
+  static void detectFeatures(ImageProcessor& processor,
+      vector<cv::Point2f>& cam0_points) {
+    resetCurrentFeatures(processor);
+    processor.initializeFirstFrame();
+    cam0_points.clear();
+    for (const auto& grid_features : *processor.curr_features_ptr)
+      for (const auto& feature : grid_features.second)
+        cam0_points.push_back(feature.cam0_point);
+    return;
+  }
+
+  static void trackFeatures(ImageProcessor& processor) {
+    processor.trackFeatures();
+    return;
+  }
+
+  static int trackedFeatureNumber(const ImageProcessor& processor) {
+    return processor.after_ransac;
+  }
+
+  static void stereoMatch(ImageProcessor& processor,
+      const vector<cv::Point2f>& cam0_points,
+      vector<cv::Point2f>& cam1_points,
+      vector<unsigned char>& inlier_markers) {
+    processor.stereoMatch(cam0_points, cam1_points, inlier_markers);
+    return;
+  }
+};
+
+} // end namespace msckf_vio
+
+namespace {
+
+// Calibration and stereo frames shared by the benchmarks.
+XmlRpc::XmlRpcValue calibration;
+sensor_msgs::ImagePtr prev_cam0_img;
+sensor_msgs::ImagePtr prev_cam1_img;
+sensor_msgs::ImagePtr curr_cam0_img;
+sensor_msgs::ImagePtr curr_cam1_img;
+
+XmlRpc::XmlRpcValue toXmlRpc(const vector<double>& values) {
+  XmlRpc::XmlRpcValue array;
+  array.setSize(values.size());
+  for (int i = 0; i < values.size(); ++i) array[i] = values[i];
+  return array;
+}
+
+sensor_msgs::ImagePtr toImageMsg(const cv::Mat& image,
+    const double& time) {
+  std_msgs::Header header;
+  header.stamp = ros::Time(time);
+  return cv_bridge::CvImage(header,
+      sensor_msgs::image_encodings::MONO8, image).toImageMsg();
+}
+
+/*
+ * @brief createSyntheticFrames Creates two stereo frames of
+ *    a textured plane parallel to the image planes, which
+ *    moves a few pixels between the frames.
+ */
+void createSyntheticFrames() {
+  const int width = 752;
+  const int height = 480;
+  const int disparity = 16;
+  const int margin = 32;
+
+  // Ideal pinhole cameras with a horizontal baseline.
+  XmlRpc::XmlRpcValue cam;
+  cam["distortion_model"] = string("radtan");
+  cam["distortion_coeffs"] = toXmlRpc({0.0, 0.0, 0.0, 0.0});
+  cam["intrinsics"] = toXmlRpc({458.0, 458.0, 376.0, 240.0});
+  cam["resolution"].setSize(2);
+  cam["resolution"][0] = width;
+  cam["resolution"][1] = height;
+  cam["T_cam_imu"] = toXmlRpc({
+      1.0, 0.0, 0.0, 0.0,
+      0.0, 1.0, 0.0, 0.0,
+      0.0, 0.0, 1.0, 0.0,
+      0.0, 0.0, 0.0, 1.0});
+  calibration["cam0"] = cam;
+
+  cam["T_cam_imu"] = toXmlRpc({
+      1.0, 0.0, 0.0, -0.11,
+      0.0, 1.0, 0.0, 0.0,
+      0.0, 0.0, 1.0, 0.0,
+      0.0, 0.0, 0.0, 1.0});
+  cam["T_cn_cnm1"] = cam["T_cam_imu"];
+  calibration["cam1"] = cam;
+
+  // Blurred noise gives plenty of corners.
+  cv::Mat noise(height+2*margin, width+2*margin+disparity, CV_8UC1);
+  cv::RNG rng(0);
+  rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+  cv::Mat texture;
+  cv::GaussianBlur(noise, texture, cv::Size(0, 0), 1.5);
+  cv::normalize(texture, texture, 0, 255, cv::NORM_MINMAX);
+
+  auto crop = [&](const int dx, const int dy) -> cv::Mat {
+    return texture(cv::Rect(margin+dx, margin+dy, width, height)).clone();
+  };
+  prev_cam0_img = toImageMsg(crop(0, 0), 1.0);
+  prev_cam1_img = toImageMsg(crop(disparity, 0), 1.0);
+  curr_cam0_img = toImageMsg(crop(3, 2), 1.05);
+  curr_cam1_img = toImageMsg(crop(3+disparity, 2), 1.05);
+  return;
+}
+
+bool loadRecordedFrames(char** argv) {
+  if (!utils::ParameterReader::loadYaml(argv[1], calibration))
+    return false;
+
+  vector<cv::Mat> images(4);
+  for (int i = 0; i < 4; ++i) {
+    images[i] = cv::imread(argv[i+2], cv::IMREAD_GRAYSCALE);
+    if (images[i].empty()) return false;
+  }
+  prev_cam0_img = toImageMsg(images[0], 1.0);
+  prev_cam1_img = toImageMsg(images[1], 1.0);
+  curr_cam0_img = toImageMsg(images[2], 1.05);
+  curr_cam1_img = toImageMsg(images[3], 1.05);
+  return true;
+}
+
+/*
+ * @brief createProcessor Creates an image processor with the
+ *    euroc configuration, except that the number of features
+ *    per grid cell is scaled to reach the given total.
+ */
+ImageProcessorPtr createProcessor(const int feature_num) {
+  XmlRpc::XmlRpcValue params = calibration;
+  params["grid_row"] = 4;
+  params["grid_col"] = 5;
+  params["grid_max_feature_num"] = max(1, feature_num/20);
+  params["grid_min_feature_num"] = max(1, feature_num/40);
+  params["pyramid_levels"] = 3;
+  params["patch_size"] = 15;
+  params["fast_threshold"] = 10;
+  params["max_iteration"] = 30;
+  params["track_precision"] = 0.01;
+  params["ransac_threshold"] = 3.0;
+  params["stereo_threshold"] = 5.0;
+  params["undistortion_lut"] = true;
+  params["adaptive_tracking"] = true;
+  params["track_error_threshold"] = 10.0;
+  params["stereo_prior"] = true;
+
+  ImageProcessorPtr processor(
+      new ImageProcessor(utils::ParameterReader(params)));
+  processor->initialize();
+  return processor;
+}
+
+void BM_StereoMatch(benchmark::State& state) {
+  ImageProcessorPtr processor = createProcessor(state.range(0));
+  ImageProcessorBenchmark::loadFrame(
+      *processor, prev_cam0_img, prev_cam1_img);
+
+  vector<cv::Point2f> cam0_points;
+  ImageProcessorBenchmark::detectFeatures(*processor, cam0_points);
+
+  vector<cv::Point2f> cam1_points;
+  vector<unsigned char> inlier_markers;
+  for (auto _ : state) {
+    cam1_points.clear();
+    ImageProcessorBenchmark::stereoMatch(
+        *processor, cam0_points, cam1_points, inlier_markers);
+  }
+  state.SetItemsProcessed(state.iterations()*cam0_points.size());
+  state.counters["features"] = cam0_points.size();
+}
+
+void BM_TrackFeatures(benchmark::State& state) {
+  ImageProcessorPtr processor = createProcessor(state.range(0));
+  processor->stereoCallback(prev_cam0_img, prev_cam1_img);
+  ImageProcessorBenchmark::loadFrame(
+      *processor, curr_cam0_img, curr_cam1_img);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    ImageProcessorBenchmark::resetCurrentFeatures(*processor);
+    state.ResumeTiming();
+    ImageProcessorBenchmark::trackFeatures(*processor);
+  }
+  state.counters["tracked"] =
+    ImageProcessorBenchmark::trackedFeatureNumber(*processor);
+}
+
+/*
+ * @brief BM_TwoPointRansac Point pairs of a pure translation
+ *    with the given percentage of outliers.
+ */
+void BM_TwoPointRansac(benchmark::State& state) {
+  const double outlier_ratio = state.range(0) / 100.0;
+  const int point_num = state.range(1);
+  const double pixel_unit = 1.0 / 458.0;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> xy_distr(-2.0, 2.0);
+  std::uniform_real_distribution<double> depth_distr(3.0, 10.0);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  vector<cv::Point2d> pts1(point_num), pts2(point_num);
+  const Eigen::Vector3d t(0.2, 0.05, 0.1);
+  for (int i = 0; i < point_num; ++i) {
+    const Eigen::Vector3d p1(xy_distr(gen), xy_distr(gen), depth_distr(gen));
+    const Eigen::Vector3d p2 = p1 - t;
+    pts1[i] = cv::Point2d(p1(0)/p1(2), p1(1)/p1(2));
+    pts2[i] = cv::Point2d(p2(0)/p2(2), p2(1)/p2(2));
+    if (uniform(gen) < outlier_ratio)
+      pts2[i] += cv::Point2d(20.0*pixel_unit, -20.0*pixel_unit);
+  }
+
+  TwoPointRansac ransac;
+  vector<int> inlier_markers;
+  for (auto _ : state)
+    ransac.estimate(pts1, pts2, pixel_unit, 3.0, 0.99, inlier_markers);
+  state.counters["iterations"] = ransac.lastIterationNumber();
+}
+
+void ransacArguments(benchmark::internal::Benchmark* b) {
+  for (const int outlier_percent : {0, 10, 30, 50})
+    for (const int point_num : {100, 400})
+      b->Args({outlier_percent, point_num});
+}
+
+} // namespace
+
+BENCHMARK(BM_StereoMatch)->Arg(80)->Arg(160)->Arg(320)
+  ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TrackFeatures)->Arg(80)->Arg(160)->Arg(320)
+  ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_TwoPointRansac)->Apply(ransacArguments)
+  ->Unit(benchmark::kMicrosecond);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  ros::Time::init();
+
+  if (argc == 6) {
+    if (!loadRecordedFrames(argv)) {
+      cerr << "Cannot load the recorded frames" << endl;
+      return 1;
+    }
+  } else if (argc == 1) {
+    createSyntheticFrames();
+  } else {
+    cerr << "Usage: " << argv[0] << " [benchmark flags] "
+      << "[<calibration yaml> <cam0 prev> <cam1 prev> "
+      << "<cam0 curr> <cam1 curr>]" << endl;
+    return 1;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
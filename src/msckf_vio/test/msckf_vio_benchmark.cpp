@@ -0,0 +1,335 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+/*
+ * Benchmarks of the filter steps on a synthetic sliding window,
+ * where the camera moves forward and every feature is observed
+ * in all the camera states.
+ *
+ * Use --benchmark_out=<file> --benchmark_out_format=json to keep
+ * the results for comparison.
+ */
+
+#include <random>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <benchmark/benchmark.h>
+
+#include <msckf_vio/msckf_vio.h>
+#include <msckf_vio/math_utils.hpp>
+#include <msckf_vio/utils.h>
+
+using namespace std;
+using namespace Eigen;
+using namespace msckf_vio;
+
+namespace msckf_vio {
+
+/*
+ * @brief MsckfVioBenchmark Gives access to the filter steps.
+ */
+class MsckfVioBenchmark {
+public:
+  typedef MsckfVio::StateServer StateServer;
+
+  /*
+   * @brief createFilter Creates a filter without ros io,
+   *    with an ideal stereo rig of 11cm baseline.
+   */
+  static MsckfVioPtr createFilter(const int max_cam_state_size) {
+    XmlRpc::XmlRpcValue identity;
+    identity.setSize(16);
+    for (int i = 0; i < 16; ++i)
+      identity[i] = (i%5 == 0) ? 1.0 : 0.0;
+    XmlRpc::XmlRpcValue T_cam0_cam1 = identity;
+    T_cam0_cam1[3] = -0.11;
+
+    XmlRpc::XmlRpcValue params;
+    params["cam0"]["T_cam_imu"] = identity;
+    params["cam1"]["T_cn_cnm1"] = T_cam0_cam1;
+    params["T_imu_body"] = identity;
+    params["publish_tf"] = false;
+    params["max_cam_state_size"] = max_cam_state_size;
+    params["feature"]["config"]["translation_threshold"] = -1.0;
+    params["noise"]["gyro"] = 0.005;
+    params["noise"]["acc"] = 0.05;
+    params["noise"]["gyro_bias"] = 0.001;
+    params["noise"]["acc_bias"] = 0.01;
+    params["noise"]["feature"] = 0.035;
+
+    MsckfVioPtr vio(new MsckfVio(utils::ParameterReader(params)));
+    vio->initialize();
+    return vio;
+  }
+
+  /*
+   * @brief setupWindow Fills the filter with window_size camera
+   *    states 10cm apart, each observing all the features,
+   *    which are spread 3 to 8 meters in front of the cameras.
+   */
+  static void setupWindow(MsckfVio& vio,
+      const int window_size, const int feature_num) {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<double> xy_distr(-2.0, 2.0);
+    std::uniform_real_distribution<double> depth_distr(3.0, 8.0);
+    std::normal_distribution<double> noise_distr(0.0, 1.0/458.0);
+
+    StateServer& state_server = vio.state_server;
+    state_server.cam_states.clear();
+    for (int i = 0; i < window_size; ++i) {
+      CAMState cam_state(i);
+      cam_state.time = 0.05 * i;
+      cam_state.orientation = smallAngleQuaternion(
+          Vector3d(0.0, 0.002*i, 0.0));
+      cam_state.position = Vector3d(0.1*i, 0.0, 0.0);
+      cam_state.orientation_null = cam_state.orientation;
+      cam_state.position_null = cam_state.position;
+      state_server.cam_states[i] = cam_state;
+    }
+
+    IMUState& imu_state = state_server.imu_state;
+    imu_state.id = window_size;
+    imu_state.time = 0.05 * window_size;
+    imu_state.orientation = Vector4d(0.0, 0.0, 0.0, 1.0);
+    imu_state.position = Vector3d(0.1*window_size, 0.0, 0.0);
+    imu_state.velocity = Vector3d(2.0, 0.0, 0.0);
+    imu_state.orientation_null = imu_state.orientation;
+    imu_state.position_null = imu_state.position;
+    imu_state.velocity_null = imu_state.velocity;
+    imu_state.R_imu_cam0 = Matrix3d::Identity();
+    imu_state.t_cam0_imu = Vector3d::Zero();
+
+    const int state_size = 21 + 6*window_size;
+    state_server.state_cov =
+      1e-4 * MatrixXd::Identity(state_size, state_size);
+
+    vio.map_server.clear();
+    for (int j = 0; j < feature_num; ++j) {
+      Feature feature(j);
+      feature.position = Vector3d(
+          xy_distr(gen), xy_distr(gen), depth_distr(gen));
+      feature.is_initialized = true;
+
+      for (const auto& item : state_server.cam_states) {
+        const CAMState& cam_state = item.second;
+        const Vector3d p_c0 = quaternionToRotation(
+            cam_state.orientation) * (feature.position-cam_state.position);
+        const Vector3d p_c1 = vio.calibration->T_cam0_cam1 * p_c0;
+        feature.observations[item.first] = Vector4d(
+            p_c0(0)/p_c0(2) + noise_distr(gen),
+            p_c0(1)/p_c0(2) + noise_distr(gen),
+            p_c1(0)/p_c1(2) + noise_distr(gen),
+            p_c1(1)/p_c1(2) + noise_distr(gen));
+      }
+      vio.map_server[j] = feature;
+    }
+
+    vio.tracking_rate = 1.0;
+    return;
+  }
+
+  static StateServer& stateServer(MsckfVio& vio) {
+    return vio.state_server;
+  }
+
+  static MapServer& mapServer(MsckfVio& vio) {
+    return vio.map_server;
+  }
+
+  static const StereoCalibration& calibration(const MsckfVio& vio) {
+    return *vio.calibration;
+  }
+
+  static vector<StateIDType> camStateIds(const MsckfVio& vio) {
+    vector<StateIDType> cam_state_ids;
+    for (const auto& item : vio.state_server.cam_states)
+      cam_state_ids.push_back(item.first);
+    return cam_state_ids;
+  }
+
+  static void processModel(MsckfVio& vio, const double& time,
+      const Vector3d& gyro, const Vector3d& acc) {
+    vio.processModel(time, gyro, acc);
+    return;
+  }
+
+  static void stateAugmentation(MsckfVio& vio, const double& time) {
+    vio.stateAugmentation(time);
+    return;
+  }
+
+  static void featureJacobian(MsckfVio& vio,
+      const FeatureIDType& feature_id,
+      const vector<StateIDType>& cam_state_ids,
+      MatrixXd& H_x, VectorXd& r) {
+    vio.featureJacobian(feature_id, cam_state_ids, H_x, r);
+    return;
+  }
+
+  // Stacks the Jacobians of all the features, as
+  // removeLostFeatures does.
+  static void stackJacobians(MsckfVio& vio,
+      MatrixXd& H_x, VectorXd& r) {
+    const vector<StateIDType> cam_state_ids = camStateIds(vio);
+    const int row_size = vio.map_server.size() *
+      (4*cam_state_ids.size()-3);
+    H_x = MatrixXd::Zero(row_size, 21+6*cam_state_ids.size());
+    r = VectorXd::Zero(row_size);
+
+    int stack_cntr = 0;
+    for (const auto& item : vio.map_server) {
+      MatrixXd H_xj;
+      VectorXd r_j;
+      vio.featureJacobian(item.first, cam_state_ids, H_xj, r_j);
+      H_x.block(stack_cntr, 0, H_xj.rows(), H_xj.cols()) = H_xj;
+      r.segment(stack_cntr, r_j.rows()) = r_j;
+      stack_cntr += H_xj.rows();
+    }
+    return;
+  }
+
+  static void measurementUpdate(MsckfVio& vio,
+      const MatrixXd& H, const VectorXd& r) {
+    vio.measurementUpdate(H, r);
+    return;
+  }
+
+  static void pruneCamStateBuffer(MsckfVio& vio) {
+    vio.pruneCamStateBuffer();
+    return;
+  }
+};
+
+} // end namespace msckf_vio
+
+namespace {
+
+void BM_ProcessModel(benchmark::State& state) {
+  const int window_size = state.range(0);
+  MsckfVioPtr vio = MsckfVioBenchmark::createFilter(window_size+1);
+  MsckfVioBenchmark::setupWindow(*vio, window_size, 0);
+
+  const Vector3d gyro(0.01, -0.02, 0.03);
+  const Vector3d acc(0.1, 0.0, 9.81);
+  double time = MsckfVioBenchmark::stateServer(*vio).imu_state.time;
+  for (auto _ : state) {
+    time += 0.005;
+    MsckfVioBenchmark::processModel(*vio, time, gyro, acc);
+  }
+}
+
+void BM_StateAugmentation(benchmark::State& state) {
+  const int window_size = state.range(0);
+  MsckfVioPtr vio = MsckfVioBenchmark::createFilter(window_size+1);
+  MsckfVioBenchmark::setupWindow(*vio, window_size, 0);
+
+  MsckfVioBenchmark::StateServer& state_server =
+    MsckfVioBenchmark::stateServer(*vio);
+  const MsckfVioBenchmark::StateServer initial_state = state_server;
+  for (auto _ : state) {
+    state.PauseTiming();
+    state_server = initial_state;
+    state.ResumeTiming();
+    MsckfVioBenchmark::stateAugmentation(
+        *vio, initial_state.imu_state.time);
+  }
+}
+
+void BM_FeatureJacobian(benchmark::State& state) {
+  const int window_size = state.range(0);
+  MsckfVioPtr vio = MsckfVioBenchmark::createFilter(window_size+1);
+  MsckfVioBenchmark::setupWindow(*vio, window_size, 1);
+
+  const vector<StateIDType> cam_state_ids =
+    MsckfVioBenchmark::camStateIds(*vio);
+  MatrixXd H_x;
+  VectorXd r;
+  for (auto _ : state) {
+    MsckfVioBenchmark::featureJacobian(
+        *vio, 0, cam_state_ids, H_x, r);
+    benchmark::DoNotOptimize(r.data());
+  }
+}
+
+void BM_MeasurementUpdate(benchmark::State& state) {
+  const int window_size = state.range(0);
+  const int feature_num = state.range(1);
+  MsckfVioPtr vio = MsckfVioBenchmark::createFilter(window_size+1);
+  MsckfVioBenchmark::setupWindow(*vio, window_size, feature_num);
+
+  MatrixXd H_x;
+  VectorXd r;
+  MsckfVioBenchmark::stackJacobians(*vio, H_x, r);
+
+  MsckfVioBenchmark::StateServer& state_server =
+    MsckfVioBenchmark::stateServer(*vio);
+  const MsckfVioBenchmark::StateServer initial_state = state_server;
+  for (auto _ : state) {
+    state.PauseTiming();
+    state_server = initial_state;
+    state.ResumeTiming();
+    MsckfVioBenchmark::measurementUpdate(*vio, H_x, r);
+  }
+  state.counters["rows"] = H_x.rows();
+}
+
+void BM_PruneCamStateBuffer(benchmark::State& state) {
+  const int window_size = state.range(0);
+  const int feature_num = state.range(1);
+  MsckfVioPtr vio = MsckfVioBenchmark::createFilter(window_size);
+  MsckfVioBenchmark::setupWindow(*vio, window_size, feature_num);
+
+  MsckfVioBenchmark::StateServer& state_server =
+    MsckfVioBenchmark::stateServer(*vio);
+  MapServer& map_server = MsckfVioBenchmark::mapServer(*vio);
+  const MsckfVioBenchmark::StateServer initial_state = state_server;
+  const MapServer initial_map = map_server;
+  for (auto _ : state) {
+    state.PauseTiming();
+    state_server = initial_state;
+    map_server = initial_map;
+    state.ResumeTiming();
+    MsckfVioBenchmark::pruneCamStateBuffer(*vio);
+  }
+}
+
+void BM_InitializePosition(benchmark::State& state) {
+  const int observation_num = state.range(0);
+  MsckfVioPtr vio = MsckfVioBenchmark::createFilter(observation_num+1);
+  MsckfVioBenchmark::setupWindow(*vio, observation_num, 1);
+
+  const CamStateServer& cam_states =
+    MsckfVioBenchmark::stateServer(*vio).cam_states;
+  Feature feature = MsckfVioBenchmark::mapServer(*vio)[0];
+  const Isometry3d T_cam0_cam1 =
+    MsckfVioBenchmark::calibration(*vio).T_cam0_cam1;
+  for (auto _ : state) {
+    feature.is_initialized = false;
+    benchmark::DoNotOptimize(feature.initializePosition(
+          cam_states, T_cam0_cam1));
+  }
+}
+
+void windowArguments(benchmark::internal::Benchmark* b) {
+  for (const int window_size : {10, 20, 30})
+    for (const int feature_num : {50, 100, 200})
+      b->Args({window_size, feature_num});
+}
+
+} // namespace
+
+BENCHMARK(BM_ProcessModel)->Arg(10)->Arg(20)->Arg(30);
+BENCHMARK(BM_StateAugmentation)->Arg(10)->Arg(20)->Arg(30);
+BENCHMARK(BM_FeatureJacobian)->Arg(10)->Arg(20)->Arg(30);
+BENCHMARK(BM_MeasurementUpdate)->Apply(windowArguments)
+  ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_PruneCamStateBuffer)->Apply(windowArguments)
+  ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_InitializePosition)->Arg(5)->Arg(10)->Arg(20);
+
+BENCHMARK_MAIN();
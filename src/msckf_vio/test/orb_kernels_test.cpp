@@ -0,0 +1,152 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include <msckf_vio/orb_kernels.hpp>
+
+using namespace std;
+using namespace msckf_vio;
+
+namespace {
+
+const int HALF_PATCH_SIZE = 15;
+
+// Rounding as in OpenCV, to the nearest even integer.
+int cvRound(const float value) {
+  return static_cast<int>(std::lrint(value));
+}
+
+// Same as the ORB extractor.
+vector<int> circleRows() {
+  vector<int> umax(HALF_PATCH_SIZE + 1);
+  int v, v0, vmax = static_cast<int>(floor(HALF_PATCH_SIZE * sqrt(2.f) / 2 + 1));
+  int vmin = static_cast<int>(ceil(HALF_PATCH_SIZE * sqrt(2.f) / 2));
+  const double hp2 = HALF_PATCH_SIZE*HALF_PATCH_SIZE;
+  for (v = 0; v <= vmax; ++v)
+    umax[v] = cvRound(sqrt(hp2 - v * v));
+  for (v = HALF_PATCH_SIZE, v0 = 0; v >= vmin; --v) {
+    while (umax[v0] == umax[v0 + 1]) ++v0;
+    umax[v] = v0;
+    ++v0;
+  }
+  return umax;
+}
+
+// The scalar code of the ORB extractor, which the kernels
+// should reproduce.
+void referenceMoments(const uint8_t* center, const int step,
+    const vector<int>& u_max, int& m_01, int& m_10) {
+  m_01 = 0;
+  m_10 = 0;
+  for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u)
+    m_10 += u * center[u];
+  for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
+    int v_sum = 0;
+    const int d = u_max[v];
+    for (int u = -d; u <= d; ++u) {
+      const int val_plus = center[u + v*step];
+      const int val_minus = center[u - v*step];
+      v_sum += (val_plus - val_minus);
+      m_10 += u * (val_plus + val_minus);
+    }
+    m_01 += v * v_sum;
+  }
+}
+
+void referenceDescriptor(const uint8_t* center, const int step,
+    const float a, const float b, const int* pattern, uint8_t* desc) {
+  for (int i = 0; i < 32; ++i, pattern += 32) {
+    int val = 0;
+    for (int j = 0; j < 8; ++j) {
+      const int* p0 = pattern + 4*j;
+      const int* p1 = p0 + 2;
+      const int t0 = center[cvRound(p0[0]*b + p0[1]*a)*step +
+        cvRound(p0[0]*a - p0[1]*b)];
+      const int t1 = center[cvRound(p1[0]*b + p1[1]*a)*step +
+        cvRound(p1[0]*a - p1[1]*b)];
+      val |= (t0 < t1) << j;
+    }
+    desc[i] = static_cast<uint8_t>(val);
+  }
+}
+
+class OrbKernelsTest : public ::testing::Test {
+protected:
+  OrbKernelsTest() : width(96), height(80), generator(7) {
+    image.resize(width*height);
+    // Smooth gradients and noise, so that the tests of the
+    // descriptors have both outcomes and ties.
+    uniform_int_distribution<int> noise(0, 3);
+    for (int y = 0; y < height; ++y)
+      for (int x = 0; x < width; ++x)
+        image[y*width+x] = static_cast<uint8_t>(
+            (x*2 + y + 40*(((x/8)+(y/8))%2) + noise(generator)) & 0xff);
+
+    // Points of the pattern within the patch, as in ORB.
+    uniform_int_distribution<int> coordinate(-13, 12);
+    pattern.resize(1024);
+    for (size_t i = 0; i < pattern.size(); ++i)
+      pattern[i] = coordinate(generator);
+  }
+
+  const uint8_t* at(const int x, const int y) const {
+    return &image[y*width+x];
+  }
+
+  const int width;
+  const int height;
+  vector<uint8_t> image;
+  vector<int> pattern;
+  mt19937 generator;
+};
+
+}
+
+TEST_F(OrbKernelsTest, patchMoments) {
+  const vector<int> umax = circleRows();
+  const PatchMoments moments(umax);
+
+  for (int y = HALF_PATCH_SIZE+1; y < height-HALF_PATCH_SIZE-1; ++y) {
+    for (int x = HALF_PATCH_SIZE+1; x < width-HALF_PATCH_SIZE-1; ++x) {
+      int m_01 = 0, m_10 = 0;
+      int ref_m_01 = 0, ref_m_10 = 0;
+      moments(at(x, y), width, m_01, m_10);
+      referenceMoments(at(x, y), width, umax, ref_m_01, ref_m_10);
+      ASSERT_EQ(m_01, ref_m_01) << x << " " << y;
+      ASSERT_EQ(m_10, ref_m_10) << x << " " << y;
+    }
+  }
+}
+
+TEST_F(OrbKernelsTest, briefDescriptor) {
+  uniform_real_distribution<float> angle(0.f, 360.f);
+  uniform_int_distribution<int> column(19, width-20);
+  uniform_int_distribution<int> row(19, height-20);
+
+  for (int k = 0; k < 2000; ++k) {
+    // Every whole degree first, then random angles.
+    const float deg = k < 360 ? static_cast<float>(k) : angle(generator);
+    const float rad = deg * static_cast<float>(M_PI / 180.0);
+    const float a = static_cast<float>(cos(rad));
+    const float b = static_cast<float>(sin(rad));
+    const uint8_t* center = at(column(generator), row(generator));
+
+    uint8_t desc[32], ref_desc[32];
+    computeBriefDescriptor(center, width, a, b, &pattern[0], desc);
+    referenceDescriptor(center, width, a, b, &pattern[0], ref_desc);
+    for (int i = 0; i < 32; ++i)
+      ASSERT_EQ(desc[i], ref_desc[i]) << deg << " " << i;
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,98 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <stdint.h>
+#include <cmath>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <gtest/gtest.h>
+#include <msckf_vio/pose_history.hpp>
+
+using namespace std;
+using namespace Eigen;
+using namespace msckf_vio;
+
+namespace {
+
+const int64_t kStep = 50000000; // 20Hz in ns
+
+// Pose rotating about z and moving along x at 1m/s.
+Isometry3d poseAt(const int64_t stamp) {
+  const double t = stamp * 1e-9;
+  Isometry3d pose = Isometry3d::Identity();
+  pose.linear() = AngleAxisd(0.1*t, Vector3d::UnitZ()).toRotationMatrix();
+  pose.translation() = Vector3d(t, 0.0, 0.0);
+  return pose;
+}
+
+}
+
+TEST(PoseHistoryTest, exactAndInterpolatedLookup) {
+  PoseHistory history(10.0);
+  for (int i = 0; i < 100; ++i)
+    EXPECT_TRUE(history.push(i*kStep, poseAt(i*kStep)));
+  EXPECT_EQ(history.size(), 100u);
+
+  // Out of order poses are dropped.
+  EXPECT_FALSE(history.push(10*kStep, poseAt(10*kStep)));
+
+  Isometry3d pose;
+  ASSERT_TRUE(history.interpolate(42*kStep, pose));
+  EXPECT_TRUE(pose.isApprox(poseAt(42*kStep), 1e-12));
+
+  const int64_t between = 42*kStep + kStep/4;
+  ASSERT_TRUE(history.interpolate(between, pose));
+  EXPECT_TRUE(pose.isApprox(poseAt(between), 1e-9));
+
+  // Outside of the history.
+  EXPECT_FALSE(history.interpolate(-1, pose));
+  EXPECT_FALSE(history.interpolate(99*kStep+1, pose));
+}
+
+TEST(PoseHistoryTest, nearestLookup) {
+  PoseHistory history(10.0);
+  for (int i = 0; i < 10; ++i)
+    history.push(i*kStep, poseAt(i*kStep));
+
+  Isometry3d pose;
+  int64_t pose_stamp = 0;
+  ASSERT_TRUE(history.nearest(3*kStep+kStep/3, kStep, pose, pose_stamp));
+  EXPECT_EQ(pose_stamp, 3*kStep);
+  ASSERT_TRUE(history.nearest(3*kStep+2*kStep/3, kStep, pose, pose_stamp));
+  EXPECT_EQ(pose_stamp, 4*kStep);
+  EXPECT_TRUE(pose.isApprox(poseAt(4*kStep), 1e-12));
+
+  ASSERT_TRUE(history.nearest(20*kStep, 20*kStep, pose, pose_stamp));
+  EXPECT_EQ(pose_stamp, 9*kStep);
+  EXPECT_FALSE(history.nearest(20*kStep, kStep, pose, pose_stamp));
+}
+
+TEST(PoseHistoryTest, dropsPosesBeyondDuration) {
+  // 20 seconds at 20Hz into a history of 5 seconds, which
+  // wraps around the ring buffer several times.
+  PoseHistory history(5.0);
+  for (int i = 0; i < 400; ++i)
+    history.push(i*kStep, poseAt(i*kStep));
+
+  EXPECT_EQ(history.size(), 101u);
+
+  Isometry3d pose;
+  EXPECT_FALSE(history.interpolate(298*kStep, pose));
+  ASSERT_TRUE(history.interpolate(299*kStep, pose));
+  EXPECT_TRUE(pose.isApprox(poseAt(299*kStep), 1e-12));
+  ASSERT_TRUE(history.interpolate(350*kStep+kStep/2, pose));
+  EXPECT_TRUE(pose.isApprox(poseAt(350*kStep+kStep/2), 1e-9));
+
+  history.clear();
+  EXPECT_EQ(history.size(), 0u);
+  EXPECT_FALSE(history.interpolate(350*kStep, pose));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,106 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <msckf_vio/profiler.hpp>
+
+using namespace std;
+using namespace msckf_vio::profiling;
+
+TEST(ProfilerTest, histogramQuantiles) {
+  Histogram histogram;
+  // 1ms to 100ms.
+  for (int i = 1; i <= 100; ++i)
+    histogram.add(i*1e-3);
+
+  EXPECT_EQ(histogram.count, 100u);
+  EXPECT_NEAR(histogram.sum/histogram.count, 50.5e-3, 1e-9);
+  EXPECT_DOUBLE_EQ(histogram.max, 100e-3);
+
+  // The quantiles are upper edges of the bins,
+  // which are about 12% wide.
+  EXPECT_GE(histogram.quantile(0.5), 50e-3);
+  EXPECT_LE(histogram.quantile(0.5), 50e-3*1.13);
+  EXPECT_GE(histogram.quantile(0.99), 99e-3);
+  EXPECT_LE(histogram.quantile(0.99), 100e-3);
+
+  histogram.clear();
+  EXPECT_EQ(histogram.count, 0u);
+  EXPECT_EQ(histogram.quantile(0.5), 0.0);
+}
+
+TEST(ProfilerTest, histogramOutOfRange) {
+  Histogram histogram;
+  histogram.add(0.0);
+  histogram.add(1e3);
+  EXPECT_EQ(histogram.count, 2u);
+  EXPECT_EQ(histogram.quantile(1.0), 1e3);
+}
+
+TEST(ProfilerTest, collectStages) {
+  Profiler profiler;
+  for (int i = 0; i < 10; ++i) {
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "outer");
+    MSCKF_VIO_PROFILE_SCOPE(profiler, "inner");
+  }
+
+  // The stages are recorded from several threads.
+  vector<thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&profiler]() {
+        MSCKF_VIO_PROFILE_SCOPE(profiler, "worker");
+      });
+  }
+  for (auto& t : threads) t.join();
+
+  vector<StageStatistics> statistics = profiler.collect();
+  ASSERT_EQ(statistics.size(), 3u);
+  // The stages are in the order of their first completion.
+  EXPECT_EQ(statistics[0].name, "inner");
+  EXPECT_EQ(statistics[1].name, "outer");
+  EXPECT_EQ(statistics[1].count, 10u);
+  EXPECT_EQ(statistics[2].name, "worker");
+  EXPECT_EQ(statistics[2].count, 4u);
+  EXPECT_LE(statistics[0].max, statistics[1].max);
+
+  // Collecting restarts the statistics.
+  EXPECT_TRUE(profiler.collect().empty());
+}
+
+TEST(ProfilerTest, chromeTrace) {
+  const string filename = "/tmp/msckf_vio_profiler_test.json";
+  {
+    Profiler profiler;
+    ASSERT_TRUE(profiler.openTrace(filename));
+    for (int i = 0; i < 3; ++i)
+      MSCKF_VIO_PROFILE_SCOPE(profiler, "stage");
+  }
+
+  ifstream fin(filename.c_str());
+  const string trace((istreambuf_iterator<char>(fin)),
+      istreambuf_iterator<char>());
+  remove(filename.c_str());
+
+  EXPECT_EQ(trace.find('['), 0u);
+  EXPECT_NE(trace.rfind(']'), string::npos);
+  size_t event_num = 0;
+  for (size_t pos = trace.find("\"ph\":\"X\""); pos != string::npos;
+      pos = trace.find("\"ph\":\"X\"", pos+1))
+    ++event_num;
+  EXPECT_EQ(event_num, 3u);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,56 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+#include <msckf_vio/track_statistics.hpp>
+
+using namespace msckf_vio;
+
+TEST(TrackStatisticsTest, lifetimeHistogram) {
+  TrackStatistics statistics(10, 5.0, 10);
+  statistics.addTrack(1);
+  statistics.addTrack(3);
+  statistics.addTrack(3);
+  statistics.addTrack(10);
+  statistics.addTrack(25);
+
+  const auto& histogram = statistics.lifetimeHistogram();
+  ASSERT_EQ(histogram.size(), 10u);
+  EXPECT_EQ(histogram[0], 1u);
+  EXPECT_EQ(histogram[2], 2u);
+  // The longer tracks are in the last bin.
+  EXPECT_EQ(histogram[9], 2u);
+  EXPECT_EQ(statistics.trackNumber(), 5u);
+  EXPECT_DOUBLE_EQ(statistics.meanLifetime(), 42.0/5.0);
+}
+
+TEST(TrackStatisticsTest, errorHistogram) {
+  TrackStatistics statistics(10, 5.0, 10);
+  EXPECT_DOUBLE_EQ(statistics.errorBinWidth(), 0.5);
+
+  statistics.addError(0.0);
+  statistics.addError(0.49);
+  statistics.addError(0.5);
+  statistics.addError(4.9);
+  statistics.addError(100.0);
+
+  const auto& histogram = statistics.errorHistogram();
+  ASSERT_EQ(histogram.size(), 10u);
+  EXPECT_EQ(histogram[0], 2u);
+  EXPECT_EQ(histogram[1], 1u);
+  EXPECT_EQ(histogram[9], 2u);
+
+  statistics.clear();
+  EXPECT_EQ(statistics.errorHistogram()[0], 0u);
+  EXPECT_EQ(statistics.trackNumber(), 0u);
+  EXPECT_DOUBLE_EQ(statistics.meanLifetime(), 0.0);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
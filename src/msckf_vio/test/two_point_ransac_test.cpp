@@ -0,0 +1,137 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <msckf_vio/two_point_ransac.hpp>
+
+using namespace std;
+using namespace Eigen;
+using namespace msckf_vio;
+
+struct Point {
+  double x;
+  double y;
+};
+
+/*
+ * @brief generateMatches Creates point pairs of a pure
+ *    translational motion, where the given ratio of the
+ *    pairs are corrupted into outliers.
+ */
+void generateMatches(const double outlier_ratio,
+    const int point_num, const double pixel_unit,
+    vector<Point>& pts1, vector<Point>& pts2,
+    vector<int>& is_inlier) {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> xy_distr(-2.0, 2.0);
+  std::uniform_real_distribution<double> depth_distr(3.0, 10.0);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::uniform_real_distribution<double> outlier_distr(10.0, 40.0);
+
+  const Vector3d t(0.2, 0.05, 0.1);
+
+  pts1.resize(point_num);
+  pts2.resize(point_num);
+  is_inlier.resize(point_num);
+  for (int i = 0; i < point_num; ++i) {
+    const Vector3d p1(xy_distr(gen), xy_distr(gen), depth_distr(gen));
+    const Vector3d p2 = p1 - t;
+    pts1[i].x = p1(0) / p1(2);
+    pts1[i].y = p1(1) / p1(2);
+    pts2[i].x = p2(0) / p2(2);
+    pts2[i].y = p2(1) / p2(2);
+    is_inlier[i] = 1;
+
+    if (uniform(gen) < outlier_ratio) {
+      // Displace the match off its epipolar line.
+      const double offset = outlier_distr(gen) * pixel_unit;
+      pts2[i].x += uniform(gen) < 0.5 ? offset : -offset;
+      pts2[i].y += uniform(gen) < 0.5 ? offset : -offset;
+      is_inlier[i] = 0;
+    }
+  }
+  return;
+}
+
+TEST(TwoPointRansacTest, outlierRejection) {
+  const double pixel_unit = 1.0 / 450.0;
+  TwoPointRansac ransac;
+
+  for (const double outlier_ratio : {0.0, 0.1, 0.3, 0.5}) {
+    vector<Point> pts1, pts2;
+    vector<int> is_inlier;
+    generateMatches(outlier_ratio, 200, pixel_unit, pts1, pts2, is_inlier);
+
+    vector<int> inlier_markers;
+    ransac.estimate(pts1, pts2, pixel_unit, 3.0, 0.99, inlier_markers);
+    ASSERT_EQ(inlier_markers.size(), pts1.size());
+
+    int missed_inliers = 0;
+    int accepted_outliers = 0;
+    for (size_t i = 0; i < is_inlier.size(); ++i) {
+      if (is_inlier[i] && !inlier_markers[i]) ++missed_inliers;
+      if (!is_inlier[i] && inlier_markers[i]) ++accepted_outliers;
+    }
+    EXPECT_EQ(missed_inliers, 0) << "outlier ratio: " << outlier_ratio;
+    EXPECT_LE(accepted_outliers, 2) << "outlier ratio: " << outlier_ratio;
+  }
+  return;
+}
+
+TEST(TwoPointRansacTest, adaptiveIterations) {
+  const double pixel_unit = 1.0 / 450.0;
+  TwoPointRansac ransac;
+
+  // Without outliers, the first valid hypothesis is supported by
+  // all the points, which should terminate the iterations.
+  vector<Point> pts1, pts2;
+  vector<int> is_inlier;
+  generateMatches(0.0, 200, pixel_unit, pts1, pts2, is_inlier);
+
+  vector<int> inlier_markers;
+  ransac.estimate(pts1, pts2, pixel_unit, 3.0, 0.99, inlier_markers);
+  EXPECT_LE(ransac.lastIterationNumber(), 3);
+
+  // With outliers, the iterations are bounded by the
+  // initial inlier ratio, 7 for the default of 0.7.
+  generateMatches(0.3, 200, pixel_unit, pts1, pts2, is_inlier);
+  ransac.estimate(pts1, pts2, pixel_unit, 3.0, 0.99, inlier_markers);
+  EXPECT_LE(ransac.lastIterationNumber(), 7);
+
+  TwoPointRansac cautious_ransac(0, 0.5);
+  cautious_ransac.estimate(pts1, pts2, pixel_unit, 3.0, 0.99, inlier_markers);
+  EXPECT_LE(cautious_ransac.lastIterationNumber(), 17);
+  return;
+}
+
+TEST(TwoPointRansacTest, degeneratedMotion) {
+  const double pixel_unit = 1.0 / 450.0;
+  TwoPointRansac ransac;
+
+  // Identical points mean there is no translation.
+  vector<Point> pts1, pts2;
+  vector<int> is_inlier;
+  generateMatches(0.0, 50, pixel_unit, pts1, pts2, is_inlier);
+  pts2 = pts1;
+  pts2[0].x += 10.0 * pixel_unit;
+
+  vector<int> inlier_markers;
+  ransac.estimate(pts1, pts2, pixel_unit, 3.0, 0.99, inlier_markers);
+  EXPECT_EQ(inlier_markers[0], 0);
+  for (size_t i = 1; i < inlier_markers.size(); ++i)
+    EXPECT_EQ(inlier_markers[i], 1);
+  return;
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
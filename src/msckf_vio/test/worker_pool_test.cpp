@@ -0,0 +1,59 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <atomic>
+#include <vector>
+#include <gtest/gtest.h>
+#include <msckf_vio/worker_pool.hpp>
+
+using namespace msckf_vio;
+
+TEST(WorkerPoolTest, parallelFor) {
+  WorkerPool pool(3);
+  EXPECT_EQ(pool.threadNumber(), 3u);
+
+  std::vector<int> values(1000, 0);
+  pool.parallelFor(values.size(), [&values](size_t i) {
+    values[i] = static_cast<int>(i) * 2;
+  });
+  for (size_t i = 0; i < values.size(); ++i)
+    EXPECT_EQ(values[i], static_cast<int>(i) * 2);
+
+  // Nothing to do.
+  pool.parallelFor(0, [](size_t) { FAIL(); });
+}
+
+TEST(WorkerPoolTest, serial) {
+  WorkerPool pool(0);
+  std::vector<size_t> order;
+  pool.parallelFor(5, [&order](size_t i) { order.push_back(i); });
+  ASSERT_EQ(order.size(), 5u);
+  for (size_t i = 0; i < order.size(); ++i) EXPECT_EQ(order[i], i);
+}
+
+TEST(WorkerPoolTest, nested) {
+  WorkerPool pool(2);
+  std::atomic<int> count(0);
+  // E.g. the left and right images, and the cells of each.
+  pool.parallelFor(2, [&pool, &count](size_t) {
+    pool.parallelFor(100, [&count](size_t) { ++count; });
+  });
+  EXPECT_EQ(count.load(), 200);
+}
+
+TEST(WorkerPoolTest, repeated) {
+  WorkerPool pool(4);
+  std::atomic<int> count(0);
+  for (int k = 0; k < 200; ++k)
+    pool.parallelFor(8, [&count](size_t) { ++count; });
+  EXPECT_EQ(count.load(), 1600);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}